@@ -3,11 +3,13 @@
 #include <iostream>
 
 #include "commutativeRExp.h"
+#include "hash.h"
 
 // this creates the empty set
 CommutativeRExp::CommutativeRExp()
 {
 	this->type = Empty;
+	this->rehash();
 }
 
 // used by boost::ublas with CommutativeRExp(0) to
@@ -17,12 +19,14 @@ CommutativeRExp::CommutativeRExp(int zero)
 	assert(zero == 0);
 
 	this->type = Empty;
+	this->rehash();
 }
 
 CommutativeRExp::CommutativeRExp(VarPtr var)
 {
 	this->type = Element;
 	this->elem = Var::getVar(var);
+	this->rehash();
 }
 
 CommutativeRExp::CommutativeRExp(enum optype type, std::shared_ptr<std::set<CommutativeRExp>> seta)
@@ -31,6 +35,7 @@ CommutativeRExp::CommutativeRExp(enum optype type, std::shared_ptr<std::set<Comm
 	if(this->type != Addition)
 		assert(false); // should not be called with this constructor...
 	this->seta = seta;
+	this->rehash();
 }
 
 CommutativeRExp::CommutativeRExp(enum optype type, std::shared_ptr<std::multiset<CommutativeRExp>> setm)
@@ -39,6 +44,7 @@ CommutativeRExp::CommutativeRExp(enum optype type, std::shared_ptr<std::multiset
 	if(this->type != Multiplication)
 		assert(false); // should not be called with this constructor...
 	this->setm = setm;
+	this->rehash();
 }
 
 CommutativeRExp::CommutativeRExp(enum optype type, std::shared_ptr<CommutativeRExp> rexp)
@@ -47,6 +53,7 @@ CommutativeRExp::CommutativeRExp(enum optype type, std::shared_ptr<CommutativeRE
 	if(this->type != Star && this->type != Plus)
 		assert(false); // should not be called with this constructor...
 	this->rexp = rexp;
+	this->rehash();
 }
 
 CommutativeRExp::CommutativeRExp(const CommutativeRExp& expr)
@@ -66,10 +73,7 @@ CommutativeRExp::CommutativeRExp(const CommutativeRExp& expr)
 		;// Do nothing
 	else
 		assert(false);
-}
-
-CommutativeRExp::~CommutativeRExp()
-{
+	this->hash_ = expr.hash_;
 }
 
 /*
@@ -96,6 +100,7 @@ void CommutativeRExp::optimize(bool one)
 			{
 				auto tmp = *elem;
 				tmp.type = Star;
+				tmp.rehash();
 				set_copy->erase(*elem);
 				set_copy->insert(tmp);
 				changed = true;
@@ -164,7 +169,7 @@ void CommutativeRExp::optimize(bool one)
 }
 
 // union operator
-CommutativeRExp CommutativeRExp::operator +=(const CommutativeRExp& expr)
+CommutativeRExp& CommutativeRExp::operator +=(const CommutativeRExp& expr)
 {
 	std::shared_ptr<std::set<CommutativeRExp> > retset(new std::set<CommutativeRExp>());
 
@@ -194,11 +199,36 @@ CommutativeRExp CommutativeRExp::operator +=(const CommutativeRExp& expr)
 		return *this; // so we can just return one of the elements // TODO: check this! quick test shows this is right
 	this->type = Addition;
 	this->seta = retset;
-	// x+(x^*) = x^*
-	// check if there was at least one star in the multiplication set
+	optimize_addition();
+	this->rehash();
+	return *this;
+}
+
+// acc += lhs * rhs, but if acc is a sum that nobody else shares, the product is
+// inserted directly into its set instead of copying the whole set
+void CommutativeRExp::AddMul(CommutativeRExp& acc, const CommutativeRExp& lhs, const CommutativeRExp& rhs)
+{
+	CommutativeRExp product = lhs * rhs;
+	if(acc.type != Addition || acc.seta.use_count() != 1 || product.type == Empty)
+	{
+		acc += product;
+		return;
+	}
+	if(product.type == Addition)
+		acc.seta->insert(product.seta->begin(), product.seta->end());
+	else
+		acc.seta->insert(product);
+	acc.optimize_addition();
+	acc.rehash();
+}
+
+// x+(x^*) = x^*
+void CommutativeRExp::optimize_addition()
+{
+	// check if there was at least one star in the addition set
 	bool star_found = false;
 	bool one_found = false;
-	for(auto it = retset->begin(); it != retset->end(); ++it) // TODO: maybe reverse search order!
+	for(auto it = this->seta->begin(); it != this->seta->end(); ++it) // TODO: maybe reverse search order!
 	{
 		if(it->type == Star)
 		{
@@ -213,7 +243,6 @@ CommutativeRExp CommutativeRExp::operator +=(const CommutativeRExp& expr)
 	}
 	if(star_found)
 		optimize(one_found);
-	return *this;
 }
 
 // try to find a case of xx^* and convert it to x^+
@@ -289,7 +318,7 @@ void CommutativeRExp::optimize_starplus()
 }
 
 // concatenate all expressions from first set with all expressions of the second set
-CommutativeRExp CommutativeRExp::operator *=(const CommutativeRExp& expr)
+CommutativeRExp& CommutativeRExp::operator *=(const CommutativeRExp& expr)
 {
 	std::shared_ptr<std::multiset<CommutativeRExp> > retset(new std::multiset<CommutativeRExp>());
 
@@ -341,6 +370,7 @@ CommutativeRExp CommutativeRExp::operator *=(const CommutativeRExp& expr)
 	this->type = Multiplication;
 	if(star_found)
 		optimize_starplus();
+	this->rehash();
 
 	return *this;
 }
@@ -361,6 +391,8 @@ bool CommutativeRExp::operator <(const CommutativeRExp& rhs) const
 			case Addition: // length- then lexicographic-order based on elements of seta
 				if(this->seta->size() < rhs.seta->size())
 					return true;
+				else if(this->seta->size() > rhs.seta->size())
+					return false;
 
 				for(auto l_it = this->seta->begin(), r_it = rhs.seta->begin();
 					(l_it != this->seta->end() ) && (r_it != rhs.seta->end());
@@ -380,6 +412,8 @@ bool CommutativeRExp::operator <(const CommutativeRExp& rhs) const
 			case Multiplication: // length- then lexicographic-order based on elements of setm
 				if(this->setm->size() < rhs.setm->size())
 					return true;
+				else if(this->setm->size() > rhs.setm->size())
+					return false;
 
 				for(auto l_it = this->setm->begin(), r_it = rhs.setm->begin();
 					(l_it != this->setm->end() ) && (r_it != rhs.setm->end());
@@ -419,6 +453,8 @@ bool CommutativeRExp::operator ==(const CommutativeRExp& expr) const
 			case Element:
 				return this->elem == expr.elem;
 			case Addition: // all elements have to be equal
+				if(this->seta->size() != expr.seta->size())
+					return false;
 				for(auto l_it = this->seta->begin(), r_it = expr.seta->begin();
 					(l_it != this->seta->end() ) && (r_it != expr.seta->end());
 					++l_it, ++r_it )
@@ -428,6 +464,8 @@ bool CommutativeRExp::operator ==(const CommutativeRExp& expr) const
 				}
 				return true; // all elements are equal
 			case Multiplication: // all elements have to be equal
+				if(this->setm->size() != expr.setm->size())
+					return false;
 				for(auto l_it = this->setm->begin(), r_it = expr.setm->begin();
 					(l_it != this->setm->end() ) && (r_it != expr.setm->end());
 					++l_it, ++r_it )
@@ -460,16 +498,16 @@ CommutativeRExp CommutativeRExp::star() const
 
 CommutativeRExp CommutativeRExp::null()
 {
-	if(!CommutativeRExp::elem_null)
-		CommutativeRExp::elem_null = std::shared_ptr<CommutativeRExp>(new CommutativeRExp());
-	return *CommutativeRExp::elem_null;
+	// a local static is initialized only once, even if several threads get
+	// here at the same time
+	static const CommutativeRExp elem_null;
+	return elem_null;
 }
 
 CommutativeRExp CommutativeRExp::one()
 {
-	if(!CommutativeRExp::elem_one)
-		CommutativeRExp::elem_one = std::shared_ptr<CommutativeRExp>(new CommutativeRExp(Var::getVar("ε")));
-	return *CommutativeRExp::elem_one;
+	static const CommutativeRExp elem_one(Var::getVar("ε"));
+	return elem_one;
 }
 
 std::ostream& operator<<(std::ostream& os, const std::set<CommutativeRExp>& set)
@@ -516,7 +554,21 @@ std::string CommutativeRExp::string() const
 	return this->generateString();
 }
 
+void CommutativeRExp::rehash()
+{
+	std::size_t h = this->type;
+	if(this->type == Element)
+		HashCombine(h, this->elem);
+	else if(this->type == Addition)
+		for(auto &term : *this->seta)
+			HashCombine(h, term);
+	else if(this->type == Multiplication)
+		for(auto &term : *this->setm)
+			HashCombine(h, term);
+	else if(this->type == Star || this->type == Plus)
+		HashCombine(h, *this->rexp);
+	this->hash_ = h;
+}
+
 bool CommutativeRExp::is_idempotent = true;
 bool CommutativeRExp::is_commutative = true;
-std::shared_ptr<CommutativeRExp> CommutativeRExp::elem_null;
-std::shared_ptr<CommutativeRExp> CommutativeRExp::elem_one;
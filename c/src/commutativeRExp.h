@@ -53,14 +53,17 @@ private:
 	std::shared_ptr<std::set<CommutativeRExp>> seta;
 	std::shared_ptr<std::multiset<CommutativeRExp>> setm;
 	std::shared_ptr<CommutativeRExp> rexp;
+	// the structural hash, computed by rehash() whenever the expression is
+	// built or changed (the hashes of the subexpressions are already stored
+	// in them, so this does not recurse)
+	std::size_t hash_;
+	void rehash();
 	void optimize_starplus();
 	void optimize(bool one);
+	void optimize_addition();
 	std::string generateString() const;
 
 public:
-	static std::shared_ptr<CommutativeRExp> elem_null;
-	static std::shared_ptr<CommutativeRExp> elem_one;
-
 	CommutativeRExp();
 	CommutativeRExp(int zero);
 	CommutativeRExp(VarPtr var);
@@ -68,17 +71,37 @@ public:
 	CommutativeRExp(enum optype type, std::shared_ptr<std::multiset<CommutativeRExp>> setm);
 	CommutativeRExp(enum optype type, std::shared_ptr<CommutativeRExp> term);
 	CommutativeRExp(const CommutativeRExp& expr);
-	virtual ~CommutativeRExp();
-	CommutativeRExp operator += (const CommutativeRExp& term);
-	CommutativeRExp operator *= (const CommutativeRExp& term);
+	CommutativeRExp(CommutativeRExp&& expr) = default;
+	CommutativeRExp& operator = (const CommutativeRExp& expr) = default;
+	CommutativeRExp& operator = (CommutativeRExp&& expr) = default;
+	CommutativeRExp& operator += (const CommutativeRExp& term);
+	CommutativeRExp& operator *= (const CommutativeRExp& term);
+	static void AddMul(CommutativeRExp& acc, const CommutativeRExp& lhs, const CommutativeRExp& rhs);
 	bool operator < (const CommutativeRExp& term) const;
 	bool operator == (const CommutativeRExp& term) const;
 	CommutativeRExp star () const;
 	static CommutativeRExp null();
 	static CommutativeRExp one();
 	std::string string() const;
+	// structural hash, consistent with ==
+	std::size_t hash() const
+	{
+		return this->hash_;
+	}
 	static bool is_idempotent;
 	static bool is_commutative;
 };
 
+namespace std {
+
+template <>
+struct hash<CommutativeRExp> {
+	std::size_t operator()(const CommutativeRExp& expr) const
+	{
+		return expr.hash();
+	}
+};
+
+}
+
 #endif /* COMMUTATIVEREXP_H_ */
@@ -16,7 +16,7 @@ class CountingSemiring : public Semiring<CountingSemiring>
 public:
 	static bool is_idempotent;
 	static bool is_commutative;
-	virtual std::string string() const = 0;
+	std::string string() const;
 };
 
 //CountingSemiring::is_idempotent = true;
@@ -1,8 +1,11 @@
+#include <algorithm>
 #include <cassert>
 #include <sstream>
 #include <limits> // for epsilon
 #include <cmath> // for fabs
+#include <vector>
 #include "float-semiring.h"
+#include "float_kernels.h"
 
 // std::map in polynomial.h wants this constructor...
 FloatSemiring::FloatSemiring()
@@ -16,17 +19,13 @@ FloatSemiring::FloatSemiring(const float val)
 	this->val = val;
 }
 
-FloatSemiring::~FloatSemiring()
-{
-}
-
-FloatSemiring FloatSemiring::operator+=(const FloatSemiring& elem)
+FloatSemiring& FloatSemiring::operator+=(const FloatSemiring& elem)
 {
 	this->val += elem.val;
 	return *this;
 }
 
-FloatSemiring FloatSemiring::operator*=(const FloatSemiring& elem)
+FloatSemiring& FloatSemiring::operator*=(const FloatSemiring& elem)
 {
 	this->val *= elem.val;
 	return *this;
@@ -47,16 +46,16 @@ FloatSemiring FloatSemiring::star() const
 
 FloatSemiring FloatSemiring::null()
 {
-	if(!FloatSemiring::elem_null)
-		FloatSemiring::elem_null = std::shared_ptr<FloatSemiring>(new FloatSemiring(0));
-	return *FloatSemiring::elem_null;
+	// a local static is initialized only once, even if several threads (e.g.,
+	// of a ThreadPool evaluating a tape) get here at the same time
+	static const FloatSemiring elem_null{0};
+	return elem_null;
 }
 
 FloatSemiring FloatSemiring::one()
 {
-	if(!FloatSemiring::elem_one)
-		FloatSemiring::elem_one = std::shared_ptr<FloatSemiring>(new FloatSemiring(1));
-	return *FloatSemiring::elem_one;
+	static const FloatSemiring elem_one{1};
+	return elem_one;
 }
 
 std::string FloatSemiring::string() const
@@ -66,7 +65,86 @@ std::string FloatSemiring::string() const
 	return ss.str();
 }
 
+float FloatSemiring::getValue() const
+{
+	return this->val;
+}
+
+namespace {
+
+// the kernels work on plain arrays of floats, so these copy the views to and
+// from such arrays (row by row)
+std::vector<float> ToFloats(const MatrixView<const FloatSemiring> &view)
+{
+	std::size_t columns = view.getColumns();
+	std::vector<float> result(view.getRows() * columns);
+	for(std::size_t r = 0; r < view.getRows(); ++r)
+		for(std::size_t c = 0; c < columns; ++c)
+			result[r * columns + c] = view.At(r, c).getValue();
+	return result;
+}
+
+void FromFloats(const std::vector<float> &floats, const MatrixView<FloatSemiring> &view)
+{
+	std::size_t columns = view.getColumns();
+	assert(floats.size() == view.getRows() * columns);
+	for(std::size_t r = 0; r < view.getRows(); ++r)
+		for(std::size_t c = 0; c < columns; ++c)
+			view.At(r, c) = FloatSemiring(floats[r * columns + c]);
+}
+
+} /* Anonymous namespace. */
+
+template <>
+void Matrix<FloatSemiring>::MultiplyInto(
+		const MatrixView<const FloatSemiring> &lhs,
+		const MatrixView<const FloatSemiring> &rhs,
+		const MatrixView<FloatSemiring> &result)
+{
+	assert(lhs.getColumns() == rhs.getRows());
+	assert(result.getRows() == lhs.getRows() &&
+	       result.getColumns() == rhs.getColumns());
+	// FloatSemiring is just a float (see float-semiring.h), so the rows of the
+	// views are arrays of floats and the kernel can work on them in place
+	FloatMultiply(reinterpret_cast<const float*>(lhs.getData()), lhs.getStride(),
+	              reinterpret_cast<const float*>(rhs.getData()), rhs.getStride(),
+	              reinterpret_cast<float*>(result.getData()), result.getStride(),
+	              lhs.getRows(), lhs.getColumns(), rhs.getColumns());
+}
+
+template <>
+Matrix<FloatSemiring> Matrix<FloatSemiring>::FloydWarshall() const
+{
+	assert(columns_ == rows_);
+	std::vector<float> floats = ToFloats(View());
+	FloatClosure(floats.data(), rows_);
+	Matrix result{rows_, columns_};
+	FromFloats(floats, result.View());
+	return result;
+}
+
+template <>
+Matrix<FloatSemiring> Matrix<FloatSemiring>::StarSolve(
+		const Matrix<FloatSemiring> &rhs) const
+{
+	assert(columns_ == rows_ && rows_ == rhs.rows_);
+	std::vector<float> floats = ToFloats(View());
+	std::vector<float> rhs_floats = ToFloats(rhs.View());
+	std::vector<float> result_floats(rhs_floats.size());
+	bool solved = FloatStarSolve(floats.data(), rhs_floats.data(),
+	                             result_floats.data(), rows_, rhs.columns_);
+	// A* * rhs is never negative, so a negative (or infinite or NaN) solution
+	// means that 1 - A is (close to) singular or that rounding went wrong.
+	// In both cases we don't trust the solve and compute the star in the
+	// semiring instead, which fails loudly if it doesn't exist (see star()).
+	for(std::size_t i = 0; solved && i < result_floats.size(); ++i)
+		solved = std::isfinite(result_floats[i]) && result_floats[i] >= 0.0f;
+	if(!solved)
+		return star() * rhs;
+	Matrix result{rhs.rows_, rhs.columns_};
+	FromFloats(result_floats, result.View());
+	return result;
+}
+
 bool FloatSemiring::is_idempotent = false;
 bool FloatSemiring::is_commutative = true;
-std::shared_ptr<FloatSemiring> FloatSemiring::elem_null;
-std::shared_ptr<FloatSemiring> FloatSemiring::elem_one;
@@ -1,29 +1,96 @@
 #ifndef FLOAT_SEMIRING_H
 #define FLOAT_SEMIRING_H
 
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <memory>
+#include <type_traits>
 #include "semiring.h"
 
 class FloatSemiring : public Semiring<FloatSemiring>
 {
 private:
 	float val;
-	static std::shared_ptr<FloatSemiring> elem_null;
-	static std::shared_ptr<FloatSemiring> elem_one;
 public:
 	FloatSemiring();
 	FloatSemiring(const float val);
-	virtual ~FloatSemiring();
-	FloatSemiring operator += (const FloatSemiring& elem);
-	FloatSemiring operator *= (const FloatSemiring& elem);
+	FloatSemiring& operator += (const FloatSemiring& elem);
+	FloatSemiring& operator *= (const FloatSemiring& elem);
+	static void AddMul(FloatSemiring& acc, const FloatSemiring& lhs, const FloatSemiring& rhs)
+	{
+		acc.val += lhs.val * rhs.val;
+	}
+	static bool IsNegligible(const FloatSemiring& update, const FloatSemiring& value, const Tolerance& tolerance)
+	{
+		return update.val <= tolerance.absolute + tolerance.relative * value.val;
+	}
 	bool operator == (const FloatSemiring& elem) const;
 	FloatSemiring star () const;
 	static FloatSemiring null();
 	static FloatSemiring one();
 	std::string string() const;
+	float getValue() const;
 	static bool is_idempotent;
 	static bool is_commutative;
 };
 
+// == allows for a relative error of about one ulp, which is not transitive,
+// so no useful hash agrees with it and there is no std::hash<FloatSemiring>.
+// As the keys of a SemiringMap the elements are compared by their bits
+// instead, so two values that differ only in rounding are different keys
+// (e.g., make_free just uses another variable for them).
+template <>
+struct SemiringHash<FloatSemiring>
+{
+	std::size_t operator()(const FloatSemiring& elem) const
+	{
+		return std::hash<std::uint32_t>()(FloatBits(elem));
+	}
+
+	static std::uint32_t FloatBits(const FloatSemiring& elem)
+	{
+		float value = elem.getValue();
+		std::uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+};
+
+template <>
+struct SemiringEqual<FloatSemiring>
+{
+	bool operator()(const FloatSemiring& lhs, const FloatSemiring& rhs) const
+	{
+		return SemiringHash<FloatSemiring>::FloatBits(lhs) ==
+			SemiringHash<FloatSemiring>::FloatBits(rhs);
+	}
+};
+
+// no vtable, so a matrix of FloatSemiring is just an array of floats
+static_assert(sizeof(FloatSemiring) == sizeof(float) &&
+              std::is_trivially_copyable<FloatSemiring>::value &&
+              std::is_standard_layout<FloatSemiring>::value,
+              "FloatSemiring should be a plain float");
+
+#include "matrix.h"
+
+/* Dense matrices of floats use the kernels from float_kernels.h (on raw float
+ * arrays) instead of going through the semiring operators element by element.
+ * These specializations have to be visible wherever Matrix<FloatSemiring> is
+ * used, so they're declared right here. */
+template <>
+void Matrix<FloatSemiring>::MultiplyInto(
+		const MatrixView<const FloatSemiring> &lhs,
+		const MatrixView<const FloatSemiring> &rhs,
+		const MatrixView<FloatSemiring> &result);
+
+template <>
+Matrix<FloatSemiring> Matrix<FloatSemiring>::FloydWarshall() const;
+
+/* For reals, A* = (1 - A)^-1, so A* * rhs is just a linear solve. */
+template <>
+Matrix<FloatSemiring> Matrix<FloatSemiring>::StarSolve(
+		const Matrix<FloatSemiring> &rhs) const;
+
 #endif
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#include "float_batch_tape.h"
+#include "float_kernels.h"
+
+FloatBatchTape::FloatBatchTape(const FreeTape &tape)
+    : vars_(tape.vars_), rows_(tape.rows_), columns_(tape.columns_),
+      num_registers_(0) {
+  typedef FreeTape::Opcode Opcode;
+  const auto &instructions = tape.tape_;
+  const std::uint32_t kForever = std::numeric_limits<std::uint32_t>::max();
+  const std::uint32_t kUnused = kForever - 1;
+
+  /* The instructions whose values are needed for the elements of the matrix,
+   * found backwards from the outputs (the operands always come before the
+   * instructions that read them). */
+  std::vector<std::uint8_t> live(instructions.size(), false);
+  for (auto output : tape.outputs_) {
+    live[output] = true;
+  }
+  for (std::size_t i = instructions.size(); i-- > 0;) {
+    if (!live[i]) {
+      continue;
+    }
+    const auto &instruction = instructions[i];
+    switch (instruction.opcode) {
+      case Opcode::kAddition:
+      case Opcode::kMultiplication:
+        live[instruction.rhs] = true;
+        /* Fall through. */
+      case Opcode::kStar:
+        live[instruction.lhs] = true;
+        break;
+      default:
+        break;
+    }
+  }
+
+  /* The last live instruction that reads the value of every instruction (the
+   * elements of the matrix are needed until the end).  Dead instructions are
+   * never executed, so they must not keep their operands alive. */
+  std::vector<std::uint32_t> last_use(instructions.size(), kUnused);
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    if (!live[i]) {
+      continue;
+    }
+    const auto &instruction = instructions[i];
+    switch (instruction.opcode) {
+      case Opcode::kAddition:
+      case Opcode::kMultiplication:
+        last_use[instruction.rhs] = i;
+        /* Fall through. */
+      case Opcode::kStar:
+        last_use[instruction.lhs] = i;
+        break;
+      default:
+        break;
+    }
+  }
+  for (auto output : tape.outputs_) {
+    last_use[output] = kForever;
+  }
+
+  /* Every operand that is read for the last time frees its register before
+   * we pick the one for the result.  So the result can go to the register of
+   * one of its operands, which is fine since all the kernels work element by
+   * element. */
+  std::vector<std::uint32_t> registers(instructions.size());
+  std::vector<std::uint32_t> free_registers;
+  auto release = [&](std::uint32_t operand, std::uint32_t i) {
+    if (last_use[operand] == i) {
+      free_registers.push_back(registers[operand]);
+      last_use[operand] = kUnused;  /* Don't release it twice for x * x. */
+    }
+  };
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    const auto &instruction = instructions[i];
+    if (!live[i]) {
+      continue;  /* Nobody needs the value. */
+    }
+    Instruction code{instruction.opcode, 0, instruction.lhs, instruction.rhs};
+    switch (instruction.opcode) {
+      case Opcode::kAddition:
+      case Opcode::kMultiplication:
+        code.lhs = registers[instruction.lhs];
+        code.rhs = registers[instruction.rhs];
+        release(instruction.lhs, i);
+        release(instruction.rhs, i);
+        break;
+      case Opcode::kStar:
+        code.lhs = registers[instruction.lhs];
+        release(instruction.lhs, i);
+        break;
+      default:
+        break;
+    }
+    if (free_registers.empty()) {
+      free_registers.push_back(num_registers_++);
+    }
+    registers[i] = free_registers.back();
+    free_registers.pop_back();
+    code.result = registers[i];
+    code_.push_back(code);
+  }
+
+  for (auto output : tape.outputs_) {
+    outputs_.push_back(registers[output]);
+  }
+}
+
+std::vector< Matrix<FloatSemiring> > FloatBatchTape::Eval(
+    const std::unordered_map< VarPtr, std::vector<float> > &valuations)
+  const {
+  typedef FreeTape::Opcode Opcode;
+  const std::size_t lanes =
+    valuations.empty() ? 0 : valuations.begin()->second.size();
+
+  /* The lanes of register r are values[r * lanes], ...,
+   * values[(r + 1) * lanes - 1]. */
+  std::vector<float> values(num_registers_ * lanes);
+  auto lanes_of = [&values, lanes](std::uint32_t r) {
+    return values.data() + r * lanes;
+  };
+
+  for (const auto &code : code_) {
+    float *result = lanes_of(code.result);
+    switch (code.opcode) {
+      case Opcode::kAddition:
+        FloatLanesAdd(lanes_of(code.lhs), lanes_of(code.rhs), result, lanes);
+        break;
+      case Opcode::kMultiplication:
+        FloatLanesMultiply(lanes_of(code.lhs), lanes_of(code.rhs), result,
+                           lanes);
+        break;
+      case Opcode::kStar:
+        FloatLanesStar(lanes_of(code.lhs), result, lanes);
+        break;
+      case Opcode::kElement: {
+        auto iter = valuations.find(vars_[code.lhs]);
+        assert(iter != valuations.end() && iter->second.size() == lanes);
+        std::copy(iter->second.begin(), iter->second.end(), result);
+        break;
+      }
+      case Opcode::kEpsilon:
+        std::fill(result, result + lanes, 1.0f);
+        break;
+      case Opcode::kEmpty:
+        std::fill(result, result + lanes, 0.0f);
+        break;
+    }
+  }
+
+  std::vector< Matrix<FloatSemiring> > result;
+  result.reserve(lanes);
+  for (std::size_t lane = 0; lane < lanes; ++lane) {
+    if (outputs_.empty()) {
+      result.emplace_back(rows_, columns_);
+      continue;
+    }
+    std::vector<FloatSemiring> elements;
+    elements.reserve(outputs_.size());
+    for (auto output : outputs_) {
+      elements.emplace_back(lanes_of(output)[lane]);
+    }
+    result.emplace_back(rows_, std::move(elements));
+  }
+  return result;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "float-semiring.h"
+#include "free-tape.h"
+#include "matrix.h"
+#include "var.h"
+
+/*
+ * FloatBatchTape
+ *
+ * Evaluates a FreeTape in FloatSemiring for a whole batch of valuations at
+ * once (e.g., for a parameter sweep over the coefficients).  Every value of
+ * the tape is a vector with one float per valuation (a lane) and every
+ * instruction is a single vectorized loop over all the lanes (see
+ * FloatLanesAdd and friends), so the cost of going through the tape is paid
+ * once per batch instead of once per valuation.  The results are exactly the
+ * same as evaluating the tape for each of the valuations separately.
+ *
+ * A tape has one value per instruction, but most of them are needed only
+ * briefly.  So the constructor assigns the values to registers (a register is
+ * reused once the last instruction that reads its value is done), which keeps
+ * the memory for the lanes proportional to the number of values that are live
+ * at the same time, not to the size of the tape.
+ */
+class FloatBatchTape {
+  public:
+    explicit FloatBatchTape(const FreeTape &tape);
+
+    /* The valuations contain the values of every variable of the tape (see
+     * FreeTape::GetVars) in all the lanes, so all the vectors must have the
+     * same size.  Returns the matrix for each of the lanes. */
+    std::vector< Matrix<FloatSemiring> > Eval(
+        const std::unordered_map< VarPtr, std::vector<float> > &valuations)
+      const;
+
+    /* The number of values (for every lane) that we need to keep. */
+    std::size_t GetNumRegisters() const { return num_registers_; }
+
+  private:
+    /* Same as FreeTape::Instruction, but with registers instead of the
+     * indices of the instructions. */
+    struct Instruction {
+      FreeTape::Opcode opcode;
+      std::uint32_t result;
+      std::uint32_t lhs;
+      std::uint32_t rhs;
+    };
+
+    std::vector<Instruction> code_;
+    std::vector<VarPtr> vars_;
+
+    /* The register of every element of the matrix. */
+    std::vector<std::uint32_t> outputs_;
+    std::size_t rows_;
+    std::size_t columns_;
+    std::size_t num_registers_;
+};
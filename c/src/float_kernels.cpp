@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FLOAT_KERNELS_AVX2
+#include <immintrin.h>
+#endif
+
+#include "float_kernels.h"
+
+namespace {
+
+/* Size of the blocks of the inner dimension, so that the corresponding rows of
+ * rhs stay in the cache while we go over all the rows of lhs. */
+const std::size_t kInnerBlock = 128;
+
+void ScalarMultiply(const float *lhs, std::size_t lhs_stride,
+                    const float *rhs, std::size_t rhs_stride,
+                    float *result, std::size_t result_stride,
+                    std::size_t rows, std::size_t inner, std::size_t columns) {
+  for (std::size_t r = 0; r < rows; ++r) {
+    std::fill(result + r * result_stride, result + r * result_stride + columns,
+              0.0f);
+  }
+  for (std::size_t block = 0; block < inner; block += kInnerBlock) {
+    std::size_t block_end = std::min(block + kInnerBlock, inner);
+    for (std::size_t r = 0; r < rows; ++r) {
+      float *result_row = result + r * result_stride;
+      for (std::size_t i = block; i < block_end; ++i) {
+        float lhs_elem = lhs[r * lhs_stride + i];
+        const float *rhs_row = rhs + i * rhs_stride;
+        for (std::size_t c = 0; c < columns; ++c) {
+          result_row[c] += lhs_elem * rhs_row[c];
+        }
+      }
+    }
+  }
+}
+
+/* Adds factor * pivot_row to row (both of the given size). */
+void ScalarRowUpdate(float *row, const float *pivot_row, float factor,
+                     std::size_t size) {
+  for (std::size_t j = 0; j < size; ++j) {
+    row[j] += factor * pivot_row[j];
+  }
+}
+
+void ScalarLanesAdd(const float *lhs, const float *rhs, float *result,
+                    std::size_t size) {
+  for (std::size_t i = 0; i < size; ++i) {
+    result[i] = lhs[i] + rhs[i];
+  }
+}
+
+void ScalarLanesMultiply(const float *lhs, const float *rhs, float *result,
+                         std::size_t size) {
+  for (std::size_t i = 0; i < size; ++i) {
+    result[i] = lhs[i] * rhs[i];
+  }
+}
+
+void ScalarLanesStar(const float *values, float *result, std::size_t size) {
+  for (std::size_t i = 0; i < size; ++i) {
+    result[i] = 1 / (1 - values[i]);
+  }
+}
+
+#ifdef FLOAT_KERNELS_AVX2
+
+__attribute__((target("avx2")))
+void AvxMultiply(const float *lhs, std::size_t lhs_stride,
+                 const float *rhs, std::size_t rhs_stride,
+                 float *result, std::size_t result_stride,
+                 std::size_t rows, std::size_t inner, std::size_t columns) {
+  for (std::size_t r = 0; r < rows; ++r) {
+    std::fill(result + r * result_stride, result + r * result_stride + columns,
+              0.0f);
+  }
+  for (std::size_t block = 0; block < inner; block += kInnerBlock) {
+    std::size_t block_end = std::min(block + kInnerBlock, inner);
+    for (std::size_t r = 0; r < rows; ++r) {
+      float *result_row = result + r * result_stride;
+      for (std::size_t i = block; i < block_end; ++i) {
+        float lhs_elem = lhs[r * lhs_stride + i];
+        __m256 lhs_vec = _mm256_set1_ps(lhs_elem);
+        const float *rhs_row = rhs + i * rhs_stride;
+        std::size_t c = 0;
+        /* Separate multiplication and addition (no FMA) to round exactly like
+         * the scalar version. */
+        for (; c + 8 <= columns; c += 8) {
+          __m256 product = _mm256_mul_ps(lhs_vec, _mm256_loadu_ps(rhs_row + c));
+          __m256 sum = _mm256_add_ps(_mm256_loadu_ps(result_row + c), product);
+          _mm256_storeu_ps(result_row + c, sum);
+        }
+        for (; c < columns; ++c) {
+          result_row[c] += lhs_elem * rhs_row[c];
+        }
+      }
+    }
+  }
+}
+
+__attribute__((target("avx2")))
+void AvxRowUpdate(float *row, const float *pivot_row, float factor,
+                  std::size_t size) {
+  __m256 factor_vec = _mm256_set1_ps(factor);
+  std::size_t j = 0;
+  for (; j + 8 <= size; j += 8) {
+    __m256 product = _mm256_mul_ps(factor_vec, _mm256_loadu_ps(pivot_row + j));
+    _mm256_storeu_ps(row + j, _mm256_add_ps(_mm256_loadu_ps(row + j), product));
+  }
+  for (; j < size; ++j) {
+    row[j] += factor * pivot_row[j];
+  }
+}
+
+__attribute__((target("avx2")))
+void AvxLanesAdd(const float *lhs, const float *rhs, float *result,
+                 std::size_t size) {
+  std::size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    _mm256_storeu_ps(result + i, _mm256_add_ps(_mm256_loadu_ps(lhs + i),
+                                               _mm256_loadu_ps(rhs + i)));
+  }
+  for (; i < size; ++i) {
+    result[i] = lhs[i] + rhs[i];
+  }
+}
+
+__attribute__((target("avx2")))
+void AvxLanesMultiply(const float *lhs, const float *rhs, float *result,
+                      std::size_t size) {
+  std::size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    _mm256_storeu_ps(result + i, _mm256_mul_ps(_mm256_loadu_ps(lhs + i),
+                                               _mm256_loadu_ps(rhs + i)));
+  }
+  for (; i < size; ++i) {
+    result[i] = lhs[i] * rhs[i];
+  }
+}
+
+__attribute__((target("avx2")))
+void AvxLanesStar(const float *values, float *result, std::size_t size) {
+  const __m256 one = _mm256_set1_ps(1.0f);
+  std::size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m256 denominator = _mm256_sub_ps(one, _mm256_loadu_ps(values + i));
+    _mm256_storeu_ps(result + i, _mm256_div_ps(one, denominator));
+  }
+  for (; i < size; ++i) {
+    result[i] = 1 / (1 - values[i]);
+  }
+}
+
+bool HasAvx2() {
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+}
+
+#else
+
+bool HasAvx2() {
+  return false;
+}
+
+#endif
+
+}  /* Anonymous namespace. */
+
+bool FloatKernelsVectorized() {
+  return HasAvx2();
+}
+
+void FloatMultiply(const float *lhs, std::size_t lhs_stride,
+                   const float *rhs, std::size_t rhs_stride,
+                   float *result, std::size_t result_stride,
+                   std::size_t rows, std::size_t inner, std::size_t columns) {
+#ifdef FLOAT_KERNELS_AVX2
+  if (HasAvx2()) {
+    AvxMultiply(lhs, lhs_stride, rhs, rhs_stride, result, result_stride, rows,
+                inner, columns);
+    return;
+  }
+#endif
+  ScalarMultiply(lhs, lhs_stride, rhs, rhs_stride, result, result_stride, rows,
+                 inner, columns);
+}
+
+void FloatLanesAdd(const float *lhs, const float *rhs, float *result,
+                   std::size_t size) {
+#ifdef FLOAT_KERNELS_AVX2
+  if (HasAvx2()) {
+    AvxLanesAdd(lhs, rhs, result, size);
+    return;
+  }
+#endif
+  ScalarLanesAdd(lhs, rhs, result, size);
+}
+
+void FloatLanesMultiply(const float *lhs, const float *rhs, float *result,
+                        std::size_t size) {
+#ifdef FLOAT_KERNELS_AVX2
+  if (HasAvx2()) {
+    AvxLanesMultiply(lhs, rhs, result, size);
+    return;
+  }
+#endif
+  ScalarLanesMultiply(lhs, rhs, result, size);
+}
+
+void FloatLanesStar(const float *values, float *result, std::size_t size) {
+#ifndef NDEBUG
+  // if a value is 1 this returns inf
+  for (std::size_t i = 0; i < size; ++i) {
+    assert(0 < 1 - values[i]);
+  }
+#endif
+#ifdef FLOAT_KERNELS_AVX2
+  if (HasAvx2()) {
+    AvxLanesStar(values, result, size);
+    return;
+  }
+#endif
+  ScalarLanesStar(values, result, size);
+}
+
+/* In every step k, we compute the star of the pivot just once and update all
+ * the rows using the values of the pivot row from before the step, i.e.,
+ *   a_ij = a_ij + a_ik * a_kk* * a_kj
+ * for all i, j.  Each of these updates is a single vectorized row update. */
+void FloatClosure(float *matrix, std::size_t size) {
+  void (*row_update)(float*, const float*, float, std::size_t) =
+    ScalarRowUpdate;
+#ifdef FLOAT_KERNELS_AVX2
+  if (HasAvx2()) {
+    row_update = AvxRowUpdate;
+  }
+#endif
+  std::vector<float> pivot_row(size);
+  for (std::size_t k = 0; k < size; ++k) {
+    float pivot = matrix[k * size + k];
+    // if pivot == 1 this returns inf
+    assert(0 < 1 - pivot);
+    float pivot_star = 1 / (1 - pivot);
+    std::copy(matrix + k * size, matrix + (k + 1) * size, pivot_row.begin());
+    for (std::size_t i = 0; i < size; ++i) {
+      float factor = matrix[i * size + k] * pivot_star;
+      row_update(matrix + i * size, pivot_row.data(), factor, size);
+    }
+  }
+  /* Add one, i.e., A* = 1 + A+ */
+  for (std::size_t i = 0; i < size; ++i) {
+    matrix[i * size + i] += 1;
+  }
+}
+
+bool FloatStarSolve(const float *matrix, const float *rhs, float *result,
+                    std::size_t size, std::size_t columns) {
+  /* lu = 1 - matrix, overwritten by its decomposition: the strictly lower
+   * triangle holds L (with an implicit unit diagonal), the rest holds U. */
+  std::vector<double> lu(size * size);
+  for (std::size_t i = 0; i < size; ++i) {
+    for (std::size_t j = 0; j < size; ++j) {
+      lu[i * size + j] = (i == j ? 1.0 : 0.0) - matrix[i * size + j];
+    }
+  }
+  std::vector<std::size_t> permutation(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    permutation[i] = i;
+  }
+
+  for (std::size_t k = 0; k < size; ++k) {
+    std::size_t pivot_row = k;
+    for (std::size_t i = k + 1; i < size; ++i) {
+      if (std::fabs(lu[i * size + k]) > std::fabs(lu[pivot_row * size + k])) {
+        pivot_row = i;
+      }
+    }
+    if (lu[pivot_row * size + k] == 0.0) {
+      return false;
+    }
+    if (pivot_row != k) {
+      std::swap_ranges(lu.begin() + k * size, lu.begin() + (k + 1) * size,
+                       lu.begin() + pivot_row * size);
+      std::swap(permutation[k], permutation[pivot_row]);
+    }
+    double pivot = lu[k * size + k];
+    for (std::size_t i = k + 1; i < size; ++i) {
+      double factor = lu[i * size + k] / pivot;
+      lu[i * size + k] = factor;
+      for (std::size_t j = k + 1; j < size; ++j) {
+        lu[i * size + j] -= factor * lu[k * size + j];
+      }
+    }
+  }
+
+  std::vector<double> x(size);
+  for (std::size_t c = 0; c < columns; ++c) {
+    /* Forward substitution with L (on the permuted rhs) ... */
+    for (std::size_t i = 0; i < size; ++i) {
+      double sum = rhs[permutation[i] * columns + c];
+      for (std::size_t j = 0; j < i; ++j) {
+        sum -= lu[i * size + j] * x[j];
+      }
+      x[i] = sum;
+    }
+    /* ... and backward substitution with U. */
+    for (std::size_t i = size; i-- > 0;) {
+      double sum = x[i];
+      for (std::size_t j = i + 1; j < size; ++j) {
+        sum -= lu[i * size + j] * x[j];
+      }
+      x[i] = sum / lu[i * size + i];
+    }
+    for (std::size_t i = 0; i < size; ++i) {
+      result[i * columns + c] = static_cast<float>(x[i]);
+    }
+  }
+  return true;
+}
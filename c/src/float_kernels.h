@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+
+/*
+ * Dense kernels on raw row-major float arrays, used by the specializations of
+ * Matrix<FloatSemiring>.  On x86 the AVX2 versions are used if the CPU supports
+ * them (checked at runtime), otherwise we fall back to the portable scalar
+ * ones.
+ *
+ * Both versions of FloatMultiply compute every element of the result with the
+ * same sequence of float additions and multiplications as the generic Matrix
+ * code (the vectorization is across columns, never across the summation), so
+ * the results are exactly the same.
+ */
+
+/* result (rows x columns) = lhs (rows x inner) * rhs (inner x columns), where
+ * row r of each matrix starts at r * stride (so they can be blocks of larger
+ * matrices).  result must not overlap the operands. */
+void FloatMultiply(const float *lhs, std::size_t lhs_stride,
+                   const float *rhs, std::size_t rhs_stride,
+                   float *result, std::size_t result_stride,
+                   std::size_t rows, std::size_t inner, std::size_t columns);
+
+/* Replaces the size x size matrix with its star (using Floyd-Warshall, without
+ * the tiling of the generic version, so the results can differ in the last
+ * bits). */
+void FloatClosure(float *matrix, std::size_t size);
+
+/* Computes matrix* * rhs (where rhs has size rows and the given number of
+ * columns), i.e., solves (1 - matrix) x = rhs.  This uses an LU decomposition
+ * with partial pivoting (in double precision), which is computed only once for
+ * all the columns of rhs.  Returns false if 1 - matrix is singular. */
+bool FloatStarSolve(const float *matrix, const float *rhs, float *result,
+                    std::size_t size, std::size_t columns);
+
+/* Element-wise operations on arrays of the given size (e.g., the lanes of a
+ * FloatBatchTape).  The result may be the same array as an operand.  They
+ * round exactly like the corresponding operations of FloatSemiring. */
+void FloatLanesAdd(const float *lhs, const float *rhs, float *result,
+                   std::size_t size);
+void FloatLanesMultiply(const float *lhs, const float *rhs, float *result,
+                        std::size_t size);
+/* result = 1 / (1 - value), every value has to be smaller than 1. */
+void FloatLanesStar(const float *values, float *result, std::size_t size);
+
+/* Whether the vectorized kernels are used on this machine. */
+bool FloatKernelsVectorized();
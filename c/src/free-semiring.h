@@ -3,6 +3,7 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "matrix.h"
 #include "semiring.h"
@@ -16,13 +17,33 @@ class Evaluator;
 class FreeSemiring : public Semiring<FreeSemiring> {
   public:
     /* Default constructor creates zero element. */
-    FreeSemiring() {
-      node_ = factory_.GetEmpty();
+    FreeSemiring() : FreeSemiring(factory_.GetEmpty()) {}
+
+    FreeSemiring(const VarPtr var) : FreeSemiring(factory_.NewElement(var)) {}
+
+    /* Every FreeSemiring counts as an external reference to its Node (see
+     * [Note: Garbage]).  A moved-from FreeSemiring doesn't refer to any Node,
+     * so it can only be destroyed or assigned to. */
+    FreeSemiring(const FreeSemiring &x) : FreeSemiring(x.node_) {}
+
+    FreeSemiring(FreeSemiring &&x) : node_(x.node_) {
+      x.node_ = nullptr;
     }
 
-    FreeSemiring(const VarPtr var) {
-      assert(var);
-      node_ = factory_.NewElement(var);
+    ~FreeSemiring() {
+      if (node_) {
+        node_->Unref();
+      }
+    }
+
+    FreeSemiring& operator=(const FreeSemiring &x) {
+      SetNode(x.node_);
+      return *this;
+    }
+
+    FreeSemiring& operator=(FreeSemiring &&x) {
+      std::swap(node_, x.node_);
+      return *this;
     }
 
     static FreeSemiring null() {
@@ -37,22 +58,24 @@ class FreeSemiring : public Semiring<FreeSemiring> {
       return FreeSemiring{factory_.NewStar(node_)};
     }
 
-    FreeSemiring operator+(const FreeSemiring &x) {
-      return FreeSemiring{factory_.NewAddition(node_, x.node_)};
+    FreeSemiring& operator+=(const FreeSemiring &x) {
+      SetNode(factory_.NewAddition(node_, x.node_));
+      return *this;
     }
 
-    FreeSemiring& operator+=(const FreeSemiring &x) {
-      node_ = factory_.NewAddition(node_, x.node_);
+    FreeSemiring& operator*=(const FreeSemiring &x) {
+      SetNode(factory_.NewMultiplication(node_, x.node_));
       return *this;
     }
 
-    FreeSemiring operator*(const FreeSemiring &x) {
-      return FreeSemiring{factory_.NewMultiplication(node_, x.node_)};
+    /* The sum (product) of all the elements as a single Node, see
+     * [Note: N-ary Nodes]. */
+    static FreeSemiring SumOf(const std::vector<FreeSemiring> &summands) {
+      return FreeSemiring{factory_.NewSum(GetNodes(summands))};
     }
 
-    FreeSemiring& operator*=(const FreeSemiring &x) {
-      node_ = factory_.NewMultiplication(node_, x.node_);
-      return *this;
+    static FreeSemiring ProductOf(const std::vector<FreeSemiring> &factors) {
+      return FreeSemiring{factory_.NewProduct(GetNodes(factors))};
     }
 
     bool operator==(const FreeSemiring &x) const {
@@ -75,17 +98,82 @@ class FreeSemiring : public Semiring<FreeSemiring> {
       factory_.PrintDot(out);
     }
 
-    void GC() {
-      factory_.GC();
+    /* Frees all the Nodes that are not reachable from any FreeSemiring and
+     * returns their number.  This must not run concurrently with any other
+     * operation on FreeSemirings. */
+    static std::size_t GC() {
+      return factory_.GC();
+    }
+
+    /* Sets the simplifications used when creating new elements, they have to
+     * be valid in the semiring in which the elements are evaluated, e.g.,
+     *   FreeSemiring::SetRewriteRules(RewriteRules::ForSemiring<SR>());
+     * This must not run concurrently with creating new elements. */
+    static void SetRewriteRules(const RewriteRules &rules) {
+      factory_.SetRewriteRules(rules);
+    }
+
+    static const RewriteRules& GetRewriteRules() {
+      return factory_.GetRewriteRules();
+    }
+
+    /* The number of allocated Nodes. */
+    static std::size_t GetNodeCount() {
+      return factory_.GetSize();
     }
 
   private:
-    FreeSemiring(NodePtr n) : node_(n) {}
+    FreeSemiring(NodePtr n) : node_(n) {
+      assert(node_);
+      node_->Ref();
+    }
+
+    static std::vector<NodePtr> GetNodes(const std::vector<FreeSemiring> &xs) {
+      std::vector<NodePtr> nodes;
+      nodes.reserve(xs.size());
+      for (const auto &x : xs) {
+        nodes.push_back(x.node_);
+      }
+      return nodes;
+    }
+
+    void SetNode(NodePtr n) {
+      /* Take the new reference first, n might be the same as node_. */
+      n->Ref();
+      if (node_) {
+        node_->Unref();
+      }
+      node_ = n;
+    }
 
     NodePtr node_;
     static NodeFactory factory_;
 
     friend struct std::hash<FreeSemiring>;
+    friend class FreeTape;
+};
+
+/* Sets the rewrite rules of FreeSemiring for as long as it lives and then
+ * restores the previous ones, e.g.,
+ *   ScopedRewriteRules rules{RewriteRules::ForSemiring<SR>()};
+ * so that the rules of one semiring don't leak into the elements created
+ * afterwards (which might be evaluated in a different semiring). */
+class ScopedRewriteRules {
+  public:
+    ScopedRewriteRules(const RewriteRules &rules)
+        : previous_(FreeSemiring::GetRewriteRules()) {
+      FreeSemiring::SetRewriteRules(rules);
+    }
+
+    ScopedRewriteRules(const ScopedRewriteRules &) = delete;
+    ScopedRewriteRules& operator=(const ScopedRewriteRules &) = delete;
+
+    ~ScopedRewriteRules() {
+      FreeSemiring::SetRewriteRules(previous_);
+    }
+
+  private:
+    const RewriteRules previous_;
 };
 
 namespace std {
@@ -137,6 +225,26 @@ class Evaluator : public NodeVisitor {
       result_ = new SR(*temp * *result_);
     }
 
+    void Visit(const Sum &s) {
+      std::vector<SR> values;
+      for (auto child : s.GetChildren()) {
+        LookupEval(child);
+        values.push_back(*result_);
+      }
+      result_ = new SR(BalancedReduce(std::move(values),
+          [](const SR &lhs, const SR &rhs) { return lhs + rhs; }));
+    }
+
+    void Visit(const Product &p) {
+      auto multiply = [](const SR &lhs, const SR &rhs) { return lhs * rhs; };
+      std::vector<SR> values;
+      for (const auto &power : p.GetPowers()) {
+        LookupEval(power.first);
+        values.push_back(Power(*result_, power.second, multiply));
+      }
+      result_ = new SR(BalancedReduce(std::move(values), multiply));
+    }
+
     void Visit(const Star &s) {
       LookupEval(s.GetNode());
       result_ = new SR(result_->star());
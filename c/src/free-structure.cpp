@@ -1,4 +1,7 @@
+#include <algorithm>
 #include <cassert>
+#include <functional>
+#include <limits>
 
 #include "free-structure.h"
 
@@ -17,6 +20,18 @@ void NodeVisitor::Visit(const Multiplication &m) {
   m.GetRhs()->Accept(*this);
 }
 
+void NodeVisitor::Visit(const Sum &s) {
+  for (auto child : s.GetChildren()) {
+    child->Accept(*this);
+  }
+}
+
+void NodeVisitor::Visit(const Product &p) {
+  for (auto child : p.GetChildren()) {
+    child->Accept(*this);
+  }
+}
+
 void NodeVisitor::Visit(const Star &s) {
   s.GetNode()->Accept(*this);
 }
@@ -50,6 +65,14 @@ class StringPrinter : public NodeVisitor {
       out_ << ")";
     }
 
+    void Visit(const Sum &s) {
+      PrintChildren(s.GetChildren(), " + ");
+    }
+
+    void Visit(const Product &p) {
+      PrintChildren(p.GetChildren(), " * ");
+    }
+
     void Visit(const Star &s) {
       out_ << "(";
       s.GetNode()->Accept(*this);
@@ -67,6 +90,18 @@ class StringPrinter : public NodeVisitor {
     void Visit(const Empty &e) {}
 
   private:
+    void PrintChildren(const std::vector<NodePtr> &children,
+                       const char *separator) {
+      out_ << "(";
+      for (std::size_t i = 0; i < children.size(); ++i) {
+        if (i > 0) {
+          out_ << separator;
+        }
+        children[i]->Accept(*this);
+      }
+      out_ << ")";
+    }
+
     std::ostream &out_;
 };
 
@@ -77,13 +112,269 @@ std::ostream& operator<<(std::ostream &out, const Node &node) {
 }
 
 
+std::vector< std::pair<NodePtr, std::size_t> > Product::GetPowers() const {
+  std::vector< std::pair<NodePtr, std::size_t> > powers;
+  for (auto child : children) {
+    if (!powers.empty() && powers.back().first == child) {
+      ++powers.back().second;
+    } else {
+      powers.emplace_back(child, 1);
+    }
+  }
+  return powers;
+}
+
+
+/*
+ * NodeTable
+ */
+
+const std::size_t NodeTable::kMinCapacity;
+
+namespace {
+
+/* The order of the operands of the commutative operations, see [Note: Operand
+ * order]. */
+bool StructureLess(NodePtr lhs, NodePtr rhs) {
+  if (lhs->GetStructure() != rhs->GetStructure()) {
+    return lhs->GetStructure() < rhs->GetStructure();
+  }
+  return lhs->GetId() < rhs->GetId();
+}
+
+/* The structure of the Node with the given (canonical) key. */
+std::uint32_t StructureHash(const NodeTable::Key &key) {
+  std::size_t h = static_cast<std::size_t>(key.kind);
+  if (key.kind == NodeKind::kElement) {
+    HashCombine(h, key.var->string());
+  } else if (key.children) {
+    for (auto child : *key.children) {
+      HashCombine(h, child->GetStructure());
+    }
+  } else {
+    HashCombine(h, key.lhs->GetStructure());
+    if (key.rhs) {
+      HashCombine(h, key.rhs->GetStructure());
+    }
+  }
+  return static_cast<std::uint32_t>(h);
+}
+
+}
+
+NodeTable::Key NodeTable::GetKey(const Node &node) {
+  switch (node.GetKind()) {
+    case NodeKind::kAddition: {
+      auto &addition = static_cast<const Addition&>(node);
+      return Key{NodeKind::kAddition, addition.GetLhs(), addition.GetRhs(),
+                 VarPtr()};
+    }
+    case NodeKind::kMultiplication: {
+      auto &multiplication = static_cast<const Multiplication&>(node);
+      return Key{NodeKind::kMultiplication, multiplication.GetLhs(),
+                 multiplication.GetRhs(), VarPtr()};
+    }
+    case NodeKind::kSum:
+      return Key{NodeKind::kSum, nullptr, nullptr, VarPtr(),
+                 &static_cast<const Sum&>(node).GetChildren()};
+    case NodeKind::kProduct:
+      return Key{NodeKind::kProduct, nullptr, nullptr, VarPtr(),
+                 &static_cast<const Product&>(node).GetChildren()};
+    case NodeKind::kStar:
+      return Key{NodeKind::kStar, static_cast<const Star&>(node).GetNode(),
+                 nullptr, VarPtr()};
+    case NodeKind::kElement:
+      return Key{NodeKind::kElement, nullptr, nullptr,
+                 static_cast<const Element&>(node).GetVar()};
+    default:
+      /* Empty and Epsilon are not in the table. */
+      assert(false);
+      return Key{node.GetKind(), nullptr, nullptr, VarPtr()};
+  }
+}
+
+std::size_t NodeTable::Hash(const Key &key) {
+  std::size_t h = static_cast<std::size_t>(key.kind);
+  if (key.kind == NodeKind::kElement) {
+    HashCombine(h, key.var.getId());
+  } else if (key.children) {
+    for (auto child : *key.children) {
+      HashCombine(h, child->GetId());
+    }
+  } else {
+    HashCombine(h, key.lhs->GetId());
+    if (key.rhs) {
+      HashCombine(h, key.rhs->GetId());
+    }
+  }
+  return h;
+}
+
+bool NodeTable::Equal(const Key &lhs, const Key &rhs) {
+  if (lhs.children || rhs.children) {
+    return lhs.kind == rhs.kind && lhs.children && rhs.children &&
+           *lhs.children == *rhs.children;
+  }
+  return lhs.kind == rhs.kind && lhs.lhs == rhs.lhs && lhs.rhs == rhs.rhs &&
+         lhs.var == rhs.var;
+}
+
+NodePtr NodeTable::Find(const Key &key, std::size_t hash) const {
+  const std::size_t mask = slots_.size() - 1;
+  for (std::size_t i = hash & mask; slots_[i]; i = (i + 1) & mask) {
+    if (Equal(GetKey(*slots_[i]), key)) {
+      return slots_[i];
+    }
+  }
+  return nullptr;
+}
+
+void NodeTable::Insert(NodePtr node, std::size_t hash) {
+  /* Keep the load factor below 1/2, so that the probe sequences stay short. */
+  if (2 * (size_ + 1) > slots_.size()) {
+    std::vector<NodePtr> old_slots(2 * slots_.size(), nullptr);
+    old_slots.swap(slots_);
+    for (auto old_node : old_slots) {
+      if (old_node) {
+        InsertSlot(old_node, Hash(GetKey(*old_node)));
+      }
+    }
+  }
+  InsertSlot(node, hash);
+  ++size_;
+}
+
+void NodeTable::InsertSlot(NodePtr node, std::size_t hash) {
+  const std::size_t mask = slots_.size() - 1;
+  std::size_t i = hash & mask;
+  while (slots_[i]) {
+    i = (i + 1) & mask;
+  }
+  slots_[i] = node;
+}
+
+void NodeTable::Clear() {
+  slots_.assign(kMinCapacity, nullptr);
+  size_ = 0;
+}
+
+
 /*
  * NodeFactory
- *
- * The following is a bit repetitive, but it's short enough that it's probably
- * not worth the effort to abstract away the common parts...
  */
 
+const std::size_t NodeFactory::kShardBits;
+const std::size_t NodeFactory::kShards;
+
+NodeFactory::NodeFactory() : rules_{false, false} {
+  empty_ = new Empty(NewId(), static_cast<std::uint32_t>(NodeKind::kEmpty));
+  nodes_[empty_->GetId()] = empty_;
+  epsilon_ =
+    new Epsilon(NewId(), static_cast<std::uint32_t>(NodeKind::kEpsilon));
+  nodes_[epsilon_->GetId()] = epsilon_;
+}
+
+NodeFactory::~NodeFactory() {
+  for (auto node : nodes_) {
+    if (node && node != empty_ && node != epsilon_) {
+      Destroy(node);
+    }
+  }
+  delete static_cast<Empty*>(empty_);
+  delete static_cast<Epsilon*>(epsilon_);
+}
+
+std::uint32_t NodeFactory::NewId() {
+  if (!free_ids_.empty()) {
+    std::uint32_t id = free_ids_.back();
+    free_ids_.pop_back();
+    return id;
+  }
+  assert(nodes_.size() < std::numeric_limits<std::uint32_t>::max());
+  nodes_.push_back(nullptr);
+  return nodes_.size() - 1;
+}
+
+std::size_t NodeFactory::GetShard(std::size_t hash) {
+  /* The NodeTables use the lowest bits of the hash, so we use the highest bits
+   * of a multiplicative hash (which are the well mixed ones). */
+  const std::uint64_t kMultiplier = 0x9e3779b97f4a7c15ULL;
+  return (static_cast<std::uint64_t>(hash) * kMultiplier) >> (64 - kShardBits);
+}
+
+void NodeFactory::Destroy(NodePtr node) {
+  free_ids_.push_back(node->GetId());
+  nodes_[node->GetId()] = nullptr;
+  /* The children may be already destroyed (by the same sweep of the GC), so
+   * we can't compute the hash to find the Shard that allocated the Node.  But
+   * the free slot can go to the arena of any Shard, since all of them live as
+   * long as the factory. */
+  Shard &shard = shards_[node->GetId() % kShards];
+  switch (node->GetKind()) {
+    case NodeKind::kAddition: {
+      auto addition = static_cast<Addition*>(node);
+      addition->~Addition();
+      shard.additions.Free(addition);
+      break;
+    }
+    case NodeKind::kMultiplication: {
+      auto multiplication = static_cast<Multiplication*>(node);
+      multiplication->~Multiplication();
+      shard.multiplications.Free(multiplication);
+      break;
+    }
+    case NodeKind::kSum: {
+      auto sum = static_cast<Sum*>(node);
+      sum->~Sum();
+      shard.sums.Free(sum);
+      break;
+    }
+    case NodeKind::kProduct: {
+      auto product = static_cast<Product*>(node);
+      product->~Product();
+      shard.products.Free(product);
+      break;
+    }
+    case NodeKind::kStar: {
+      auto star = static_cast<Star*>(node);
+      star->~Star();
+      shard.stars.Free(star);
+      break;
+    }
+    case NodeKind::kElement: {
+      auto element = static_cast<Element*>(node);
+      element->~Element();
+      shard.elems.Free(element);
+      break;
+    }
+    default:
+      /* Empty and Epsilon live as long as the factory. */
+      assert(false);
+  }
+}
+
+template <typename T, typename... Args>
+NodePtr NodeFactory::GetOrCreate(NodeArena<T> Shard::*arena,
+                                 const NodeTable::Key &key, Args&&... args) {
+  const std::size_t hash = NodeTable::Hash(key);
+  Shard &shard = shards_[GetShard(hash)];
+  std::lock_guard<std::mutex> lock{shard.mutex};
+  NodePtr node_ptr = shard.table.Find(key, hash);
+  if (node_ptr) {
+    return node_ptr;
+  }
+  const std::uint32_t structure = StructureHash(key);
+  void *memory = (shard.*arena).Allocate();
+  {
+    std::lock_guard<std::mutex> ids_lock{ids_mutex_};
+    std::uint32_t id = NewId();
+    node_ptr = new (memory) T(id, structure, std::forward<Args>(args)...);
+    nodes_[id] = node_ptr;
+  }
+  shard.table.Insert(node_ptr, hash);
+  return node_ptr;
+}
+
 NodePtr NodeFactory::NewAddition(NodePtr lhs, NodePtr rhs) {
   assert(lhs);
   assert(rhs);
@@ -95,20 +386,24 @@ NodePtr NodeFactory::NewAddition(NodePtr lhs, NodePtr rhs) {
     return lhs;
   }
 
-  /* Since + is commutative, use pointers to order the arguments.
-   * This makes it possible to have that:
-   *   NewAddition(a, b) == NewAddition(b, a) */
-  if (lhs > rhs) {
-    std::swap(lhs, rhs);
+  NodePtr simplified = SimplifyAddition(lhs, rhs);
+  if (!simplified) {
+    simplified = SimplifyAddition(rhs, lhs);
+  }
+  if (simplified) {
+    return simplified;
   }
 
-  auto iter = additions_.find({lhs, rhs});
-  if (iter != additions_.end()) {
-    return iter->second;
+  /* Since + is commutative, order the arguments, so that:
+   *   NewAddition(a, b) == NewAddition(b, a)
+   * See [Note: Operand order]. */
+  if (StructureLess(rhs, lhs)) {
+    std::swap(lhs, rhs);
   }
-  NodePtr node_ptr{new Addition(lhs, rhs)};
-  additions_.insert({ {lhs, rhs}, node_ptr });
-  return node_ptr;
+
+  return GetOrCreate(&Shard::additions,
+                     NodeTable::Key{NodeKind::kAddition, lhs, rhs, VarPtr()},
+                     lhs, rhs);
 }
 
 NodePtr NodeFactory::NewMultiplication(NodePtr lhs, NodePtr rhs) {
@@ -126,13 +421,83 @@ NodePtr NodeFactory::NewMultiplication(NodePtr lhs, NodePtr rhs) {
     return empty_;
   }
 
-  auto iter = multiplications_.find({lhs, rhs});
-  if (iter != multiplications_.end()) {
-    return iter->second;
+  /* If the semiring is commutative (see RewriteRules), order the arguments as
+   * for the addition, so that:
+   *   NewMultiplication(a, b) == NewMultiplication(b, a)
+   * Otherwise the order of the factors matters and is kept. */
+  if (rules_.commutative && StructureLess(rhs, lhs)) {
+    std::swap(lhs, rhs);
   }
-  NodePtr node_ptr{new Multiplication(lhs, rhs)};
-  multiplications_.insert({ {lhs, rhs}, node_ptr });
-  return node_ptr;
+
+  return GetOrCreate(
+      &Shard::multiplications,
+      NodeTable::Key{NodeKind::kMultiplication, lhs, rhs, VarPtr()}, lhs, rhs);
+}
+
+NodePtr NodeFactory::NewSum(std::vector<NodePtr> children) {
+  /* Flatten the nested Sums and drop the empty ones. */
+  std::vector<NodePtr> summands;
+  for (auto child : children) {
+    assert(child);
+    if (child->GetKind() == NodeKind::kSum) {
+      auto &nested = static_cast<const Sum*>(child)->GetChildren();
+      summands.insert(summands.end(), nested.begin(), nested.end());
+    } else if (child != empty_) {
+      summands.push_back(child);
+    }
+  }
+
+  /* Same order as in NewAddition. */
+  std::sort(summands.begin(), summands.end(), StructureLess);
+  if (rules_.idempotent) {
+    summands.erase(std::unique(summands.begin(), summands.end()),
+                   summands.end());
+  }
+
+  switch (summands.size()) {
+    case 0:
+      return empty_;
+    case 1:
+      return summands[0];
+    case 2:
+      return NewAddition(summands[0], summands[1]);
+  }
+  NodeTable::Key key{NodeKind::kSum, nullptr, nullptr, VarPtr(), &summands};
+  return GetOrCreate(&Shard::sums, key, std::move(summands));
+}
+
+NodePtr NodeFactory::NewProduct(std::vector<NodePtr> children) {
+  /* Flatten the nested Products and drop the epsilons. */
+  std::vector<NodePtr> factors;
+  for (auto child : children) {
+    assert(child);
+    if (child == empty_) {
+      return empty_;
+    }
+    if (child->GetKind() == NodeKind::kProduct) {
+      auto &nested = static_cast<const Product*>(child)->GetChildren();
+      factors.insert(factors.end(), nested.begin(), nested.end());
+    } else if (child != epsilon_) {
+      factors.push_back(child);
+    }
+  }
+
+  /* Same order as in NewMultiplication, this also puts the equal factors
+   * next to each other. */
+  if (rules_.commutative) {
+    std::sort(factors.begin(), factors.end(), StructureLess);
+  }
+
+  switch (factors.size()) {
+    case 0:
+      return epsilon_;
+    case 1:
+      return factors[0];
+    case 2:
+      return NewMultiplication(factors[0], factors[1]);
+  }
+  NodeTable::Key key{NodeKind::kProduct, nullptr, nullptr, VarPtr(), &factors};
+  return GetOrCreate(&Shard::products, key, std::move(factors));
 }
 
 NodePtr NodeFactory::NewStar(NodePtr node) {
@@ -142,34 +507,152 @@ NodePtr NodeFactory::NewStar(NodePtr node) {
     return epsilon_;
   }
 
-  auto iter = stars_.find(node);
-  if (iter != stars_.end()) {
-    return iter->second;
+  if (rules_.idempotent) {
+    /* (a*)* = a* and 1* = 1 */
+    if (node->GetKind() == NodeKind::kStar || node == epsilon_) {
+      return node;
+    }
   }
-  NodePtr node_ptr{new Star(node)};
-  stars_.insert({node, node_ptr});
-  return node_ptr;
+
+  return GetOrCreate(&Shard::stars,
+                     NodeTable::Key{NodeKind::kStar, node, nullptr, VarPtr()},
+                     node);
+}
+
+NodePtr NodeFactory::SimplifyAddition(NodePtr lhs, NodePtr rhs) const {
+  /* Whether star is the star of node. */
+  auto is_star_of = [](NodePtr star, NodePtr node) {
+    return star->GetKind() == NodeKind::kStar &&
+           static_cast<const Star*>(star)->GetNode() == node;
+  };
+
+  if (lhs == epsilon_ && rhs->GetKind() == NodeKind::kMultiplication) {
+    /* 1 + a a* = 1 + a* a = a* */
+    auto product = static_cast<const Multiplication*>(rhs);
+    if (is_star_of(product->GetRhs(), product->GetLhs())) {
+      return product->GetRhs();
+    }
+    if (is_star_of(product->GetLhs(), product->GetRhs())) {
+      return product->GetLhs();
+    }
+  }
+
+  if (rules_.idempotent) {
+    /* a + a = a */
+    if (lhs == rhs) {
+      return lhs;
+    }
+    /* 1 + a* = a + a* = a* */
+    if (rhs->GetKind() == NodeKind::kStar &&
+        (lhs == epsilon_ || is_star_of(rhs, lhs))) {
+      return rhs;
+    }
+  }
+
+  return nullptr;
 }
 
 NodePtr NodeFactory::NewElement(VarPtr var) {
   assert(var);
 
-  auto iter = elems_.find(var);
-  if (iter != elems_.end()) {
-    return iter->second;
+  return GetOrCreate(
+      &Shard::elems, NodeTable::Key{NodeKind::kElement, nullptr, nullptr, var},
+      var);
+}
+
+std::size_t NodeFactory::GC() {
+  std::vector< std::unique_lock<std::mutex> > locks;
+  for (auto &shard : shards_) {
+    locks.emplace_back(shard.mutex);
   }
-  NodePtr node_ptr{new Element(var)};
-  elems_.insert({var, node_ptr});
-  return node_ptr;
+  locks.emplace_back(ids_mutex_);
+
+  /* Mark everything reachable from the externally referenced Nodes.  Note
+   * that empty_ and epsilon_ are never freed. */
+  std::vector<bool> marked(nodes_.size(), false);
+  std::vector<NodePtr> stack;
+  auto mark = [&marked, &stack](NodePtr node) {
+    if (!marked[node->GetId()]) {
+      marked[node->GetId()] = true;
+      stack.push_back(node);
+    }
+  };
+  mark(empty_);
+  mark(epsilon_);
+  for (auto node : nodes_) {
+    if (node && node->IsReferenced()) {
+      mark(node);
+    }
+  }
+  while (!stack.empty()) {
+    NodePtr node = stack.back();
+    stack.pop_back();
+    switch (node->GetKind()) {
+      case NodeKind::kAddition:
+        mark(static_cast<const Addition*>(node)->GetLhs());
+        mark(static_cast<const Addition*>(node)->GetRhs());
+        break;
+      case NodeKind::kMultiplication:
+        mark(static_cast<const Multiplication*>(node)->GetLhs());
+        mark(static_cast<const Multiplication*>(node)->GetRhs());
+        break;
+      case NodeKind::kSum:
+        for (auto child : static_cast<const Sum*>(node)->GetChildren()) {
+          mark(child);
+        }
+        break;
+      case NodeKind::kProduct:
+        for (auto child : static_cast<const Product*>(node)->GetChildren()) {
+          mark(child);
+        }
+        break;
+      case NodeKind::kStar:
+        mark(static_cast<const Star*>(node)->GetNode());
+        break;
+      default:
+        break;
+    }
+  }
+
+  /* Sweep the unmarked ones and rebuild the table with the remaining ones
+   * (that's simpler than removing the entries from an open addressing table
+   * one by one). */
+  std::size_t freed = 0;
+  for (auto &shard : shards_) {
+    shard.table.Clear();
+  }
+  for (auto node : nodes_) {
+    if (!node || node == empty_ || node == epsilon_) {
+      continue;
+    }
+    if (marked[node->GetId()]) {
+      const std::size_t hash = NodeTable::Hash(NodeTable::GetKey(*node));
+      shards_[GetShard(hash)].table.Insert(node, hash);
+    } else {
+      Destroy(node);
+      ++freed;
+    }
+  }
+  return freed;
 }
 
-void NodeFactory::GC() {
-  assert(false);
+std::size_t NodeFactory::GetSize() {
+  std::size_t size = 2;
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock{shard.mutex};
+    size += shard.table.GetSize();
+  }
+  return size;
 }
 
+std::size_t NodeFactory::GetMaxId() {
+  std::lock_guard<std::mutex> lock{ids_mutex_};
+  return nodes_.size();
+}
 
 
 void NodeFactory::PrintDot(std::ostream &out) {
+  std::lock_guard<std::mutex> lock{ids_mutex_};
   out << "digraph {" << std::endl;
 
   struct TypePrinter : public NodeVisitor {
@@ -178,6 +661,8 @@ void NodeFactory::PrintDot(std::ostream &out) {
 
     void Visit(const Addition &a) { out_ << "+"; }
     void Visit(const Multiplication &m) { out_ << "*"; }
+    void Visit(const Sum &s) { out_ << "+"; }
+    void Visit(const Product &p) { out_ << "*"; }
     void Visit(const Star &s) { out_ << "(-)*"; }
     void Visit(const Element &e) { out_ << e.GetVar(); }
     void Visit(const Epsilon &e) { out_ << "epsilon"; }
@@ -199,31 +684,30 @@ void NodeFactory::PrintDot(std::ostream &out) {
     out << "\"]" << std::endl;
   };
 
-  for (auto &children_parent : additions_) {
-    print_node(children_parent.second);
-    print_edge(children_parent.second, children_parent.first.first);
-    print_edge(children_parent.second, children_parent.first.second);
-  }
-
-  for (auto &children_parent : multiplications_) {
-    print_node(children_parent.second);
-    print_edge(children_parent.second, children_parent.first.first);
-    print_edge(children_parent.second, children_parent.first.second);
-  }
-
-  for (auto &child_parent : stars_) {
-    print_node(child_parent.second);
-    print_edge(child_parent.second, child_parent.first);
-  }
-
-  for (auto &child_parent : elems_) {
-    out << "\"" << child_parent.second << "\""
-        << " [label=\"" << child_parent.first << "\"]"
-        << std::endl;
+  for (auto node : nodes_) {
+    if (!node) {
+      continue;
+    }
+    print_node(node);
+    NodeTable::Key key = node == empty_ || node == epsilon_
+      ? NodeTable::Key{node->GetKind(), nullptr, nullptr, VarPtr()}
+      : NodeTable::GetKey(*node);
+    if (key.kind == NodeKind::kElement) {
+      continue;
+    }
+    if (key.children) {
+      for (auto child : *key.children) {
+        print_edge(node, child);
+      }
+      continue;
+    }
+    if (key.lhs) {
+      print_edge(node, key.lhs);
+    }
+    if (key.rhs) {
+      print_edge(node, key.rhs);
+    }
   }
 
-  print_node(empty_);
-  print_node(epsilon_);
-
   out << "}" << std::endl;
 }
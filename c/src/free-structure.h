@@ -1,7 +1,12 @@
 #pragma once
 
+#include <atomic>
+#include <cassert>
+#include <cstdint>
 #include <memory>
-#include <unordered_map>
+#include <mutex>
+#include <type_traits>
+#include <vector>
 
 #include "var.h"
 #include "hash.h"
@@ -11,6 +16,8 @@ class Node;
 
 class Addition;
 class Multiplication;
+class Sum;
+class Product;
 class Star;
 class Element;
 class Epsilon;
@@ -23,10 +30,52 @@ class NodeVisitor;
 
 class NodeFactory;
 
+/* See [Note: Node storage] */
+enum class NodeKind : std::uint8_t {
+  kAddition, kMultiplication, kSum, kProduct, kStar, kElement, kEpsilon, kEmpty
+};
+
 class Node {
   public:
-    virtual ~Node() {}
-    virtual void Accept(NodeVisitor &visitor) const = 0;
+    NodeKind GetKind() const { return kind_; }
+
+    /* Unique among the live Nodes of a NodeFactory and dense, i.e., smaller
+     * than NodeFactory::GetMaxId(), so it can be used to index vectors. */
+    std::uint32_t GetId() const { return id_; }
+
+    /* A hash of the structure of the Node (its kind, the structures of its
+     * children and the names of its variables).  Unlike the id it does not
+     * depend on when the Node was created, see [Note: Operand order]. */
+    std::uint32_t GetStructure() const { return structure_; }
+
+    /* Calls the Visit() for the actual kind of the Node. */
+    inline void Accept(NodeVisitor &visitor) const;
+
+    /* External references, i.e., from the FreeSemiring handles (see [Note:
+     * Garbage]).  Atomic, since the handles are copied around from multiple
+     * threads (e.g., when computing the star of a matrix in parallel). */
+    void Ref() const { refs_.fetch_add(1, std::memory_order_relaxed); }
+    void Unref() const {
+      assert(0 < refs_.load(std::memory_order_relaxed));
+      refs_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    bool IsReferenced() const {
+      return 0 < refs_.load(std::memory_order_relaxed);
+    }
+
+  protected:
+    Node(NodeKind kind, std::uint32_t id, std::uint32_t structure)
+        : kind_(kind), refs_(0), id_(id), structure_(structure) {}
+
+    /* Not virtual, the Nodes are destroyed only by the NodeFactory (which
+     * knows their kind). */
+    ~Node() = default;
+
+  private:
+    const NodeKind kind_;
+    mutable std::atomic<std::uint32_t> refs_;
+    const std::uint32_t id_;
+    const std::uint32_t structure_;
 };
 
 class StringPrinter;
@@ -43,6 +92,8 @@ class NodeVisitor {
     virtual ~NodeVisitor() {}
     virtual void Visit(const Addition &a);
     virtual void Visit(const Multiplication &m);
+    virtual void Visit(const Sum &s);
+    virtual void Visit(const Product &p);
     virtual void Visit(const Star &s);
     virtual void Visit(const Element &e);
     virtual void Visit(const Epsilon &e);
@@ -54,13 +105,12 @@ class Addition : public Node {
   public:
     ~Addition() = default;
 
-    void Accept(NodeVisitor &visitor) const { visitor.Visit(*this); }
-
     NodePtr GetLhs() const { return lhs; }
     NodePtr GetRhs() const { return rhs; }
 
   private:
-    Addition(NodePtr l, NodePtr r) : lhs(l), rhs(r) {}
+    Addition(std::uint32_t id, std::uint32_t structure, NodePtr l, NodePtr r)
+        : Node(NodeKind::kAddition, id, structure), lhs(l), rhs(r) {}
     const NodePtr lhs;
     const NodePtr rhs;
     friend class NodeFactory;
@@ -70,28 +120,59 @@ class Multiplication : public Node {
   public:
     ~Multiplication() = default;
 
-    void Accept(NodeVisitor &visitor) const { visitor.Visit(*this); }
-
     NodePtr GetLhs() const { return lhs; }
     NodePtr GetRhs() const { return rhs; }
 
   private:
-    Multiplication(NodePtr l, NodePtr r) : lhs(l), rhs(r) {}
+    Multiplication(std::uint32_t id, std::uint32_t structure, NodePtr l,
+                   NodePtr r)
+        : Node(NodeKind::kMultiplication, id, structure), lhs(l), rhs(r) {}
     const NodePtr lhs;
     const NodePtr rhs;
     friend class NodeFactory;
 };
 
+/* N-ary versions of Addition and Multiplication, see [Note: N-ary Nodes]. */
+class Sum : public Node {
+  public:
+    ~Sum() = default;
+
+    const std::vector<NodePtr>& GetChildren() const { return children; }
+
+  private:
+    Sum(std::uint32_t id, std::uint32_t structure, std::vector<NodePtr> &&c)
+        : Node(NodeKind::kSum, id, structure), children(std::move(c)) {}
+    const std::vector<NodePtr> children;
+    friend class NodeFactory;
+};
+
+class Product : public Node {
+  public:
+    ~Product() = default;
+
+    const std::vector<NodePtr>& GetChildren() const { return children; }
+
+    /* The children grouped into runs of the same Node, i.e., the factors
+     * together with their exponents. */
+    std::vector< std::pair<NodePtr, std::size_t> > GetPowers() const;
+
+  private:
+    Product(std::uint32_t id, std::uint32_t structure,
+            std::vector<NodePtr> &&c)
+        : Node(NodeKind::kProduct, id, structure), children(std::move(c)) {}
+    const std::vector<NodePtr> children;
+    friend class NodeFactory;
+};
+
 class Star : public Node {
   public:
     ~Star() = default;
 
-    void Accept(NodeVisitor &visitor) const { visitor.Visit(*this); }
-
     NodePtr GetNode() const { return node; }
 
   private:
-    Star(NodePtr n) : node(n) {}
+    Star(std::uint32_t id, std::uint32_t structure, NodePtr n)
+        : Node(NodeKind::kStar, id, structure), node(n) {}
     const NodePtr node;
     friend class NodeFactory;
 };
@@ -100,12 +181,11 @@ class Element : public Node {
   public:
     ~Element() = default;
 
-    void Accept(NodeVisitor &visitor) const { visitor.Visit(*this); }
-
-    VarPtr GetVar() const { return var; }
+    const VarPtr& GetVar() const { return var; }
 
   private:
-    Element(VarPtr v) : var(v) {}
+    Element(std::uint32_t id, std::uint32_t structure, VarPtr v)
+        : Node(NodeKind::kElement, id, structure), var(v) {}
     const VarPtr var;
     friend class NodeFactory;
 };
@@ -113,64 +193,365 @@ class Element : public Node {
 class Empty : public Node {
   public:
     ~Empty() = default;
-    void Accept(NodeVisitor &visitor) const { visitor.Visit(*this); }
   private:
-    Empty() = default;
+    Empty(std::uint32_t id, std::uint32_t structure)
+        : Node(NodeKind::kEmpty, id, structure) {}
     friend class NodeFactory;
 };
 
 class Epsilon : public Node {
   public:
     ~Epsilon() = default;
-    void Accept(NodeVisitor &visitor) const { visitor.Visit(*this); }
   private:
-    Epsilon() = default;
+    Epsilon(std::uint32_t id, std::uint32_t structure)
+        : Node(NodeKind::kEpsilon, id, structure) {}
     friend class NodeFactory;
 };
 
-class NodeFactory {
+inline void Node::Accept(NodeVisitor &visitor) const {
+  switch (kind_) {
+    case NodeKind::kAddition:
+      visitor.Visit(static_cast<const Addition&>(*this));
+      break;
+    case NodeKind::kMultiplication:
+      visitor.Visit(static_cast<const Multiplication&>(*this));
+      break;
+    case NodeKind::kSum:
+      visitor.Visit(static_cast<const Sum&>(*this));
+      break;
+    case NodeKind::kProduct:
+      visitor.Visit(static_cast<const Product&>(*this));
+      break;
+    case NodeKind::kStar:
+      visitor.Visit(static_cast<const Star&>(*this));
+      break;
+    case NodeKind::kElement:
+      visitor.Visit(static_cast<const Element&>(*this));
+      break;
+    case NodeKind::kEpsilon:
+      visitor.Visit(static_cast<const Epsilon&>(*this));
+      break;
+    case NodeKind::kEmpty:
+      visitor.Visit(static_cast<const Empty&>(*this));
+      break;
+  }
+}
+
+
+/*
+ * NodeArena
+ *
+ * Storage for the Nodes of a single kind.  The Nodes are allocated in chunks
+ * (so they are close to each other in memory and we don't pay for a separate
+ * heap allocation per Node) and never move, so NodePtrs stay valid.  The slots
+ * of the freed Nodes are reused.
+ */
+template <typename T>
+class NodeArena {
   public:
-    NodeFactory() : empty_(new Empty), epsilon_(new Epsilon) {}
-    virtual ~NodeFactory() {
-      for (auto &pair : additions_) { delete pair.second; }
-      for (auto &pair : multiplications_) { delete pair.second; }
-      for (auto &pair : stars_) { delete pair.second; }
-      for (auto &pair : elems_) { delete pair.second; }
-      delete empty_;
-      delete epsilon_;
+    NodeArena() : used_(kChunkSize) {}
+
+    /* Returns uninitialized memory for a T. */
+    void* Allocate() {
+      if (!free_.empty()) {
+        void *slot = free_.back();
+        free_.pop_back();
+        return slot;
+      }
+      if (used_ == kChunkSize) {
+        chunks_.emplace_back(new Slot[kChunkSize]);
+        used_ = 0;
+      }
+      return &chunks_.back()[used_++];
     }
 
+    /* The object has to be already destroyed. */
+    void Free(T *object) {
+      free_.push_back(object);
+    }
+
+  private:
+    static const std::size_t kChunkSize = 1024;
+
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Slot;
+    std::vector< std::unique_ptr<Slot[]> > chunks_;
+    std::size_t used_;
+    std::vector<void*> free_;
+};
+
+
+/*
+ * NodeTable
+ *
+ * The hash-consing table of NodeFactory: an open addressing hash table (with
+ * linear probing) that contains just the pointers to the Nodes.  The keys
+ * (i.e., the kind and the children or the variable) are not stored, we get
+ * them from the Nodes themselves.
+ */
+class NodeTable {
+  public:
+    /* The key of a Node, for Element it's just the var, for Star only lhs is
+     * used and for Sum and Product only the children. */
+    struct Key {
+      NodeKind kind;
+      NodePtr lhs;
+      NodePtr rhs;
+      VarPtr var;
+      const std::vector<NodePtr> *children;
+    };
+
+    NodeTable() : slots_(kMinCapacity, nullptr), size_(0) {}
+
+    static Key GetKey(const Node &node);
+    static std::size_t Hash(const Key &key);
+
+    /* Returns the Node with the given key (and its hash) or nullptr. */
+    NodePtr Find(const Key &key, std::size_t hash) const;
+
+    /* There must be no Node with the same key in the table. */
+    void Insert(NodePtr node, std::size_t hash);
+
+    void Clear();
+
+    std::size_t GetSize() const { return size_; }
+
+  private:
+    static const std::size_t kMinCapacity = 256;
+
+    static bool Equal(const Key &lhs, const Key &rhs);
+
+    void InsertSlot(NodePtr node, std::size_t hash);
+
+    /* nullptr for the free slots. */
+    std::vector<NodePtr> slots_;
+    std::size_t size_;
+};
+
+
+/* The algebraic laws that the NodeFactory uses to simplify the Nodes while
+ * creating them, on top of the ones that hold in every semiring (0 and 1 are
+ * units, 0 is absorbing, 1 + a a* = 1 + a* a = a*).  These depend on the
+ * semiring in which the Nodes are going to be evaluated, see ForSemiring(). */
+struct RewriteRules {
+  /* a + a = a, (a*)* = a*, 1* = 1, and a + a* = 1 + a* = a* */
+  bool idempotent;
+  /* a b = b a, i.e., the factors of a product are ordered canonically. */
+  bool commutative;
+
+  template <typename SR>
+  static RewriteRules ForSemiring() {
+    return RewriteRules{SR::is_idempotent, SR::is_commutative};
+  }
+};
+
+class NodeFactory {
+  public:
+    NodeFactory();
+    virtual ~NodeFactory();
+
     virtual NodePtr NewAddition(NodePtr lhs, NodePtr rhs);
     virtual NodePtr NewMultiplication(NodePtr lhs, NodePtr rhs);
+    virtual NodePtr NewSum(std::vector<NodePtr> children);
+    virtual NodePtr NewProduct(std::vector<NodePtr> children);
     virtual NodePtr NewStar(NodePtr node);
     virtual NodePtr NewElement(VarPtr var);
     virtual NodePtr GetEmpty() const { return empty_; }
     virtual NodePtr GetEpsilon() const { return epsilon_; }
 
     virtual void PrintDot(std::ostream &out);
-    virtual void GC();
+
+    /* Frees all the Nodes that are not reachable from a Node with external
+     * references (see [Note: Garbage]) and returns their number. */
+    virtual std::size_t GC();
+
+    /* The number of Nodes (including empty and epsilon). */
+    virtual std::size_t GetSize();
+
+    /* All the ids of the Nodes are smaller than this. */
+    virtual std::size_t GetMaxId();
+
+    /* The rules apply only to the Nodes created afterwards, the existing
+     * ones are not touched.  By default there are none. */
+    void SetRewriteRules(const RewriteRules &rules) { rules_ = rules; }
+    const RewriteRules& GetRewriteRules() const { return rules_; }
 
   private:
-    std::unordered_map< std::pair<NodePtr, NodePtr>, NodePtr > additions_;
-    std::unordered_map< std::pair<NodePtr, NodePtr>, NodePtr > multiplications_;
-    std::unordered_map< NodePtr, NodePtr > stars_;
-    std::unordered_map< VarPtr, NodePtr > elems_;
+    /* A part of the hash-consing table together with the storage of its Nodes,
+     * see [Note: Concurrent hash-consing]. */
+    struct Shard {
+      std::mutex mutex;
+      NodeTable table;
+      NodeArena<Addition> additions;
+      NodeArena<Multiplication> multiplications;
+      NodeArena<Sum> sums;
+      NodeArena<Product> products;
+      NodeArena<Star> stars;
+      NodeArena<Element> elems;
+    };
+
+    static const std::size_t kShardBits = 4;
+    static const std::size_t kShards = 1 << kShardBits;
+
+    static std::size_t GetShard(std::size_t hash);
+
+    /* Looks up the Node with the given key and if there is none, creates one
+     * (of type T with the given arguments for the constructor) in the given
+     * arena of the Shard. */
+    template <typename T, typename... Args>
+    NodePtr GetOrCreate(NodeArena<T> Shard::*arena, const NodeTable::Key &key,
+                        Args&&... args);
+
+    /* The caller has to hold ids_mutex_. */
+    std::uint32_t NewId();
+
+    /* The caller has to hold all the locks. */
+    void Destroy(NodePtr node);
+
+    /* Simplifications of one + node (see RewriteRules), nullptr if none
+     * applies. */
+    NodePtr SimplifyAddition(NodePtr lhs, NodePtr rhs) const;
+
+    RewriteRules rules_;
+
+    Shard shards_[kShards];
+
+    /* All the Nodes indexed by their ids (nullptr for the unused ids),
+     * protected by ids_mutex_. */
+    std::vector<NodePtr> nodes_;
+    std::vector<std::uint32_t> free_ids_;
+    std::mutex ids_mutex_;
+
     NodePtr empty_;
     NodePtr epsilon_;
 };
 
 /*
- * [Note: Garbage]
+ * [Note: Node storage]
+ *
+ * The Nodes have no vtable, just a tag with their kind (which Accept() uses to
+ * call the right Visit()), a 32-bit id and the external reference count.  They
+ * are allocated from one NodeArena per kind and hash-consed in a NodeTable
+ * keyed on the kind and the children (or the variable).  Compared to a separate
+ * heap allocation per Node and a std::unordered_map per kind this uses a
+ * fraction of the memory and keeps the Nodes close to each other.
  *
- * The current version of NodeFactory will never deallocate Nodes since we
- * always keep at least one reference in the std::unordered_maps.  We should
- * probably introduce external reference count (external as in not counting the
- * references kept by NodeFactory itself).
+ * The children are stored as NodePtrs (and not ids), so that a traversal
+ * doesn't need to go through the NodeFactory.  The ids are dense, so
+ * everything that needs a map from Nodes (e.g., the marks of the GC) can use a
+ * vector instead.
+ */
+
+/*
+ * [Note: Concurrent hash-consing]
+ *
+ * The Nodes can be created from multiple threads at the same time (e.g., when
+ * computing the star of a matrix in parallel or when building the Jacobians
+ * of independent systems).  Instead of a single lock around the whole
+ * NodeFactory, the hash-consing table is split into kShards Shards, each with
+ * its own lock, NodeTable and NodeArenas.  The shard of a Node is given by the
+ * hash of its key, so the threads only contend if they create Nodes that
+ * happen to fall into the same Shard.
+ *
+ * The key is made canonical (e.g., the operands of an Addition are ordered)
+ * before it is hashed, so all the requests for the same Node go to the same
+ * Shard and are serialized by its lock: the first one creates the Node, all
+ * the others find it.  So NewAddition(a, b) == NewAddition(b, a) holds no
+ * matter which threads call it.  The only state shared by the Shards is the
+ * mapping from ids to Nodes, which has its own (short) critical section.
+ *
+ * Nodes never change after they are created, so they can be read (e.g.,
+ * traversed or compared with the keys in another Shard) without any lock, and
+ * their reference counts are atomic.  GC() takes all the locks, but the
+ * FreeSemirings are not locked, so GC() still must not run concurrently with
+ * anything else that uses the Nodes (and neither must SetRewriteRules()).
+ */
+
+/*
+ * [Note: Operand order]
+ *
+ * The operands of the commutative operations (Addition and Sum, and
+ * Multiplication and Product if the RewriteRules say so) are put into a
+ * canonical order, so that NewAddition(a, b) == NewAddition(b, a) and, for
+ * commutative rules, NewMultiplication(a, b) == NewMultiplication(b, a).
+ *
+ * The order compares the structures of the Nodes (see Node::GetStructure) and
+ * only if these are the same (i.e., on a hash collision) their ids.  The ids
+ * depend on the order in which the Nodes were created (which with multiple
+ * threads is up to the scheduling) and the ids of collected Nodes are reused,
+ * so ordering by the ids alone would make the shape of the DAG (and with it,
+ * e.g., the order in which FloatSemiring sums up the terms) differ from run to
+ * run.  The structures are the same in every run.
+ */
+
+/*
+ * [Note: N-ary Nodes]
+ *
+ * Folding the terms of a polynomial (or the factors of a monomial) one by one
+ * gives a long chain of binary Nodes.  Evaluating such a chain is strictly
+ * sequential and it makes the recursive traversals as deep as the chain is
+ * long.  So for three or more summands (factors) we use a single Sum (Product)
+ * with all of them as children.  The nested Sums (Products) are flattened,
+ * the children of a Sum are ordered (as for Addition) and for idempotent
+ * semirings deduplicated, the children of a Product are ordered only for
+ * commutative semirings (see RewriteRules).
+ *
+ * The evaluation reduces the children as a balanced tree (see
+ * BalancedReduce) and computes the powers of the repeated factors (e.g., x^k
+ * in a monomial) by squaring (see Power), so the depth is logarithmic in the
+ * number of children.
+ */
+
+/* Combines the items pairwise, i.e., op(op(i0, i1), op(i2, i3)) for four
+ * items, which is the same as folding them from left to right as long as op
+ * is associative. */
+template <typename T, typename Op>
+T BalancedReduce(std::vector<T> items, Op op) {
+  assert(!items.empty());
+  while (items.size() > 1) {
+    std::vector<T> reduced;
+    reduced.reserve((items.size() + 1) / 2);
+    for (std::size_t i = 0; i + 1 < items.size(); i += 2) {
+      reduced.push_back(op(items[i], items[i + 1]));
+    }
+    if (items.size() % 2 == 1) {
+      reduced.push_back(std::move(items.back()));
+    }
+    items.swap(reduced);
+  }
+  return std::move(items.front());
+}
+
+/* base^exponent (for exponent > 0) with O(log exponent) multiplications. */
+template <typename T, typename Op>
+T Power(T base, std::size_t exponent, Op multiply) {
+  assert(exponent > 0);
+  while (exponent % 2 == 0) {
+    base = multiply(base, base);
+    exponent /= 2;
+  }
+  T result = base;
+  while ((exponent /= 2) > 0) {
+    base = multiply(base, base);
+    if (exponent % 2 == 1) {
+      result = multiply(result, base);
+    }
+  }
+  return result;
+}
+
+/*
+ * [Note: Garbage]
  *
- * But we have to be careful with this because we can easily end up destroying
- * and creating the same object repeatedly during the fixed-point computation.
- * One way out of this would be to perform something like a garbage collection.
- * So instead of deallocating (and removing the entry from unordered_map) as
- * soon as the external reference count is 0, do that from time to time.
+ * NodeFactory keeps every Node in its hash-consing table, so the Nodes are not
+ * freed when the last FreeSemiring referring to them goes away.  Freeing them
+ * right away would be a bad idea anyway, since we can easily end up destroying
+ * and creating the same Node repeatedly during the fixed-point computation.
  *
+ * Instead every Node counts its external references, i.e., the FreeSemiring
+ * handles pointing to it (the references between the Nodes themselves are not
+ * counted).  From time to time (e.g., after solving an SCC) we call GC(), which
+ * marks everything reachable from a Node with external references and sweeps
+ * the rest.  Note that a Node returned by one of the New* functions is not
+ * referenced until it is wrapped in a FreeSemiring, so GC() must not run
+ * concurrently with anything else that uses the factory.
  */
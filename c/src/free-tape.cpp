@@ -0,0 +1,418 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include "free-tape.h"
+
+/*
+ * TapeCompiler
+ *
+ * Appends the instructions for the not-yet-compiled nodes of a DAG to the tape
+ * (in post-order, so the operands always come before the instruction that uses
+ * them).  We remember the index of every compiled node, so that the shared
+ * subgraphs are compiled (and later evaluated) only once.
+ */
+class TapeCompiler : public NodeVisitor {
+  public:
+    TapeCompiler(FreeTape &tape) : tape_(tape) {}
+    ~TapeCompiler() = default;
+
+    std::uint32_t Compile(const NodePtr &node) {
+      auto iter = indices_.find(node);
+      if (iter != indices_.end()) {
+        return iter->second;
+      }
+      node->Accept(*this);  /* Appends the instructions for node. */
+      indices_.emplace(node, result_);
+      return result_;
+    }
+
+    void Visit(const Addition &a) {
+      std::uint32_t lhs = Compile(a.GetLhs());
+      std::uint32_t rhs = Compile(a.GetRhs());
+      Emit(FreeTape::Opcode::kAddition, lhs, rhs);
+    }
+
+    void Visit(const Multiplication &m) {
+      std::uint32_t lhs = Compile(m.GetLhs());
+      std::uint32_t rhs = Compile(m.GetRhs());
+      Emit(FreeTape::Opcode::kMultiplication, lhs, rhs);
+    }
+
+    /* A Sum (Product) becomes a balanced tree of binary instructions, see
+     * [Note: N-ary Nodes]. */
+    void Visit(const Sum &s) {
+      std::vector<std::uint32_t> indices;
+      for (auto child : s.GetChildren()) {
+        indices.push_back(Compile(child));
+      }
+      result_ = BalancedReduce(std::move(indices), Emitter(*this,
+          FreeTape::Opcode::kAddition));
+    }
+
+    void Visit(const Product &p) {
+      Emitter multiply{*this, FreeTape::Opcode::kMultiplication};
+      std::vector<std::uint32_t> indices;
+      for (const auto &power : p.GetPowers()) {
+        indices.push_back(Power(Compile(power.first), power.second, multiply));
+      }
+      result_ = BalancedReduce(std::move(indices), multiply);
+    }
+
+    void Visit(const Star &s) {
+      Emit(FreeTape::Opcode::kStar, Compile(s.GetNode()), 0);
+    }
+
+    void Visit(const Element &e) {
+      /* Every variable has exactly one Element node, so we see it only once. */
+      tape_.vars_.push_back(e.GetVar());
+      Emit(FreeTape::Opcode::kElement, tape_.vars_.size() - 1, 0);
+    }
+
+    void Visit(const Epsilon &e) {
+      Emit(FreeTape::Opcode::kEpsilon, 0, 0);
+    }
+
+    void Visit(const Empty &e) {
+      Emit(FreeTape::Opcode::kEmpty, 0, 0);
+    }
+
+  private:
+    /* Emits a binary instruction and returns its index. */
+    struct Emitter {
+      Emitter(TapeCompiler &c, FreeTape::Opcode o) : compiler(c), opcode(o) {}
+
+      std::uint32_t operator()(std::uint32_t lhs, std::uint32_t rhs) const {
+        return compiler.Emit(opcode, lhs, rhs);
+      }
+
+      TapeCompiler &compiler;
+      FreeTape::Opcode opcode;
+    };
+
+    std::uint32_t Emit(FreeTape::Opcode opcode, std::uint32_t lhs,
+                       std::uint32_t rhs) {
+      assert(tape_.tape_.size() < std::numeric_limits<std::uint32_t>::max());
+      tape_.tape_.push_back(FreeTape::Instruction{opcode, lhs, rhs});
+      result_ = tape_.tape_.size() - 1;
+      return result_;
+    }
+
+    FreeTape &tape_;
+    std::unordered_map<NodePtr, std::uint32_t> indices_;
+    /* The index of the last instruction of the most recently compiled node. */
+    std::uint32_t result_ = 0;
+};
+
+
+FreeTape::FreeTape(const Matrix<FreeSemiring> &matrix)
+    : rows_(matrix.getRows()), columns_(matrix.getColumns()) {
+  TapeCompiler compiler{*this};
+  for (const auto &elem : matrix.getElements()) {
+    outputs_.push_back(compiler.Compile(elem.node_));
+  }
+}
+
+FreeTape::Levels FreeTape::Levelize(
+    const std::vector<Instruction> &instructions, std::size_t offset) {
+  /* The level of every instruction plus one, so that 0 can stand for the
+   * operands below offset. */
+  std::vector<std::uint32_t> depth(instructions.size());
+  auto get_depth = [&](std::uint32_t position) -> std::uint32_t {
+    return position < offset ? 0 : depth[position - offset];
+  };
+  std::uint32_t max_depth = 0;
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    const auto &instruction = instructions[i];
+    switch (instruction.opcode) {
+      case Opcode::kAddition:
+      case Opcode::kMultiplication:
+        depth[i] = std::max(get_depth(instruction.lhs),
+                            get_depth(instruction.rhs)) + 1;
+        break;
+      case Opcode::kStar:
+        depth[i] = get_depth(instruction.lhs) + 1;
+        break;
+      default:
+        depth[i] = 1;
+    }
+    max_depth = std::max(max_depth, depth[i]);
+  }
+
+  /* Counting sort by the level (stable, so within a level the instructions
+   * stay in the order of the tape). */
+  Levels levels;
+  levels.starts.assign(max_depth + 1, 0);
+  for (auto d : depth) {
+    ++levels.starts[d];
+  }
+  for (std::size_t level = 1; level < levels.starts.size(); ++level) {
+    levels.starts[level] += levels.starts[level - 1];
+  }
+  /* Now starts[d] is the end of the level d - 1. */
+  levels.order.resize(instructions.size());
+  std::vector<std::size_t> next(levels.starts.begin(), levels.starts.end() - 1);
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    levels.order[next[depth[i] - 1]++] = i;
+  }
+  return levels;
+}
+
+
+/*
+ * [Note: Tape files]
+ *
+ * Computing the star of the Jacobian symbolically is by far the most expensive
+ * part of the setup, but it only depends on the structure of the equations
+ * (and on which of their coefficients are the same), not on the values of
+ * the coefficients.  So we can store the compiled tape in a file and reuse it
+ * for any system with the same structure (see StarCache).
+ *
+ * The file is a header (kMagic, the key and the sizes) followed by the
+ * instructions (three 32-bit words each), the outputs and the variables
+ * (kCoefficient followed by the index of the coefficient or kVariable
+ * followed by the position of the variable).  Storing the variables by their
+ * position instead of their name also works for the generated ones (e.g., the
+ * nonterminals the parser creates for EBNF), whose names depend on the order
+ * in which the variables were created.  Everything is
+ * in the native byte order, so the files are meant as a cache on the same
+ * machine, not for exchanging tapes.  Loading maps the file into memory and
+ * just copies the instructions after checking that every operand refers to
+ * an earlier instruction (so that even a corrupted file can't make the
+ * evaluation read out of bounds), no Nodes are created.
+ */
+
+namespace {
+
+const char kMagic[8] = {'N', 'T', 'A', 'P', 'E', '0', '0', '2'};
+const std::uint32_t kCoefficient = 0;
+const std::uint32_t kVariable = 1;
+
+struct TapeFileHeader {
+  char magic[8];
+  std::uint64_t key;
+  std::uint64_t instructions;
+  std::uint64_t outputs;
+  std::uint64_t vars;
+  std::uint64_t rows;
+  std::uint64_t columns;
+};
+
+/* Reads consecutive values from a buffer, fails instead of reading past its
+ * end. */
+class BufferReader {
+  public:
+    BufferReader(const char *begin, const char *end) : pos_(begin), end_(end) {}
+
+    template <typename T>
+    bool Read(T *value) {
+      if (static_cast<std::size_t>(end_ - pos_) < sizeof(T)) {
+        return false;
+      }
+      std::memcpy(value, pos_, sizeof(T));
+      pos_ += sizeof(T);
+      return true;
+    }
+
+    bool AtEnd() const { return pos_ == end_; }
+
+  private:
+    const char *pos_;
+    const char *end_;
+};
+
+template <typename T>
+void WriteValue(std::ostream &out, const T &value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+}  /* Anonymous namespace. */
+
+bool FreeTape::Save(const std::string &path, std::uint64_t key,
+    const std::unordered_map<VarPtr, std::uint32_t> &coefficients,
+    const std::vector<VarPtr> &variables) const {
+  std::unordered_map<VarPtr, std::uint32_t> positions;
+  for (std::size_t i = 0; i < variables.size(); ++i) {
+    positions.emplace(variables[i], i);
+  }
+  /* The kind and index of every variable of the tape. */
+  std::vector< std::pair<std::uint32_t, std::uint32_t> > var_indices;
+  for (const auto &var : vars_) {
+    auto iter = coefficients.find(var);
+    if (iter != coefficients.end()) {
+      var_indices.emplace_back(kCoefficient, iter->second);
+      continue;
+    }
+    iter = positions.find(var);
+    if (iter == positions.end()) {
+      return false;
+    }
+    var_indices.emplace_back(kVariable, iter->second);
+  }
+
+  /* Write to a temporary file and rename it, so that a concurrent Load never
+   * sees a partially written file.  Every writer gets its own temporary file
+   * (in the same directory, so the rename stays on one file system), so
+   * concurrent Saves of the same path don't write into each other's files. */
+  std::vector<char> tmp_path(path.begin(), path.end());
+  const char kSuffix[] = ".XXXXXX";
+  tmp_path.insert(tmp_path.end(), kSuffix, kSuffix + sizeof(kSuffix));
+  int fd = mkstemp(tmp_path.data());
+  if (fd < 0) {
+    return false;
+  }
+  /* mkstemp only allows the owner to read the file. */
+  bool created = fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == 0;
+  close(fd);
+  {
+    std::ofstream out{tmp_path.data(), std::ofstream::binary};
+    if (!created || !out) {
+      std::remove(tmp_path.data());
+      return false;
+    }
+    TapeFileHeader header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.key = key;
+    header.instructions = tape_.size();
+    header.outputs = outputs_.size();
+    header.vars = vars_.size();
+    header.rows = rows_;
+    header.columns = columns_;
+    WriteValue(out, header);
+    for (const auto &instruction : tape_) {
+      WriteValue(out, static_cast<std::uint32_t>(instruction.opcode));
+      WriteValue(out, instruction.lhs);
+      WriteValue(out, instruction.rhs);
+    }
+    for (auto output : outputs_) {
+      WriteValue(out, output);
+    }
+    for (const auto &kind_index : var_indices) {
+      WriteValue(out, kind_index.first);
+      WriteValue(out, kind_index.second);
+    }
+    out.close();
+    if (!out) {
+      std::remove(tmp_path.data());
+      return false;
+    }
+  }
+  if (std::rename(tmp_path.data(), path.c_str()) != 0) {
+    std::remove(tmp_path.data());
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<FreeTape> FreeTape::Load(const std::string &path,
+    std::uint64_t key, const std::vector<VarPtr> &coefficients,
+    const std::vector<VarPtr> &variables) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+    close(fd);
+    return nullptr;
+  }
+  const std::size_t size = file_stat.st_size;
+  void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+
+  const char *begin = static_cast<const char*>(data);
+  BufferReader reader{begin, begin + size};
+  std::unique_ptr<FreeTape> tape{new FreeTape};
+  auto parse = [&]() -> bool {
+    TapeFileHeader header;
+    if (!reader.Read(&header) ||
+        std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.key != key || header.instructions > size ||
+        header.outputs != header.rows * header.columns ||
+        header.outputs > size || header.vars > size) {
+      return false;
+    }
+    tape->rows_ = header.rows;
+    tape->columns_ = header.columns;
+
+    tape->tape_.reserve(header.instructions);
+    for (std::uint64_t i = 0; i < header.instructions; ++i) {
+      std::uint32_t opcode;
+      Instruction instruction;
+      if (!reader.Read(&opcode) || !reader.Read(&instruction.lhs) ||
+          !reader.Read(&instruction.rhs) ||
+          opcode > static_cast<std::uint32_t>(Opcode::kEmpty)) {
+        return false;
+      }
+      instruction.opcode = static_cast<Opcode>(opcode);
+      switch (instruction.opcode) {
+        case Opcode::kAddition:
+        case Opcode::kMultiplication:
+          if (instruction.rhs >= i) {
+            return false;
+          }
+          /* Fall through. */
+        case Opcode::kStar:
+          if (instruction.lhs >= i) {
+            return false;
+          }
+          break;
+        case Opcode::kElement:
+          if (instruction.lhs >= header.vars) {
+            return false;
+          }
+          break;
+        default:
+          break;
+      }
+      tape->tape_.push_back(instruction);
+    }
+
+    tape->outputs_.reserve(header.outputs);
+    for (std::uint64_t i = 0; i < header.outputs; ++i) {
+      std::uint32_t output;
+      if (!reader.Read(&output) || output >= header.instructions) {
+        return false;
+      }
+      tape->outputs_.push_back(output);
+    }
+
+    tape->vars_.reserve(header.vars);
+    for (std::uint64_t i = 0; i < header.vars; ++i) {
+      std::uint32_t kind;
+      std::uint32_t index;
+      if (!reader.Read(&kind) || !reader.Read(&index)) {
+        return false;
+      }
+      const std::vector<VarPtr> *targets;
+      if (kind == kCoefficient) {
+        targets = &coefficients;
+      } else if (kind == kVariable) {
+        targets = &variables;
+      } else {
+        return false;
+      }
+      if (index >= targets->size()) {
+        return false;
+      }
+      tape->vars_.push_back((*targets)[index]);
+    }
+    return reader.AtEnd();
+  };
+
+  bool valid = parse();
+  munmap(data, size);
+  return valid ? std::move(tape) : nullptr;
+}
@@ -0,0 +1,645 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "free-semiring.h"
+#include "matrix.h"
+#include "thread_pool.h"
+#include "var.h"
+
+/*
+ * FreeTape
+ *
+ * A Matrix<FreeSemiring> compiled into a flat sequence of instructions.  The
+ * nodes reachable from the elements of the matrix are sorted topologically
+ * (children before parents) and every node becomes one instruction that refers
+ * to its operands by their position in the tape.  So evaluating the tape is
+ * just a single loop over a vector, filling a vector of semiring values (the
+ * i-th value is the result of the i-th instruction).  Compared to the Evaluator
+ * this avoids the virtual calls, the hash lookups for memoization and the
+ * allocation of every intermediate value.
+ *
+ * The values are computed with exactly the same operations (and in the same
+ * order of operands) as by the Evaluator, so the results are the same.
+ *
+ * Compile the tape once (e.g., for the star of the Jacobian) and evaluate it
+ * in every Newton step.
+ *
+ * The tape can also be evaluated in parallel, see [Note: Wavefront], and
+ * stored in a file, see [Note: Tape files].
+ */
+class FreeTape {
+  public:
+    enum class Opcode : std::uint8_t {
+      kAddition, kMultiplication, kStar, kElement, kEpsilon, kEmpty
+    };
+
+    /* For kAddition and kMultiplication the operands are the indices of the
+     * lhs and rhs, for kStar only lhs is used and for kElement lhs is the
+     * index into vars_. */
+    struct Instruction {
+      Opcode opcode;
+      std::uint32_t lhs;
+      std::uint32_t rhs;
+    };
+
+    explicit FreeTape(const Matrix<FreeSemiring> &matrix);
+
+    std::size_t GetSize() const { return tape_.size(); }
+
+    /* The variables that the tape depends on. */
+    const std::vector<VarPtr>& GetVars() const { return vars_; }
+
+    template <typename SR>
+    Matrix<SR> Eval(const std::unordered_map<VarPtr, SR> &valuation) const {
+      std::vector<SR> values;
+      return Eval(valuation, values);
+    }
+
+    /* Same as above, but reuses values as the storage for the intermediate
+     * results (so that evaluating the tape repeatedly doesn't need to allocate
+     * it every time). */
+    template <typename SR>
+    Matrix<SR> Eval(const std::unordered_map<VarPtr, SR> &valuation,
+                    std::vector<SR> &values) const;
+
+    /* Same as above, but evaluates the independent instructions in parallel
+     * using the given pool (the semiring has to be thread-safe). */
+    template <typename SR>
+    Matrix<SR> Eval(const std::unordered_map<VarPtr, SR> &valuation,
+                    ThreadPool &pool) const;
+
+    /* Writes the tape with the given key to a file.  The variables in
+     * coefficients are stored as their index, all the others as their
+     * position in variables.  Returns false if the file couldn't be written
+     * (or the tape depends on a variable that is in neither). */
+    bool Save(const std::string &path, std::uint64_t key,
+        const std::unordered_map<VarPtr, std::uint32_t> &coefficients,
+        const std::vector<VarPtr> &variables) const;
+
+    /* Reads a tape written by Save with the same key, the coefficient with
+     * index i becomes coefficients[i] and the variable at position i becomes
+     * variables[i].  Returns nullptr if there is no such file or it's not
+     * valid. */
+    static std::unique_ptr<FreeTape> Load(const std::string &path,
+        std::uint64_t key, const std::vector<VarPtr> &coefficients,
+        const std::vector<VarPtr> &variables);
+
+  private:
+    FreeTape() : rows_(0), columns_(0) {}
+
+    /* The instructions ordered by their level, see [Note: Wavefront]. */
+    struct Levels {
+      /* The indices of the instructions of the i-th level are
+       * order[starts[i]], ..., order[starts[i + 1] - 1]. */
+      std::vector<std::uint32_t> order;
+      std::vector<std::size_t> starts;
+    };
+
+    /* The operands below offset are not computed by the instructions (e.g.,
+     * the constants of a FoldedTape), so they are available from the start. */
+    static Levels Levelize(const std::vector<Instruction> &instructions,
+                           std::size_t offset);
+
+    /* Calls f(i) for every instruction i, level by level, the instructions of
+     * the same level in parallel. */
+    template <typename F>
+    static void ForEachLevel(const Levels &levels, ThreadPool &pool,
+                             const F &f);
+
+    /* Appends the results of the instructions to values.  The operands refer
+     * to the positions in values, so the instructions can also build on values
+     * that were there before. */
+    template <typename SR>
+    static void Run(const std::vector<Instruction> &instructions,
+                    const std::vector<VarPtr> &vars,
+                    const std::unordered_map<VarPtr, SR> &valuation,
+                    std::vector<SR> &values);
+
+    /* Appends the result of a single instruction. */
+    template <typename SR>
+    static void Apply(const Instruction &instruction,
+                      const std::vector<VarPtr> &vars,
+                      const std::unordered_map<VarPtr, SR> &valuation,
+                      std::vector<SR> &values) {
+      values.emplace_back(Compute(instruction, vars, valuation, values));
+    }
+
+    /* Returns the result of a single instruction. */
+    template <typename SR>
+    static SR Compute(const Instruction &instruction,
+                      const std::vector<VarPtr> &vars,
+                      const std::unordered_map<VarPtr, SR> &valuation,
+                      const std::vector<SR> &values);
+
+    template <typename SR>
+    static Matrix<SR> Collect(const std::vector<std::uint32_t> &outputs,
+                              std::size_t rows, std::size_t columns,
+                              const std::vector<SR> &values);
+
+    std::vector<Instruction> tape_;
+    std::vector<VarPtr> vars_;
+
+    /* Index of the instruction computing every element of the matrix. */
+    std::vector<std::uint32_t> outputs_;
+    std::size_t rows_;
+    std::size_t columns_;
+
+    friend class TapeCompiler;
+
+    template <typename SR>
+    friend class FoldedTape;
+
+    friend class FloatBatchTape;
+};
+
+
+/*
+ * FoldedTape
+ *
+ * A FreeTape partially evaluated for the given valuation: every instruction
+ * that does not (transitively) depend on any of the given variables is
+ * evaluated just once in the constructor and the remaining instructions refer
+ * to the results as constants.  So Eval has to go only through the part of
+ * the tape that depends on the variables.
+ *
+ * In Newton's method these are the poly_vars (whose values change in every
+ * step), whereas the coefficients introduced by Polynomial::make_free stay
+ * the same.
+ */
+template <typename SR>
+class FoldedTape {
+  public:
+    FoldedTape(const FreeTape &tape, const std::vector<VarPtr> &variables,
+               const std::unordered_map<VarPtr, SR> &valuation);
+
+    /* Evaluates the tape, the valuation has to contain the variables given to
+     * the constructor (the values of all other variables are ignored).  With a
+     * pool, the independent instructions are evaluated in parallel (the
+     * semiring has to be thread-safe). */
+    Matrix<SR> Eval(const std::unordered_map<VarPtr, SR> &valuation,
+                    ThreadPool *pool = nullptr);
+
+    /* Same as Eval, but reuses the results of the previous evaluation: only
+     * the instructions that depend on a variable whose value changed (i.e., is
+     * not == to the previous one) are recomputed.  This pays off if the values
+     * of most variables stay the same between the calls (e.g., in Newton's
+     * method for idempotent semirings many variables stabilize early), but is
+     * only correct if == is exact (so not for FloatSemiring). */
+    Matrix<SR> Update(const std::unordered_map<VarPtr, SR> &valuation,
+                      ThreadPool *pool = nullptr);
+
+    /* The following evaluations compute only the rows r of the matrix with
+     * skip[r] not set (and only the instructions these depend on), the other
+     * rows are just null.  If a skipped row becomes live again, the next
+     * Update evaluates the whole (live part of the) tape. */
+    void SkipRows(const std::vector<std::uint8_t> &skip);
+
+    std::size_t GetNumConstants() const { return num_constants_; }
+
+    /* The number of instructions evaluated by every Eval (without any skipped
+     * rows). */
+    std::size_t GetSize() const { return tape_.size(); }
+
+  private:
+    /* Recomputes the i-th instruction of tape_ if any of its operands changed
+     * (for Update). */
+    void UpdateInstruction(std::size_t i,
+                           const std::unordered_map<VarPtr, SR> &valuation);
+
+    /* Whether the i-th instruction of tape_ is needed by some row that is
+     * not skipped (see SkipRows). */
+    bool IsNeeded(std::size_t i) const {
+      return needed_.empty() || needed_[i];
+    }
+
+    /* The elements of the matrix (with the skipped rows null). */
+    Matrix<SR> Collect() const;
+
+    /* Computed on the first parallel evaluation. */
+    const FreeTape::Levels& GetLevels() {
+      if (levels_.starts.empty()) {
+        levels_ = FreeTape::Levelize(tape_, num_constants_);
+      }
+      return levels_;
+    }
+
+    std::vector<FreeTape::Instruction> tape_;
+    std::vector<VarPtr> vars_;
+    std::vector<std::uint32_t> outputs_;
+    std::size_t rows_;
+    std::size_t columns_;
+
+    /* The first num_constants_ values are the constants, followed by the
+     * results of tape_. */
+    std::vector<SR> values_;
+    std::size_t num_constants_;
+
+    /* Whether values_ contains the results of a previous evaluation. */
+    bool evaluated_;
+
+    /* Which instructions were recomputed by the current Update (not a
+     * vector<bool>, so that different threads can set different entries). */
+    std::vector<std::uint8_t> changed_;
+
+    /* The rows and instructions set by SkipRows (empty if nothing is
+     * skipped). */
+    std::vector<std::uint8_t> skip_;
+    std::vector<std::uint8_t> needed_;
+
+    FreeTape::Levels levels_;
+};
+
+
+/*
+ * [Note: Wavefront]
+ *
+ * The level of an instruction is 0 if none of its operands is computed by
+ * the tape (e.g., for Element) and otherwise one more than the maximum level
+ * of its operands.  So all the instructions of the same level are independent
+ * of each other and can be evaluated in parallel, once all the previous levels
+ * are done.  Every instruction still writes its result to its own slot in the
+ * vector of values, so the results are exactly the same as when evaluating the
+ * tape sequentially.
+ *
+ * This pays off for the semirings where a single operation is expensive
+ * (e.g., SemilinSetExp), where evaluating the star of the Jacobian is usually
+ * the bulk of the work of every Newton step.  The stars of larger matrices are
+ * quite wide, so there are plenty of instructions on every level.
+ */
+
+/* Evaluates the matrix as a FreeTape in parallel (see [Note: Wavefront]).
+ * The result is the same as that of FreeSemiringMatrixEval without a pool. */
+template <typename SR>
+Matrix<SR> FreeSemiringMatrixEval(const Matrix<FreeSemiring> &matrix,
+    const std::unordered_map<VarPtr, SR> &valuation, ThreadPool &pool) {
+  return FreeTape{matrix}.Eval(valuation, pool);
+}
+
+template <typename SR>
+Matrix<SR> FreeTape::Eval(const std::unordered_map<VarPtr, SR> &valuation,
+                          std::vector<SR> &values) const {
+  values.clear();
+  values.reserve(tape_.size());
+  Run(tape_, vars_, valuation, values);
+  return Collect(outputs_, rows_, columns_, values);
+}
+
+template <typename SR>
+Matrix<SR> FreeTape::Eval(const std::unordered_map<VarPtr, SR> &valuation,
+                          ThreadPool &pool) const {
+  /* Every instruction writes only its own slot and reads the slots of the
+   * previous levels. */
+  std::vector<SR> values(tape_.size(), SR::null());
+  ForEachLevel(Levelize(tape_, 0), pool, [&](std::uint32_t i) {
+    values[i] = Compute(tape_[i], vars_, valuation, values);
+  });
+  return Collect(outputs_, rows_, columns_, values);
+}
+
+template <typename F>
+void FreeTape::ForEachLevel(const Levels &levels, ThreadPool &pool,
+                            const F &f) {
+  /* Giving every instruction its own task would cost more than the
+   * instruction itself for the cheap semirings, so we split every level into
+   * a few chunks per thread. */
+  const std::size_t max_chunks = 4 * pool.GetThreads();
+  for (std::size_t level = 0; level + 1 < levels.starts.size(); ++level) {
+    const std::size_t begin = levels.starts[level];
+    const std::size_t size = levels.starts[level + 1] - begin;
+    const std::size_t chunks = std::min(size, max_chunks);
+    if (chunks <= 1) {
+      for (std::size_t k = begin; k < begin + size; ++k) {
+        f(levels.order[k]);
+      }
+      continue;
+    }
+    pool.ParallelFor(0, chunks, [&](std::size_t chunk) {
+      for (std::size_t k = begin + chunk * size / chunks;
+           k < begin + (chunk + 1) * size / chunks; ++k) {
+        f(levels.order[k]);
+      }
+    });
+  }
+}
+
+template <typename SR>
+void FreeTape::Run(const std::vector<Instruction> &instructions,
+                   const std::vector<VarPtr> &vars,
+                   const std::unordered_map<VarPtr, SR> &valuation,
+                   std::vector<SR> &values) {
+  /* The caller reserves enough space for all the values, which guarantees
+   * that the references to the operands stay valid when appending. */
+  assert(values.capacity() >= values.size() + instructions.size());
+  for (const auto &instruction : instructions) {
+    Apply(instruction, vars, valuation, values);
+  }
+}
+
+template <typename SR>
+SR FreeTape::Compute(const Instruction &instruction,
+                     const std::vector<VarPtr> &vars,
+                     const std::unordered_map<VarPtr, SR> &valuation,
+                     const std::vector<SR> &values) {
+  switch (instruction.opcode) {
+    case Opcode::kAddition:
+      return values[instruction.lhs] + values[instruction.rhs];
+    case Opcode::kMultiplication:
+      return values[instruction.lhs] * values[instruction.rhs];
+    case Opcode::kStar:
+      return values[instruction.lhs].star();
+    case Opcode::kElement: {
+      auto iter = valuation.find(vars[instruction.lhs]);
+      assert(iter != valuation.end());
+      return iter->second;
+    }
+    case Opcode::kEpsilon:
+      return SR::one();
+    case Opcode::kEmpty:
+      return SR::null();
+  }
+  assert(false);
+  return SR::null();
+}
+
+template <typename SR>
+Matrix<SR> FreeTape::Collect(const std::vector<std::uint32_t> &outputs,
+                             std::size_t rows, std::size_t columns,
+                             const std::vector<SR> &values) {
+  if (outputs.empty()) {
+    return Matrix<SR>(rows, columns);
+  }
+  std::vector<SR> result;
+  result.reserve(outputs.size());
+  for (auto output : outputs) {
+    result.emplace_back(values[output]);
+  }
+  return Matrix<SR>(rows, std::move(result));
+}
+
+
+template <typename SR>
+FoldedTape<SR>::FoldedTape(const FreeTape &tape,
+    const std::vector<VarPtr> &variables,
+    const std::unordered_map<VarPtr, SR> &valuation)
+    : rows_(tape.rows_), columns_(tape.columns_), num_constants_(0),
+      evaluated_(false) {
+  typedef FreeTape::Opcode Opcode;
+  const std::unordered_set<VarPtr> variable_set(variables.begin(),
+                                                variables.end());
+  const auto &instructions = tape.tape_;
+
+  /* Which instructions are constant, i.e., do not depend on the variables. */
+  std::vector<bool> constant(instructions.size());
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    const auto &instruction = instructions[i];
+    switch (instruction.opcode) {
+      case Opcode::kAddition:
+      case Opcode::kMultiplication:
+        constant[i] = constant[instruction.lhs] && constant[instruction.rhs];
+        break;
+      case Opcode::kStar:
+        constant[i] = constant[instruction.lhs];
+        break;
+      case Opcode::kElement:
+        constant[i] = variable_set.count(tape.vars_[instruction.lhs]) == 0;
+        break;
+      default:
+        constant[i] = true;
+    }
+  }
+
+  /* We only need to keep the constants that are used by the remaining
+   * instructions or are elements of the matrix. */
+  std::vector<bool> used(instructions.size());
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    const auto &instruction = instructions[i];
+    if (constant[i]) {
+      continue;
+    }
+    if (instruction.opcode == Opcode::kAddition ||
+        instruction.opcode == Opcode::kMultiplication) {
+      used[instruction.lhs] = true;
+      used[instruction.rhs] = true;
+    } else if (instruction.opcode == Opcode::kStar) {
+      used[instruction.lhs] = true;
+    }
+  }
+  for (auto output : tape.outputs_) {
+    used[output] = true;
+  }
+
+  /* Evaluate all the constants (the non-constant instructions just get a
+   * placeholder, since nothing constant depends on them). */
+  std::vector<SR> all_values;
+  all_values.reserve(instructions.size());
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    if (constant[i]) {
+      FreeTape::Apply(instructions[i], tape.vars_, valuation, all_values);
+    } else {
+      all_values.emplace_back(SR::null());
+    }
+  }
+
+  /* The new position of every instruction. */
+  std::vector<std::uint32_t> position(instructions.size());
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    if (constant[i] && used[i]) {
+      position[i] = values_.size();
+      values_.emplace_back(std::move(all_values[i]));
+    }
+  }
+  num_constants_ = values_.size();
+
+  for (std::size_t i = 0; i < instructions.size(); ++i) {
+    if (constant[i]) {
+      continue;
+    }
+    FreeTape::Instruction instruction = instructions[i];
+    switch (instruction.opcode) {
+      case Opcode::kAddition:
+      case Opcode::kMultiplication:
+        instruction.rhs = position[instruction.rhs];
+        /* Fall through. */
+      case Opcode::kStar:
+        instruction.lhs = position[instruction.lhs];
+        break;
+      case Opcode::kElement:
+        vars_.push_back(tape.vars_[instruction.lhs]);
+        instruction.lhs = vars_.size() - 1;
+        break;
+      default:
+        assert(false);  /* Epsilon and Empty are always constant. */
+    }
+    position[i] = num_constants_ + tape_.size();
+    tape_.push_back(instruction);
+  }
+
+  for (auto output : tape.outputs_) {
+    outputs_.push_back(position[output]);
+  }
+}
+
+template <typename SR>
+void FoldedTape<SR>::SkipRows(const std::vector<std::uint8_t> &skip) {
+  typedef FreeTape::Opcode Opcode;
+  assert(skip.size() == rows_);
+  if (skip == skip_) {
+    return;
+  }
+  skip_ = skip;
+
+  /* Mark the instructions computing the live elements and then (backwards)
+   * their operands. */
+  std::vector<std::uint8_t> needed(tape_.size(), 0);
+  for (std::size_t k = 0; k < outputs_.size(); ++k) {
+    if (!skip_[k / columns_] && outputs_[k] >= num_constants_) {
+      needed[outputs_[k] - num_constants_] = 1;
+    }
+  }
+  for (std::size_t i = tape_.size(); i-- > 0;) {
+    const auto &instruction = tape_[i];
+    if (!needed[i]) {
+      continue;
+    }
+    if (instruction.opcode == Opcode::kAddition ||
+        instruction.opcode == Opcode::kMultiplication) {
+      if (instruction.rhs >= num_constants_) {
+        needed[instruction.rhs - num_constants_] = 1;
+      }
+    }
+    if (instruction.opcode != Opcode::kElement &&
+        instruction.lhs >= num_constants_) {
+      needed[instruction.lhs - num_constants_] = 1;
+    }
+  }
+
+  /* The values of the instructions that were not needed so far are stale, so
+   * Update cannot tell what changed. */
+  for (std::size_t i = 0; i < tape_.size() && evaluated_; ++i) {
+    if (needed[i] && !IsNeeded(i)) {
+      evaluated_ = false;
+    }
+  }
+  needed_ = std::move(needed);
+}
+
+template <typename SR>
+Matrix<SR> FoldedTape<SR>::Eval(
+    const std::unordered_map<VarPtr, SR> &valuation, ThreadPool *pool) {
+  if (pool) {
+    values_.resize(num_constants_ + tape_.size(), SR::null());
+    FreeTape::ForEachLevel(GetLevels(), *pool, [&](std::uint32_t i) {
+      if (IsNeeded(i)) {
+        values_[num_constants_ + i] =
+          FreeTape::Compute(tape_[i], vars_, valuation, values_);
+      }
+    });
+  } else {
+    /* Drop the results of the previous evaluation, but keep the constants
+     * (and the allocated storage). */
+    values_.erase(values_.begin() + num_constants_, values_.end());
+    values_.reserve(num_constants_ + tape_.size());
+    if (needed_.empty()) {
+      FreeTape::Run(tape_, vars_, valuation, values_);
+    } else {
+      for (std::size_t i = 0; i < tape_.size(); ++i) {
+        if (needed_[i]) {
+          FreeTape::Apply(tape_[i], vars_, valuation, values_);
+        } else {
+          values_.emplace_back(SR::null());
+        }
+      }
+    }
+  }
+  evaluated_ = true;
+  return Collect();
+}
+
+template <typename SR>
+Matrix<SR> FoldedTape<SR>::Update(
+    const std::unordered_map<VarPtr, SR> &valuation, ThreadPool *pool) {
+  if (!evaluated_) {
+    return Eval(valuation, pool);
+  }
+
+  changed_.assign(tape_.size(), false);
+  if (pool) {
+    FreeTape::ForEachLevel(GetLevels(), *pool, [&](std::uint32_t i) {
+      if (IsNeeded(i)) {
+        UpdateInstruction(i, valuation);
+      }
+    });
+  } else {
+    for (std::size_t i = 0; i < tape_.size(); ++i) {
+      if (IsNeeded(i)) {
+        UpdateInstruction(i, valuation);
+      }
+    }
+  }
+
+  return Collect();
+}
+
+template <typename SR>
+Matrix<SR> FoldedTape<SR>::Collect() const {
+  Matrix<SR> result = FreeTape::Collect(outputs_, rows_, columns_, values_);
+  for (std::size_t r = 0; r < skip_.size(); ++r) {
+    if (skip_[r]) {
+      for (std::size_t c = 0; c < columns_; ++c) {
+        result.At(r, c) = SR::null();
+      }
+    }
+  }
+  return result;
+}
+
+template <typename SR>
+void FoldedTape<SR>::UpdateInstruction(std::size_t i,
+    const std::unordered_map<VarPtr, SR> &valuation) {
+  typedef FreeTape::Opcode Opcode;
+  auto changed = [this](std::uint32_t position) {
+    return position >= num_constants_ && changed_[position - num_constants_];
+  };
+
+  const auto &instruction = tape_[i];
+  SR &value = values_[num_constants_ + i];
+  switch (instruction.opcode) {
+    case Opcode::kAddition:
+      if (changed(instruction.lhs) || changed(instruction.rhs)) {
+        value = values_[instruction.lhs] + values_[instruction.rhs];
+        changed_[i] = true;
+      }
+      break;
+    case Opcode::kMultiplication:
+      if (changed(instruction.lhs) || changed(instruction.rhs)) {
+        value = values_[instruction.lhs] * values_[instruction.rhs];
+        changed_[i] = true;
+      }
+      break;
+    case Opcode::kStar:
+      if (changed(instruction.lhs)) {
+        value = values_[instruction.lhs].star();
+        changed_[i] = true;
+      }
+      break;
+    case Opcode::kElement: {
+      auto iter = valuation.find(vars_[instruction.lhs]);
+      assert(iter != valuation.end());
+      if (!(iter->second == value)) {
+        value = iter->second;
+        changed_[i] = true;
+      }
+      break;
+    }
+    default:
+      assert(false);  /* Epsilon and Empty are always constant. */
+  }
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cassert>
+#include <mutex>
 #include <set>
 #include <unordered_map>
 #include <utility>
@@ -194,6 +195,7 @@ class OffsetGeneratorsFactory {
 
     OffsetGeneratorsPtr<V> NewOffsetGenerators(const OffsetGeneratorsPtr<V> off_gens) {
       assert(off_gens);
+      std::lock_guard<std::mutex> lock{mutex_};
       auto iter_inserted =
         map_.emplace(KeyWrapper< OffsetGenerators<V> >{off_gens}, off_gens);
       /* Sanity check -- the actual vectors must be the same. */
@@ -204,6 +206,10 @@ class OffsetGeneratorsFactory {
   private:
     std::unordered_map< KeyWrapper< OffsetGenerators<V> >,
                         OffsetGeneratorsPtr<V> > map_;
+
+    /* Linear sets are built concurrently when a tape is evaluated with a
+     * ThreadPool (see FreeTape::Eval). */
+    std::mutex mutex_;
 };
 
 }  /* Anonymous namespace. */
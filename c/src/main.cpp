@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <numeric>
 #include <cstdlib>
+#include <memory>
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/strong_components.hpp>
 #include <boost/graph/graphviz.hpp>
@@ -13,6 +14,7 @@
 #include "newton.h"
 #include "commutativeRExp.h"
 #include "parser.h"
+#include "thread_pool.h"
 
 #ifdef OLD_SEMILINEAR_SET
 #include "semilinSetExp.h"
@@ -90,12 +92,15 @@ std::vector<std::vector<std::pair<VarPtr, Polynomial<SR>>>> group_by_scc(std::ve
 
 // apply the newton method to the given input
 template <typename SR>
-std::map<VarPtr, SR> apply_newton(std::vector<std::pair<VarPtr, Polynomial<SR>>> equations, bool scc, bool iteration_flag, int iterations, bool graphviz_output)
+std::map<VarPtr, SR> apply_newton(std::vector<std::pair<VarPtr, Polynomial<SR>>> equations, bool scc, bool iteration_flag, int iterations, bool graphviz_output, ThreadPool *pool, std::size_t serial_star_size, StarMode star_mode, const std::string &star_cache, const Tolerance &tolerance)
 {
 	// TODO: sanity checks on the input!
 
 	// generate an instance of the newton solver
-	Newton<SR> newton;
+	Newton<SR> newton{pool, serial_star_size, star_mode, star_cache, tolerance};
+
+	// the iterations newton actually needed (summed over all SCCs)
+	int iterations_used = 0;
 
 	// if we use the scc method, group the equations
 	// the outer vector contains SCCs starting with a bottom SCC at 0
@@ -136,11 +141,18 @@ std::map<VarPtr, SR> apply_newton(std::vector<std::pair<VarPtr, Polynomial<SR>>>
 
 		// do some real work here
 		std::map<VarPtr, SR> result = newton.solve_fixpoint(equations2[j], iterations);
+		iterations_used += newton.GetIterations();
 
 		// copy the results into the solution map
 		solution.insert(result.begin(), result.end());
+
+		// the free semiring terms of this SCC (the star of the Jacobian, etc.)
+		// are not needed anymore
+		FreeSemiring::GC();
 	}
 
+	std::cout << "Newton iterations: " << iterations_used << std::endl;
+
 	return solution;
 }
 
@@ -161,7 +173,9 @@ int main(int argc, char* argv[])
 	desc.add_options()
 		( "scc", "apply newton method iteratively to strongly connected components of the equation graph" )
 		( "help,h", "print this help message" )
-		( "iterations,i", po::value<int>(), "specify the number of newton iterations. default is optimal number" )
+		( "iterations,i", po::value<int>(), "specify the maximal number of newton iterations (it stops earlier once all variables have converged). default is optimal number" )
+		( "abs-tolerance", po::value<double>(), "an update of a variable at most this large (plus the relative tolerance) counts as converged. only for --float, default is 0" )
+		( "rel-tolerance", po::value<double>(), "an update of a variable at most this large relative to its value (plus the absolute tolerance) counts as converged. only for --float, default is 0" )
 		//( "verbose", "enable verbose output" )
 		//( "debug", "enable debug output" )
 		( "test", "just for testing purposes ... explicit test defined in main()" )
@@ -170,6 +184,11 @@ int main(int argc, char* argv[])
 		( "rexp", "commutative regular expression semiring" )
 		( "slset", "explicit semilinear sets semiring (as vectors)" )
 		( "graphviz", "create the file graph.dot with the equation graph" )
+		( "threads", po::value<int>(), "number of threads used to compute and evaluate the star of the Jacobian. default is 1 (no parallelism)" )
+		( "star-block", po::value<int>(), "blocks of at most this size are starred serially when using more threads. default is 16" )
+		( "numeric", "evaluate the Jacobian in every iteration and solve (1 - J) x = delta for the update instead of computing the star of J symbolically. only for --float" )
+		( "star-solve", "compute only the product of the star of the Jacobian with a symbolic vector instead of the whole star" )
+		( "star-cache", po::value<std::string>(), "directory in which the compiled stars of the Jacobians are cached, so that later runs on systems with the same structure skip computing them" )
 		;
 
 	po::variables_map vm;
@@ -220,6 +239,91 @@ int main(int argc, char* argv[])
 	if(vm.count("iterations"))
 		iterations = vm["iterations"].as<int>();
 
+	// only create the thread pool if we actually want to use more threads
+	std::unique_ptr<ThreadPool> pool;
+	if(vm.count("threads"))
+	{
+		int threads = vm["threads"].as<int>();
+		if(threads < 1)
+		{
+			std::cerr << "The number of threads has to be at least 1: " << threads << std::endl;
+			return -1;
+		}
+		if(threads > 1)
+			pool.reset(new ThreadPool(threads));
+	}
+
+	std::size_t serial_star_size = 16;
+	if(vm.count("star-block"))
+	{
+		int star_block = vm["star-block"].as<int>();
+		if(star_block < 1)
+		{
+			std::cerr << "The star block size has to be at least 1: " << star_block << std::endl;
+			return -1;
+		}
+		serial_star_size = star_block;
+	}
+
+	// --numeric replaces the symbolic star, so it does not go together with
+	// anything that changes (or caches) how the star is computed
+	if(vm.count("numeric"))
+	{
+		if(vm.count("rexp") || vm.count("slset"))
+		{
+			std::cerr << "--numeric is only supported for --float" << std::endl;
+			return -1;
+		}
+		if(vm.count("star-solve"))
+		{
+			std::cerr << "--numeric and --star-solve cannot be used together" << std::endl;
+			return -1;
+		}
+		if(vm.count("star-cache"))
+		{
+			std::cerr << "--numeric does not compute any stars to cache, so it cannot be used with --star-cache" << std::endl;
+			return -1;
+		}
+	}
+
+	StarMode star_mode = StarMode::kFull;
+	if(vm.count("numeric"))
+		star_mode = StarMode::kNumeric;
+	else if(vm.count("star-solve"))
+		star_mode = StarMode::kSolve;
+
+	std::string star_cache;
+	if(vm.count("star-cache"))
+		star_cache = vm["star-cache"].as<std::string>();
+
+	// the tolerances only make sense for semirings with a notion of distance
+	// (see IsNegligible), the other ones would silently ignore them
+	if((vm.count("abs-tolerance") || vm.count("rel-tolerance")) && (vm.count("rexp") || vm.count("slset")))
+	{
+		std::cerr << "--abs-tolerance and --rel-tolerance are only supported for --float" << std::endl;
+		return -1;
+	}
+
+	Tolerance tolerance{0, 0};
+	if(vm.count("abs-tolerance"))
+	{
+		tolerance.absolute = vm["abs-tolerance"].as<double>();
+		if(tolerance.absolute < 0)
+		{
+			std::cerr << "The absolute tolerance has to be at least 0: " << tolerance.absolute << std::endl;
+			return -1;
+		}
+	}
+	if(vm.count("rel-tolerance"))
+	{
+		tolerance.relative = vm["rel-tolerance"].as<double>();
+		if(tolerance.relative < 0)
+		{
+			std::cerr << "The relative tolerance has to be at least 0: " << tolerance.relative << std::endl;
+			return -1;
+		}
+	}
+
 	// check if we can do something useful
 	if(!vm.count("float") && !vm.count("rexp") && !vm.count("slset")) // check for all compatible parameters
 	{
@@ -262,7 +366,7 @@ int main(int argc, char* argv[])
 			std::cout << "* " << eq_it->first << " → " << eq_it->second << std::endl;
 		}
 
-		auto result = apply_newton<SemilinSetExp>(equations, vm.count("scc"), vm.count("iterations"), iterations, vm.count("graphviz"));
+		auto result = apply_newton<SemilinSetExp>(equations, vm.count("scc"), vm.count("iterations"), iterations, vm.count("graphviz"), pool.get(), serial_star_size, star_mode, star_cache, tolerance);
 
 		// final cleanup :)
 /*		SemilinSetExp tmp;
@@ -285,7 +389,7 @@ int main(int argc, char* argv[])
 		}
 
 		// apply the newton method to the equations
-		auto result = apply_newton<CommutativeRExp>(equations, vm.count("scc"), vm.count("iterations"), iterations, vm.count("graphviz"));
+		auto result = apply_newton<CommutativeRExp>(equations, vm.count("scc"), vm.count("iterations"), iterations, vm.count("graphviz"), pool.get(), serial_star_size, star_mode, star_cache, tolerance);
 		std::cout << result_string(result) << std::endl;
 	}
 	else if(vm.count("float")) {
@@ -297,7 +401,7 @@ int main(int argc, char* argv[])
 			std::cout << "* " << eq_it->first << " → " << eq_it->second << std::endl;
 		}
 
-		auto result = apply_newton<FloatSemiring>(equations, vm.count("scc"), vm.count("iterations"), iterations, vm.count("graphviz"));
+		auto result = apply_newton<FloatSemiring>(equations, vm.count("scc"), vm.count("iterations"), iterations, vm.count("graphviz"), pool.get(), serial_star_size, star_mode, star_cache, tolerance);
 		std::cout << result_string(result) << std::endl;
 	}
 
@@ -1,11 +1,79 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <initializer_list>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#include "semiring.h"
+#include "thread_pool.h"
+
+/*
+ * MatrixView
+ *
+ * A non-owning view of a rectangular block of a row-major buffer (usually the
+ * elements_ of some Matrix).  Rows of the block are stride elements apart, so
+ * taking a Block() of a view is cheap and does not copy anything.  A
+ * MatrixView<const SR> is a read-only view and can be created from the
+ * corresponding MatrixView<SR>.
+ */
+template <typename SR>
+class MatrixView {
+  public:
+    MatrixView(SR *data, std::size_t r, std::size_t c)
+        : data_(data), rows_(r), columns_(c), stride_(c) {}
+
+    MatrixView(SR *data, std::size_t r, std::size_t c, std::size_t stride)
+        : data_(data), rows_(r), columns_(c), stride_(stride) {
+      assert(columns_ <= stride_);
+    }
+
+    template <typename T>
+    MatrixView(const MatrixView<T> &view)
+        : data_(view.data_), rows_(view.rows_), columns_(view.columns_),
+          stride_(view.stride_) {}
+
+    inline SR& At(std::size_t r, std::size_t c) const {
+      assert(r < rows_ && c < columns_);
+      return data_[r * stride_ + c];
+    }
+
+    /* The block of size r x c starting at (row, column). */
+    MatrixView Block(std::size_t row, std::size_t column,
+                     std::size_t r, std::size_t c) const {
+      assert(row + r <= rows_ && column + c <= columns_);
+      return MatrixView{data_ + row * stride_ + column, r, c, stride_};
+    }
+
+    std::size_t getRows() const {
+      return rows_;
+    }
+
+    std::size_t getColumns() const {
+      return columns_;
+    }
+
+    /* Row r starts at getData() + r * getStride(). */
+    SR* getData() const {
+      return data_;
+    }
+
+    std::size_t getStride() const {
+      return stride_;
+    }
+
+  private:
+    SR *data_;
+    std::size_t rows_;
+    std::size_t columns_;
+    std::size_t stride_;
+
+    template <typename T>
+    friend class MatrixView;
+};
+
 template <typename SR>
 class Matrix {
   public:
@@ -65,16 +133,7 @@ class Matrix {
     Matrix operator*(const Matrix &rhs) const {
       assert(columns_ == rhs.rows_);
       Matrix result{rows_, rhs.columns_, SR::null()};
-      for (std::size_t r = 0; r < rows_; ++r) {
-        for (std::size_t c = 0; c < rhs.columns_; ++c) {
-          for (std::size_t i = 0; i < columns_; ++i) {
-            assert(GetIndex(r, i) < elements_.size());
-            assert(rhs.GetIndex(i, c) < rhs.elements_.size());
-            assert(result.GetIndex(r, c) < result.elements_.size());
-            result.At(r, c) += At(r, i) * rhs.At(i, c);
-          }
-        }
-      }
+      MultiplyInto(View(), rhs.View(), result.View());
       return result;
     };
 
@@ -84,25 +143,21 @@ class Matrix {
       return elements_ == rhs.elements_;
     }
 
+    /* Computes the star using a tiled version of Floyd-Warshall (see
+     * TiledFloydWarshall). */
     Matrix FloydWarshall() const {
-      assert(columns_ == rows_);
-      Matrix result = *this;
-      for (std::size_t k = 0; k < rows_; ++k) {
-        for (std::size_t i = 0; i < rows_; ++i) {
-          for (std::size_t j = 0; j < rows_; ++j) {
-            result.At(i, j) +=
-              result.At(i, k) * result.At(k, k).star() * result.At(k, j);
-          }
-        }
-      }
-      /* Add element 1, i.e., Floyd-Warshall will give us A+ matrix, so
-       *   1 + A+ = A*
-       * Reusing one() and operator+ would be much slower (additional
-       * allocations and unnecessary traersals). */
-      for (std::size_t i = 0; i < rows_; ++i) {
-        result.At(i, i) += SR::one();
-      }
-      return result;
+      return TiledFloydWarshall(nullptr, kFloydWarshallTile);
+    }
+
+    /* Same as above, but with the given size of the tiles. */
+    Matrix FloydWarshall(std::size_t tile_size) const {
+      return TiledFloydWarshall(nullptr, tile_size);
+    }
+
+    /* Same as above, but the tiles of every phase are processed in parallel
+     * using the given pool. */
+    Matrix FloydWarshall(ThreadPool &pool, std::size_t tile_size) const {
+      return TiledFloydWarshall(&pool, tile_size);
     }
 
     Matrix star2() const {
@@ -110,9 +165,80 @@ class Matrix {
       return FloydWarshall();
     }
 
+    Matrix star2(std::size_t tile_size) const {
+      assert(columns_ == rows_);
+      return FloydWarshall(tile_size);
+    }
+
+    Matrix star2(ThreadPool &pool, std::size_t tile_size) const {
+      assert(columns_ == rows_);
+      return FloydWarshall(pool, tile_size);
+    }
+
+    /* Computes the star with only two allocations: one for the result and
+     * one for the workspace shared by all the recursive calls. */
     Matrix star() const {
       assert(columns_ == rows_);
-      return recursive_star(*this);
+      Matrix result{rows_, columns_, SR::null()};
+      std::vector<SR> workspace(StarWorkspaceSize(rows_), SR::null());
+      recursive_star(View(), result.View(), workspace.data());
+      return result;
+    }
+
+    /* Same as star(), but the independent blocks are computed in parallel
+     * using the given pool.  Blocks of size at most serial_size are computed
+     * by the serial version.  Note that this requires the operations of the
+     * semiring to be thread-safe. */
+    Matrix star(ThreadPool &pool, std::size_t serial_size) const {
+      assert(columns_ == rows_);
+      Matrix result{rows_, columns_, SR::null()};
+      std::vector<SR> workspace(
+          ParallelStarWorkspaceSize(rows_, serial_size), SR::null());
+      parallel_recursive_star(pool, serial_size, View(), result.View(),
+                              workspace.data());
+      return result;
+    }
+
+    /* Computes star() * rhs without computing the star.  Every column x of
+     * the result is the least solution of x = A x + b (for the corresponding
+     * column b of rhs), which we get by Gaussian elimination: for every k we
+     * express
+     *   x_k = a_kk* (sum_{j > k} a_kj x_j + b_k)
+     * and substitute it into the equations below, then we compute the x_k
+     * backwards.  This needs only O(n^2) products for every column of rhs
+     * (after O(n^3) for the elimination) and never touches the lower triangle
+     * again.  Semirings that can do better (e.g., FloatSemiring with a linear
+     * solve) specialize this. */
+    Matrix StarSolve(const Matrix &rhs) const {
+      assert(columns_ == rows_ && rows_ == rhs.rows_);
+      Matrix a = *this;
+      Matrix x = rhs;
+      for (std::size_t k = 0; k < rows_; ++k) {
+        SR pivot_star = a.At(k, k).star();
+        for (std::size_t j = k + 1; j < columns_; ++j) {
+          a.At(k, j) = pivot_star * a.At(k, j);
+        }
+        for (std::size_t c = 0; c < x.columns_; ++c) {
+          x.At(k, c) = pivot_star * x.At(k, c);
+        }
+        for (std::size_t i = k + 1; i < rows_; ++i) {
+          const SR a_ik = a.At(i, k);
+          for (std::size_t j = k + 1; j < columns_; ++j) {
+            AddMul(a.At(i, j), a_ik, a.At(k, j));
+          }
+          for (std::size_t c = 0; c < x.columns_; ++c) {
+            AddMul(x.At(i, c), a_ik, x.At(k, c));
+          }
+        }
+      }
+      for (std::size_t k = rows_; k-- > 0;) {
+        for (std::size_t j = k + 1; j < columns_; ++j) {
+          for (std::size_t c = 0; c < x.columns_; ++c) {
+            AddMul(x.At(k, c), a.At(k, j), x.At(j, c));
+          }
+        }
+      }
+      return x;
     }
 
     std::size_t getRows() const {
@@ -127,6 +253,14 @@ class Matrix {
       return elements_;
     };
 
+    MatrixView<SR> View() {
+      return MatrixView<SR>{elements_.data(), rows_, columns_};
+    }
+
+    MatrixView<const SR> View() const {
+      return MatrixView<const SR>{elements_.data(), rows_, columns_};
+    }
+
     std::string string() const {
       std::stringstream ss;
       for (std::size_t r = 0; r < rows_; ++r) {
@@ -156,6 +290,9 @@ class Matrix {
     }
 
   private:
+    /* Size of the tiles used by FloydWarshall(). */
+    static const std::size_t kFloydWarshallTile = 64;
+
     std::size_t rows_;
     std::size_t columns_;
     std::vector<SR> elements_;
@@ -164,76 +301,372 @@ class Matrix {
       return columns_ * rows_ == elements_.size();
     }
 
-    // this is a naive implementation which creates lots of matrices
-    // maybe we can work directly on the elements_ (but then multiplication etc. are harder)
-    static Matrix recursive_star(Matrix matrix) {
-      assert(matrix.rows_ == matrix.columns_);
-      if (matrix.rows_ == 1) {
+    static std::size_t StarSplit(std::size_t size) {
+      // peel mode if n%2 != 0, split in middle otherwise
+      return size % 2 == 0 ? size / 2 : size - 1;
+    }
+
+    /* Number of elements of scratch space that recursive_star needs for a
+     * matrix of the given size (including all of its recursive calls). */
+    static std::size_t StarWorkspaceSize(std::size_t size) {
+      if (size <= 1) {
+        return 0;
+      }
+      std::size_t split = StarSplit(size);
+      std::size_t rest = size - split;
+      return split * split + rest * rest +
+        std::max(split * rest + split * split + StarWorkspaceSize(split),
+                 rest * split + rest * rest + StarWorkspaceSize(rest));
+    }
+
+    /* Same as StarWorkspaceSize, but for parallel_recursive_star.  The two
+     * blocks that are processed in parallel need disjoint workspaces, so
+     * instead of reusing the space, we need the sum of both. */
+    static std::size_t ParallelStarWorkspaceSize(std::size_t size,
+                                                 std::size_t serial_size) {
+      if (size <= serial_size || size <= 1) {
+        return StarWorkspaceSize(size);
+      }
+      std::size_t split = StarSplit(size);
+      std::size_t rest = size - split;
+      return split * split + rest * rest +
+        split * rest + split * split +
+          ParallelStarWorkspaceSize(split, serial_size) +
+        rest * split + rest * rest +
+          ParallelStarWorkspaceSize(rest, serial_size);
+    }
+
+    /* result = lhs * rhs */
+    static void MultiplyInto(const MatrixView<const SR> &lhs,
+                             const MatrixView<const SR> &rhs,
+                             const MatrixView<SR> &result) {
+      assert(lhs.getColumns() == rhs.getRows());
+      assert(result.getRows() == lhs.getRows() &&
+             result.getColumns() == rhs.getColumns());
+      for (std::size_t r = 0; r < lhs.getRows(); ++r) {
+        for (std::size_t c = 0; c < rhs.getColumns(); ++c) {
+          SR &elem = result.At(r, c);
+          elem = SR::null();
+          for (std::size_t i = 0; i < lhs.getColumns(); ++i) {
+            AddMul(elem, lhs.At(r, i), rhs.At(i, c));
+          }
+        }
+      }
+    }
+
+    /* result = result + lhs * rhs */
+    static void MultiplyAddInto(const MatrixView<const SR> &lhs,
+                                const MatrixView<const SR> &rhs,
+                                const MatrixView<SR> &result) {
+      assert(lhs.getColumns() == rhs.getRows());
+      assert(result.getRows() == lhs.getRows() &&
+             result.getColumns() == rhs.getColumns());
+      for (std::size_t r = 0; r < lhs.getRows(); ++r) {
+        for (std::size_t c = 0; c < rhs.getColumns(); ++c) {
+          SR &elem = result.At(r, c);
+          for (std::size_t i = 0; i < lhs.getColumns(); ++i) {
+            AddMul(elem, lhs.At(r, i), rhs.At(i, c));
+          }
+        }
+      }
+    }
+
+    static void CopyInto(const MatrixView<const SR> &from,
+                         const MatrixView<SR> &to) {
+      assert(from.getRows() == to.getRows() &&
+             from.getColumns() == to.getColumns());
+      for (std::size_t r = 0; r < from.getRows(); ++r) {
+        for (std::size_t c = 0; c < from.getColumns(); ++c) {
+          to.At(r, c) = from.At(r, c);
+        }
+      }
+    }
+
+    /* Replaces the (square) block with its star using Gauss-Jordan
+     * elimination, i.e., Floyd-Warshall where the star of the pivot is
+     * computed only once in every step:
+     *   a_ij = a_ij + a_ik a_kk* a_kj  for i, j != k
+     *   a_ik = a_ik a_kk*,  a_kj = a_kk* a_kj,  a_kk = a_kk*
+     * (all with the values from before the step). */
+    static void GaussJordanStar(const MatrixView<SR> &block) {
+      assert(block.getRows() == block.getColumns());
+      std::size_t size = block.getRows();
+      for (std::size_t k = 0; k < size; ++k) {
+        SR pivot_star = block.At(k, k).star();
+        for (std::size_t i = 0; i < size; ++i) {
+          if (i == k) {
+            continue;
+          }
+          SR factor = block.At(i, k) * pivot_star;
+          for (std::size_t j = 0; j < size; ++j) {
+            if (j != k) {
+              AddMul(block.At(i, j), factor, block.At(k, j));
+            }
+          }
+          block.At(i, k) = factor;
+        }
+        for (std::size_t j = 0; j < size; ++j) {
+          if (j != k) {
+            block.At(k, j) = pivot_star * block.At(k, j);
+          }
+        }
+        block.At(k, k) = pivot_star;
+      }
+    }
+
+    /* Runs f(i) for every i in [begin, end), in parallel if we have a pool. */
+    template <typename F>
+    static void ForEach(ThreadPool *pool, std::size_t begin, std::size_t end,
+                        const F &f) {
+      if (pool) {
+        pool->ParallelFor(begin, end, f);
+      } else {
+        for (std::size_t i = begin; i < end; ++i) {
+          f(i);
+        }
+      }
+    }
+
+    /* Blocked Floyd-Warshall (in the style of Venkataraman et al.), which is
+     * the same as GaussJordanStar, but on tiles instead of single elements.
+     * For every pivot tile K we:
+     *   1. replace A_KK with its star (using GaussJordanStar),
+     *   2. compute A_KJ = A_KK* A_KJ for the tiles of the pivot row,
+     *   3. compute A_IJ = A_IJ + A_IK A_KJ for all the remaining tiles (A_IK
+     *      is still the old value, so this adds A_IK A_KK* A_KJ),
+     *   4. compute A_IK = A_IK A_KK* for the tiles of the pivot column.
+     * The tiles of every phase are independent, so with a pool they are
+     * processed in parallel.  The products of phases 2 and 4 go through a
+     * scratch tile (one per tile of the pivot row/column, allocated once for
+     * all the pivots), since they would otherwise overwrite their operand. */
+    Matrix TiledFloydWarshall(ThreadPool *pool, std::size_t tile_size) const {
+      assert(columns_ == rows_ && 0 < tile_size);
+      Matrix result = *this;
+      MatrixView<SR> view = result.View();
+      std::size_t size = rows_;
+      std::size_t tiles = (size + tile_size - 1) / tile_size;
+      auto tile_start = [tile_size](std::size_t t) { return t * tile_size; };
+      auto tile_length = [tile_size, size](std::size_t t) {
+        return std::min(tile_size, size - t * tile_size);
+      };
+      std::vector<SR> scratch(tiles * tile_size * tile_size, SR::null());
+      auto scratch_tile = [&](std::size_t t, std::size_t r, std::size_t c) {
+        return MatrixView<SR>{scratch.data() + t * tile_size * tile_size, r, c};
+      };
+
+      for (std::size_t k = 0; k < tiles; ++k) {
+        std::size_t k_start = tile_start(k);
+        std::size_t k_length = tile_length(k);
+        MatrixView<SR> pivot = view.Block(k_start, k_start, k_length, k_length);
+
+        GaussJordanStar(pivot);
+
+        ForEach(pool, 0, tiles, [&](std::size_t j) {
+          if (j == k) {
+            return;
+          }
+          MatrixView<SR> tile =
+            view.Block(k_start, tile_start(j), k_length, tile_length(j));
+          MatrixView<SR> product = scratch_tile(j, k_length, tile_length(j));
+          MultiplyInto(pivot, tile, product);
+          CopyInto(product, tile);
+        });
+
+        ForEach(pool, 0, tiles * tiles, [&](std::size_t index) {
+          std::size_t i = index / tiles;
+          std::size_t j = index % tiles;
+          if (i == k || j == k) {
+            return;
+          }
+          MultiplyAddInto(
+            view.Block(tile_start(i), k_start, tile_length(i), k_length),
+            view.Block(k_start, tile_start(j), k_length, tile_length(j)),
+            view.Block(tile_start(i), tile_start(j), tile_length(i),
+                       tile_length(j)));
+        });
+
+        ForEach(pool, 0, tiles, [&](std::size_t i) {
+          if (i == k) {
+            return;
+          }
+          MatrixView<SR> tile =
+            view.Block(tile_start(i), k_start, tile_length(i), k_length);
+          MatrixView<SR> product = scratch_tile(i, tile_length(i), k_length);
+          MultiplyInto(tile, pivot, product);
+          CopyInto(product, tile);
+        });
+      }
+      return result;
+    }
+
+    /* result = lhs + result */
+    static void AddInto(const MatrixView<const SR> &lhs,
+                        const MatrixView<SR> &result) {
+      assert(lhs.getRows() == result.getRows() &&
+             lhs.getColumns() == result.getColumns());
+      for (std::size_t r = 0; r < lhs.getRows(); ++r) {
+        for (std::size_t c = 0; c < lhs.getColumns(); ++c) {
+          result.At(r, c) = lhs.At(r, c) + result.At(r, c);
+        }
+      }
+    }
+
+    /* Writes the star of matrix into result.  All the intermediate blocks live
+     * in the workspace (see StarWorkspaceSize), which is used like a stack:
+     * every recursive call gets the part that is not used by its caller.  So
+     * no matter how deep the recursion goes, we never allocate anything. */
+    static void recursive_star(const MatrixView<const SR> &matrix,
+                               const MatrixView<SR> &result, SR *workspace) {
+      assert(matrix.getRows() == matrix.getColumns());
+      assert(result.getRows() == matrix.getRows() &&
+             result.getColumns() == matrix.getColumns());
+      std::size_t size = matrix.getRows();
+      if (size == 1) {
         // just a scalar in a matrix
-        matrix.elements_[0] = matrix.elements_[0].star(); // use semiring-star
-        return matrix;
+        result.At(0, 0) = matrix.At(0, 0).star(); // use semiring-star
+        return;
+      }
+      std::size_t split = StarSplit(size);
+      std::size_t rest = size - split;
+
+      auto a_11 = matrix.Block(0, 0, split, split);
+      auto a_12 = matrix.Block(0, split, split, rest);
+      auto a_21 = matrix.Block(split, 0, rest, split);
+      auto a_22 = matrix.Block(split, split, rest, rest);
+
+      auto A_11 = result.Block(0, 0, split, split);
+      auto A_12 = result.Block(0, split, split, rest);
+      auto A_21 = result.Block(split, 0, rest, split);
+      auto A_22 = result.Block(split, split, rest, rest);
+
+      MatrixView<SR> as_11{workspace, split, split};
+      workspace += split * split;
+      MatrixView<SR> as_22{workspace, rest, rest};
+      workspace += rest * rest;
+
+      recursive_star(a_11, as_11, workspace);
+      recursive_star(a_22, as_22, workspace);
+
+      /* A_11 = (a_11 + a_12 * as_22 * a_21)* */
+      {
+        MatrixView<SR> tmp{workspace, split, rest};
+        MatrixView<SR> sum{workspace + split * rest, split, split};
+        MultiplyInto(a_12, as_22, tmp);
+        MultiplyInto(tmp, a_21, sum);
+        AddInto(a_11, sum);
+        recursive_star(sum, A_11, workspace + split * rest + split * split);
+      }
+
+      /* A_22 = (a_22 + a_21 * as_11 * a_12)* */
+      {
+        MatrixView<SR> tmp{workspace, rest, split};
+        MatrixView<SR> sum{workspace + rest * split, rest, rest};
+        MultiplyInto(a_21, as_11, tmp);
+        MultiplyInto(tmp, a_12, sum);
+        AddInto(a_22, sum);
+        recursive_star(sum, A_22, workspace + rest * split + rest * rest);
+      }
+
+      /* A_12 = as_11 * a_12 * A_22 */
+      {
+        MatrixView<SR> tmp{workspace, split, rest};
+        MultiplyInto(as_11, a_12, tmp);
+        MultiplyInto(tmp, A_22, A_12);
+      }
+
+      /* A_21 = as_22 * a_21 * A_11 */
+      {
+        MatrixView<SR> tmp{workspace, rest, split};
+        MultiplyInto(as_22, a_21, tmp);
+        MultiplyInto(tmp, A_11, A_21);
       }
-      // peel mode if n%2 != 0, split in middle otherwise
-      std::size_t split = matrix.rows_%2 == 0 ? matrix.columns_/2 : matrix.columns_-1;
-
-      // TODO: this might be slightly inefficient
-      Matrix a_11 = matrix.submatrix(0,split,0,split);
-      Matrix a_12 = matrix.submatrix(split,matrix.columns_,0,split);
-      Matrix a_21 = matrix.submatrix(0,split,split,matrix.rows_);
-      Matrix a_22 = matrix.submatrix(split,matrix.columns_,split,matrix.rows_);
-      Matrix as_11 = recursive_star(a_11);
-      Matrix as_22 = recursive_star(a_22);
-      Matrix A_11 = recursive_star(a_11 + a_12 * as_22 * a_21);
-      Matrix A_22 = recursive_star(a_22 + a_21 * as_11 * a_12);
-      Matrix A_12 = as_11 * a_12 * A_22;
-      Matrix A_21 = as_22 * a_21 * A_11;
       // FIXME: should be:
       // Matrix A_12 = as_11 * a_12 * as_22;
       // Matrix A_21 = as_22 * a_21 * as_11;
-      return block_matrix(A_11,A_12,A_21,A_22);
-    }
-
-    static Matrix block_matrix(const Matrix &a_11, const Matrix &a_12,
-                               const Matrix &a_21, const Matrix &a_22) {
-      std::vector<SR> ret;
-      assert(a_11.rows_ == a_12.rows_ && a_21.rows_ == a_22.rows_);
-      assert(a_11.columns_ == a_21.columns_ && a_12.columns_ == a_22.columns_);
-      for (int r=0; r < a_11.rows_; r++) {
-        ret.insert(     ret.end(),
-            a_11.elements_.begin()+(r*a_11.columns_),
-            a_11.elements_.begin()+((r+1)*a_11.columns_));
-        ret.insert(     ret.end(),
-            a_12.elements_.begin()+(r*a_12.columns_),
-            a_12.elements_.begin()+((r+1)*a_12.columns_));
-      }
-      for (int r=0; r < a_21.rows_; r++) {
-        ret.insert(     ret.end(),
-            a_21.elements_.begin()+(r*a_21.columns_),
-            a_21.elements_.begin()+((r+1)*a_21.columns_));
-        ret.insert(     ret.end(),
-            a_22.elements_.begin()+(r*a_22.columns_),
-            a_22.elements_.begin()+((r+1)*a_22.columns_));
-      }
-      return Matrix{a_11.rows_+a_21.rows_,
-                    std::move(ret)};
-    }
-
-    // get the submatrix starting from colum cs,...
-    Matrix submatrix(std::size_t cs, std::size_t ce,
-                     std::size_t rs, std::size_t re) const {
-      assert(cs >= 0 && cs < columns_ && ce <= columns_ && ce > cs);
-      assert(rs >= 0 && rs < rows_ && re <= rows_ && re > rs);
-      // std::size_t nc = ce-cs; // new column count
-      std::size_t nr = re-rs; // new row count
-      std::vector<SR> ret;
-      for (std::size_t r = rs; r < re; r++) {
-        for (std::size_t c = cs; c < ce; c++) {
-          // copy the needed values from elements_ to ret
-          //ret[nc*(r-rs)+cs-c] = elements_[columns_*r+c];
-          ret.push_back(elements_[columns_*r+c]);
-        }
+    }
+
+    /* Computes exactly the same as recursive_star, but the pairs of blocks
+     * that do not depend on each other (as_11 and as_22, A_11 and A_22, A_12
+     * and A_21) are computed in parallel.  The first of each pair uses the
+     * first region of the workspace, the second one the second region. */
+    static void parallel_recursive_star(ThreadPool &pool,
+                                        std::size_t serial_size,
+                                        const MatrixView<const SR> &matrix,
+                                        const MatrixView<SR> &result,
+                                        SR *workspace) {
+      assert(matrix.getRows() == matrix.getColumns());
+      assert(result.getRows() == matrix.getRows() &&
+             result.getColumns() == matrix.getColumns());
+      std::size_t size = matrix.getRows();
+      if (size <= serial_size || size <= 1) {
+        recursive_star(matrix, result, workspace);
+        return;
       }
-      return Matrix{nr, std::move(ret)};
+      std::size_t split = StarSplit(size);
+      std::size_t rest = size - split;
+
+      auto a_11 = matrix.Block(0, 0, split, split);
+      auto a_12 = matrix.Block(0, split, split, rest);
+      auto a_21 = matrix.Block(split, 0, rest, split);
+      auto a_22 = matrix.Block(split, split, rest, rest);
+
+      auto A_11 = result.Block(0, 0, split, split);
+      auto A_12 = result.Block(0, split, split, rest);
+      auto A_21 = result.Block(split, 0, rest, split);
+      auto A_22 = result.Block(split, split, rest, rest);
+
+      MatrixView<SR> as_11{workspace, split, split};
+      workspace += split * split;
+      MatrixView<SR> as_22{workspace, rest, rest};
+      workspace += rest * rest;
+
+      SR *workspace_1 = workspace;
+      SR *workspace_2 = workspace_1 + split * rest + split * split +
+                        ParallelStarWorkspaceSize(split, serial_size);
+
+      pool.Invoke(
+        [&]() {
+          parallel_recursive_star(pool, serial_size, a_11, as_11, workspace_1);
+        },
+        [&]() {
+          parallel_recursive_star(pool, serial_size, a_22, as_22, workspace_2);
+        });
+
+      pool.Invoke(
+        [&]() {
+          /* A_11 = (a_11 + a_12 * as_22 * a_21)* */
+          MatrixView<SR> tmp{workspace_1, split, rest};
+          MatrixView<SR> sum{workspace_1 + split * rest, split, split};
+          MultiplyInto(a_12, as_22, tmp);
+          MultiplyInto(tmp, a_21, sum);
+          AddInto(a_11, sum);
+          parallel_recursive_star(pool, serial_size, sum, A_11,
+                                  workspace_1 + split * rest + split * split);
+        },
+        [&]() {
+          /* A_22 = (a_22 + a_21 * as_11 * a_12)* */
+          MatrixView<SR> tmp{workspace_2, rest, split};
+          MatrixView<SR> sum{workspace_2 + rest * split, rest, rest};
+          MultiplyInto(a_21, as_11, tmp);
+          MultiplyInto(tmp, a_12, sum);
+          AddInto(a_22, sum);
+          parallel_recursive_star(pool, serial_size, sum, A_22,
+                                  workspace_2 + rest * split + rest * rest);
+        });
+
+      pool.Invoke(
+        [&]() {
+          /* A_12 = as_11 * a_12 * A_22 */
+          MatrixView<SR> tmp{workspace_1, split, rest};
+          MultiplyInto(as_11, a_12, tmp);
+          MultiplyInto(tmp, A_22, A_12);
+        },
+        [&]() {
+          /* A_21 = as_22 * a_21 * A_11 */
+          MatrixView<SR> tmp{workspace_2, rest, split};
+          MultiplyInto(as_22, a_21, tmp);
+          MultiplyInto(tmp, A_11, A_21);
+        });
     }
 
 
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <cstdint>
 #include <iosfwd>
+#include <unordered_map>
 
 #include "free-semiring.h"
+#include "hash.h"
 #include "var_degree_map.h"
 
 
@@ -137,14 +140,30 @@ class Monomial {
 
     /* Convert this monomial to an element of the free semiring. */
     FreeSemiring make_free() const {
-      FreeSemiring result = FreeSemiring::one();
+      std::vector<FreeSemiring> factors;
       for (auto var_degree : variables_) {
         FreeSemiring tmp{var_degree.first};
         for (Degree i = 0; i < var_degree.second; ++i) {
-          result = result * tmp;
+          factors.push_back(tmp);
         }
       }
-      return result;
+      return FreeSemiring::ProductOf(factors);
+    }
+
+    /* Combines the variables (in the order of the monomial) and their
+     * degrees into seed.  The variables in positions are identified by their
+     * position, all the others by their name. */
+    void HashStructure(std::size_t &seed,
+        const std::unordered_map<VarPtr, std::uint32_t> &positions) const {
+      for (auto var_degree : variables_) {
+        auto position_iter = positions.find(var_degree.first);
+        if (position_iter != positions.end()) {
+          HashCombine(seed, position_iter->second);
+        } else {
+          HashCombine(seed, var_degree.first->string());
+        }
+        HashCombine(seed, var_degree.second);
+      }
     }
 
     bool operator<(const Monomial &rhs) const {
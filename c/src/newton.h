@@ -3,152 +3,73 @@
 
 #include <cstdint>
 #include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
 
 #include "free-semiring.h"
+#include "free-tape.h"
 #include "matrix.h"
 #include "polynomial.h"
+#include "polynomial_plan.h"
+#include "star_cache.h"
+#include "thread_pool.h"
 #include "var_degree_map.h"
 
-/* This defines the generator that is able to create all possible combinations
- * of integers such they are smaller than max and their sum is between min_sum
- * and max_sum. */
-class Generator {
-  public:
-    Generator(const std::vector<Degree> &max, Degree min_sum, Degree max_sum)
-        : vector_(max.size()), max_(max), current_sum_(0),
-          min_sum_(min_sum), max_sum_(max_sum) {
-      assert(0 < vector_.size());
-      assert(min_sum <= max_sum);
-      assert(current_sum_ == CurrentSum());
-      assert(min_sum <= std::accumulate(max_.begin(), max_.end(),
-                                        static_cast<Degree>(0)));
-    }
-
-    bool NextCombination() {
-      bool added = false;
-      bool valid = false;
-
-      do {
-        if (current_sum_ < min_sum_) {
-          added = JumpMin();
-        } else if (max_sum_ < current_sum_) {
-          added = JumpMax();
-        } else {
-          added = AddOne();
-        }
-        assert(current_sum_ == CurrentSum() && BelowEqualMax());
-        valid = min_sum_ <= current_sum_ && current_sum_ <= max_sum_;
-        if (added && valid) {
-          return true;
-        }
-      } while (added && !valid);
-
-      return false;
-    }
-
-    const std::vector<std::uint16_t>& GetVectorRef() const {
-      assert(current_sum_ == CurrentSum());
-      assert(BelowEqualMax());
-      assert(min_sum_ <= current_sum_ && current_sum_ <= max_sum_);
-
-      return vector_;
-    }
+/* How Newton computes J* * delta in every step:
+ *  - kFull: computes the star of the Jacobian (in the free semiring) once and
+ *    evaluates it in every step,
+ *  - kSolve: computes only J* * d (in the free semiring, using
+ *    SparseMatrix::StarSolve, in parallel if we have a pool) for a vector d
+ *    of fresh variables once and evaluates it with d = delta in every step,
+ *  - kNumeric: evaluates the Jacobian (compiled once into a PolynomialPlan)
+ *    in every step and computes J* * delta using Matrix::StarSolve (e.g., a
+ *    linear solve for FloatSemiring). */
+enum class StarMode { kFull, kSolve, kNumeric };
 
+template <typename SR>
+class Newton {
   private:
-    std::uint16_t CurrentSum() const {
-      return std::accumulate(vector_.begin(), vector_.end(), 0);
-    }
-
-    bool BelowEqualMax() const {
-      for (std::size_t i = 0; i < vector_.size(); ++i) {
-        if (vector_[i] > max_[i]) {
-          return false;
-        }
-      }
-      return true;
-    }
-
-
-    /* Add 1 to the current vector, wrap-around if some value is > max_.
-     * Returns false if we cannot add 1 (i.e., the last element would
-     * overflow). */
-    bool AddOne(std::size_t start_index = 0) {
-      for (auto i = start_index; i < vector_.size(); ++i) {
-        if (max_[i] == 0) {
-          continue;
-        }
-
-        auto &integer = vector_[i];
-        ++integer;
-        ++current_sum_;
-        if (integer <= max_[i]) {
-          return true;
-        }
-        current_sum_ -= integer;
-        integer = 0;
-      }
-      return false;
-    }
-
-    /* Create the smallest vector that satisfies the min_sum_ requirement.  This
-     * means adding (without overflowing) min_sum_ - current_sum_. */
-    bool JumpMin() {
-      assert(min_sum_ > current_sum_);
-      auto remaining = min_sum_ - current_sum_;
-      for (std::size_t i = 0; i < vector_.size(); ++i) { // auto &integer : vector_) {
-        if (max_[i] == 0) {
-          continue;
-        }
-        auto &integer = vector_[i];
-        auto integer_max = max_[i];
-        auto to_add = integer + remaining > integer_max ?
-                      integer_max - integer : remaining;
-        integer += to_add;
-        current_sum_ += to_add;
-        remaining -= to_add;
-        if (remaining == 0) {
-          return true;
-        }
-      }
-      /* Added as much as we could, but still not enough... */
-      return false;
-    }
-
-    /* Create the smallest vector that satisfies the max_sum_ requirement.  This
-     * means that we add (with overflow) enough to get below max. */
-    bool JumpMax() {
-      assert(max_sum_ < current_sum_);
-      for (std::size_t i = 0; i < vector_.size(); ++i) {
-        if (max_[i] == 0) {
-          continue;
-        }
-
-        auto &integer = vector_[i];
-
-        /* If integer == 0 then this is harmless. */
-        current_sum_ -= integer;
-        integer = 0;
-
-        /* We're wrapping around integer and should add 1 to the next position.
-         * Check if that is enough or whether we should try to wrap-around the
-         * next position too.  This can happen when integer == 1. */
-        if (current_sum_ - integer + 1 <= max_sum_) {
-          return AddOne(i + 1);
-        }
+    /* If set, the star of the Jacobian is computed in parallel (blocks of size
+     * at most serial_star_size_ are computed serially) and so is its
+     * evaluation in every step. */
+    ThreadPool *pool_;
+    std::size_t serial_star_size_;
+
+    /* Jacobians with a smaller fraction of non-null entries are starred as a
+     * SparseMatrix. */
+    double sparse_density_;
+
+    StarMode star_mode_;
+
+    /* If not empty, the directory in which the compiled stars of the
+     * Jacobians are cached (see StarCache). */
+    std::string star_cache_;
+
+    /* When the updates of a variable are small enough to freeze it (see
+     * [Note: Freezing]). */
+    Tolerance tolerance_;
+
+    /* The number of iterations done by the last solve_fixpoint. */
+    int iterations_;
+
+    /* Converts the Jacobian to the free semiring and computes its star.  If
+     * the Jacobian is sparse enough, we do that on the sparse representation
+     * (the result is exactly the same, but we never touch the null
+     * entries). */
+    Matrix<FreeSemiring> free_jacobian_star(
+        const SparseMatrix< Polynomial<SR> > &J,
+        SemiringMap<SR, VarPtr> *valuation) {
+      double size = J.getRows();
+      if (J.GetNonNulls() < sparse_density_ * size * size) {
+        return Polynomial<SR>::make_free(J, valuation)
+                 .star(sparse_density_, pool_, serial_star_size_).ToDense();
       }
-      return false;
+      Matrix<FreeSemiring> J_free =
+        Polynomial<SR>::make_free(J.ToDense(), valuation);
+      return pool_ ? J_free.star(*pool_, serial_star_size_) : J_free.star();
     }
 
-    std::vector<std::uint16_t> vector_;
-    const std::vector<Degree> &max_;
-    Degree current_sum_;
-    Degree min_sum_;
-    Degree max_sum_;
-};
-
-template <typename SR>
-class Newton {
-  private:
     Matrix<Polynomial<SR> > compute_symbolic_delta(
         const std::vector<VarPtr> &v,
         const std::vector<VarPtr> &v_upd,
@@ -159,47 +80,11 @@ class Newton {
       assert(num_variables == v_upd.size() &&
              num_variables == poly_vars.size());
 
+      /* We want all the derivatives of at least second order, see
+       * Polynomial::HigherOrderTerms. */
       std::vector<Polynomial<SR> > delta;
-
-      std::vector<Degree> current_max_degree(num_variables);
-
       for (std::size_t i = 0; i < num_variables; ++i) {
-        Polynomial<SR> delta_i = Polynomial<SR>::null();
-        Polynomial<SR> f = F.at(i);
-        Degree poly_max_degree = f.get_degree();
-
-        for (std::size_t j = 0; j < num_variables; ++j) {
-          current_max_degree[j] = f.GetMaxDegreeOf(poly_vars[j]);
-        }
-
-        /* We want to calculate all possible derivatives of at least second
-         * order, but lower or equal to the degree of polynomial. */
-        Generator generator{current_max_degree, 2, poly_max_degree};
-
-        while (generator.NextCombination()) {
-          std::vector<VarPtr> dx;
-          Polynomial<SR> prod{SR::one()};
-
-          for (std::size_t index = 0; index < num_variables; ++index) {
-            for (int j = 0; j < generator.GetVectorRef()[index]; ++j) {
-              dx.push_back(poly_vars[index]);
-              prod *= v_upd[index];
-            }
-          }
-
-          // eval f.derivative(dx) at v
-          std::map<VarPtr, VarPtr> values;
-          for (std::size_t index = 0; index < v.size(); ++index) {
-            // FIXME: GCC 4.7 is missing emplace
-            // values.emplace(poly_vars[index], v[index]);
-            values.insert(std::make_pair(poly_vars[index], v[index]));
-          }
-          Polynomial<SR> f_eval = f.derivative(dx).subst(values);
-
-          delta_i = delta_i + f_eval * prod;
-        }
-
-        delta.emplace_back(std::move(delta_i));
+        delta.emplace_back(F.at(i).HigherOrderTerms(poly_vars, v, v_upd, 2));
       }
 
       return Matrix<Polynomial<SR> >(delta.size(), delta);
@@ -217,30 +102,183 @@ class Newton {
       return ret;
     }
 
+    /* For idempotent semirings many variables stabilize early, so we only
+     * recompute the parts of the tape that depend on the changed ones.  With a
+     * pool the tape is evaluated in parallel, see [Note: Wavefront]. */
+    Matrix<SR> eval_tape(FoldedTape<SR> &tape,
+        const std::unordered_map<VarPtr, SR> &valuation) {
+      return SR::is_idempotent ? tape.Update(valuation, pool_)
+                               : tape.Eval(valuation, pool_);
+    }
+
+    /* Whether variable i has converged in the last step, i.e., its value
+     * stays the same for idempotent semirings and otherwise its update is
+     * negligible. */
+    bool is_stable(const Matrix<SR> &v, const Matrix<SR> &v_upd,
+                   std::size_t i) const {
+      if (SR::is_idempotent) {
+        return v_upd.At(i, 0) == v.At(i, 0);
+      }
+      return IsNegligible(v_upd.At(i, 0), v.At(i, 0) + v_upd.At(i, 0),
+                          tolerance_);
+    }
+
+    /* Freezes the variables that are stable and depend only on frozen (or
+     * stable) ones, see [Note: Freezing].  dependents[j] are the variables
+     * whose polynomials contain variable j.  Returns whether any variable is
+     * still live. */
+    bool freeze(const std::vector< std::vector<std::size_t> > &dependents,
+                const Matrix<SR> &v, const Matrix<SR> &v_upd,
+                std::vector<std::uint8_t> *frozen) const {
+      std::vector<std::uint8_t> &is_frozen = *frozen;
+      std::vector<std::uint8_t> candidate(is_frozen.size(), 0);
+      std::vector<std::size_t> live;
+      for (std::size_t i = 0; i < is_frozen.size(); ++i) {
+        if (is_frozen[i]) {
+          continue;
+        }
+        if (is_stable(v, v_upd, i)) {
+          candidate[i] = 1;
+        } else {
+          live.push_back(i);
+        }
+      }
+      /* Everything that (transitively) depends on a live variable stays
+       * live. */
+      while (!live.empty()) {
+        std::size_t j = live.back();
+        live.pop_back();
+        for (auto i : dependents[j]) {
+          if (candidate[i]) {
+            candidate[i] = 0;
+            live.push_back(i);
+          }
+        }
+      }
+      bool any_live = false;
+      for (std::size_t i = 0; i < is_frozen.size(); ++i) {
+        is_frozen[i] |= candidate[i];
+        any_live |= !is_frozen[i];
+      }
+      return any_live;
+    }
+
+    /* Sets the given variables to the corresponding elements of the column
+     * vector values. */
+    static void set_valuation(const std::vector<VarPtr> &vars,
+        const Matrix<SR> &values, std::unordered_map<VarPtr, SR> *valuation) {
+      assert(vars.size() == values.getRows());
+      for (std::size_t i = 0; i < vars.size(); ++i) {
+        valuation->erase(vars[i]); // clean the old variables from the map
+        valuation->insert(std::make_pair(vars[i], values.At(i, 0)));
+      }
+    }
+
   public:
+    Newton() : pool_(nullptr), serial_star_size_(0), sparse_density_(kSparseStarDensity),
+               star_mode_(StarMode::kFull), tolerance_{0, 0},
+               iterations_(0) {}
+
+    Newton(ThreadPool *pool, std::size_t serial_star_size,
+           StarMode star_mode = StarMode::kFull,
+           const std::string &star_cache = "",
+           const Tolerance &tolerance = Tolerance{0, 0})
+        : pool_(pool), serial_star_size_(serial_star_size),
+          sparse_density_(kSparseStarDensity), star_mode_(star_mode),
+          star_cache_(star_cache), tolerance_(tolerance), iterations_(0) {}
+
+    /* The number of iterations the last solve_fixpoint actually did (at most
+     * max_iter, fewer if all the variables froze before). */
+    int GetIterations() const { return iterations_; }
+
     // calculate the next newton iterand
+    // (the rows of the frozen variables are not computed and left null)
     Matrix<SR> step(const std::vector<VarPtr> &poly_vars,
-        const Matrix<FreeSemiring> &J_s,
+        FoldedTape<SR> &J_s,
         std::unordered_map<VarPtr, SR> *valuation,
-        const Matrix<SR> &v, const Matrix<SR> &delta) {
-      assert(poly_vars.size() == (unsigned int)v.getRows());
-      int i = 0;
-      for (std::vector<VarPtr>::const_iterator poly_var = poly_vars.begin();
-           poly_var != poly_vars.end(); ++poly_var) {
-        SR sr_elem = v.getElements().at(i++);
-        valuation->erase(*poly_var); // clean the old variables from the map
-        valuation->insert(valuation->begin(),
-            std::pair<VarPtr,SR>(*poly_var,sr_elem));
-      }
-      Matrix<SR> J_s_new = FreeSemiring_eval<SR>(J_s, valuation);
+        const Matrix<SR> &v, const Matrix<SR> &delta,
+        const std::vector<std::uint8_t> &frozen) {
+      set_valuation(poly_vars, v, valuation);
+      J_s.SkipRows(frozen);
+      Matrix<SR> J_s_new = eval_tape(J_s, *valuation);
 
       //std::cout << "Jacobian (evaluated): " << std::endl;
       //std::cout << J_s_new << std::endl;
 
-      Matrix<SR> result = J_s_new * delta;
+      Matrix<SR> result{J_s_new.getRows(), 1, SR::null()};
+      for (std::size_t r = 0; r < J_s_new.getRows(); ++r) {
+        if (frozen[r]) {
+          continue;
+        }
+        for (std::size_t c = 0; c < J_s_new.getColumns(); ++c) {
+          AddMul(result.At(r, 0), J_s_new.At(r, c), delta.At(c, 0));
+        }
+      }
+      return result;
+    }
+
+    /* Calculates the next newton iterand without the symbolic star: evaluates
+     * the Jacobian at v (J_plan computes its non-null entries, which are at the
+     * given positions) and computes J(v)* * delta using StarSolve (which, e.g.,
+     * for FloatSemiring is just a linear solve).  Only the live part of the
+     * system is evaluated and solved: the frozen variables depend only on
+     * frozen ones and their deltas are null, so their rows of J(v)* * delta
+     * are null and the live rows don't need them. */
+    Matrix<SR> numeric_step(const PolynomialPlan<SR> &J_plan,
+        const std::vector< std::pair<std::size_t, std::size_t> > &J_positions,
+        const Matrix<SR> &v, const Matrix<SR> &delta,
+        const std::vector<std::uint8_t> &frozen) {
+      /* The index of every live variable in the reduced system. */
+      std::vector<std::size_t> live_vars;
+      std::vector<std::size_t> live_index(frozen.size(), frozen.size());
+      for (std::size_t i = 0; i < frozen.size(); ++i) {
+        if (!frozen[i]) {
+          live_index[i] = live_vars.size();
+          live_vars.push_back(i);
+        }
+      }
+
+      std::vector<std::uint8_t> skip(J_positions.size(), 0);
+      for (std::size_t i = 0; i < J_positions.size(); ++i) {
+        skip[i] = frozen[J_positions[i].first] || frozen[J_positions[i].second];
+      }
+      Matrix<SR> J_entries = J_plan.Eval(v.getElements(), &skip);
+
+      Matrix<SR> J_value{live_vars.size(), live_vars.size(), SR::null()};
+      for (std::size_t i = 0; i < J_positions.size(); ++i) {
+        if (!skip[i]) {
+          J_value.At(live_index[J_positions[i].first],
+                     live_index[J_positions[i].second]) = J_entries.At(i, 0);
+        }
+      }
+      Matrix<SR> live_delta{live_vars.size(), 1, SR::null()};
+      for (std::size_t i = 0; i < live_vars.size(); ++i) {
+        live_delta.At(i, 0) = delta.At(live_vars[i], 0);
+      }
+      Matrix<SR> live_result = J_value.StarSolve(live_delta);
+
+      Matrix<SR> result{frozen.size(), 1, SR::null()};
+      for (std::size_t i = 0; i < live_vars.size(); ++i) {
+        result.At(live_vars[i], 0) = live_result.At(i, 0);
+      }
       return result;
     }
 
+    /* Calculates the next newton iterand from J_s_d = J* * d (where d are the
+     * delta_vars), i.e., we only have to evaluate it with d = delta (the rows
+     * of the frozen variables are not computed and left null). */
+    Matrix<SR> solve_step(const std::vector<VarPtr> &poly_vars,
+        const std::vector<VarPtr> &delta_vars,
+        FoldedTape<SR> &J_s_d,
+        std::unordered_map<VarPtr, SR> *valuation,
+        const Matrix<SR> &v, const Matrix<SR> &delta,
+        const std::vector<std::uint8_t> &frozen) {
+      set_valuation(poly_vars, v, valuation);
+      set_valuation(delta_vars, delta, valuation);
+      J_s_d.SkipRows(frozen);
+      return eval_tape(J_s_d, *valuation);
+    }
+
     // this is just a wrapper function at the moment
     std::map<VarPtr,SR> solve_fixpoint(
         const std::vector<std::pair<VarPtr, Polynomial<SR>>>& equations,
@@ -266,30 +304,141 @@ class Newton {
       return solution;
     }
 
+    /* [Note: Freezing]
+     *
+     * The value of a variable in the next step depends only on the current
+     * values (and updates) of the variables it (transitively) depends on.
+     * So once a
+     * variable and all of its dependencies are stable (for idempotent
+     * semirings the step did not change their values, otherwise their updates
+     * are negligible, see IsNegligible and tolerance_), the variable is
+     * frozen: it keeps its value (i.e., its update is null from then on) and
+     * we skip its row of J* * delta and its part of the delta.  A set of
+     * variables that depend on each other freezes at the same time, once all
+     * of them are stable.  With the default tolerance (0) the frozen values
+     * are exactly the ones we would get without freezing.
+     *
+     * Skipping the rows is done in every StarMode: for kFull and kSolve the
+     * tape evaluates only the instructions needed by the live rows (see
+     * FoldedTape::SkipRows) and for kNumeric only the Jacobian and the
+     * system of the live variables are evaluated and solved.
+     *
+     * When all the variables are frozen we have reached the fixpoint and stop
+     * before max_iter (see GetIterations).
+     */
+
     // iterate until convergence
     // TODO: seems to be 2 iterations off compared to sage-impl..
     Matrix<SR> solve_fixpoint(const std::vector<Polynomial<SR> >& F,
                               const std::vector<VarPtr>& poly_vars, int max_iter) {
-      Matrix<Polynomial<SR> > F_mat = Matrix<Polynomial<SR> >(F.size(),F);
-      Matrix<Polynomial<SR> > J = Polynomial<SR>::jacobian(F, poly_vars);
-      auto valuation_tmp = new std::unordered_map<SR, VarPtr, SR>();
-      Matrix<FreeSemiring> J_free = Polynomial<SR>::make_free(J, valuation_tmp);
+      /* J_s is only ever evaluated in SR, so we can simplify it using the
+       * laws that hold in SR (but only while we build it). */
+      ScopedRewriteRules rewrite_rules{RewriteRules::ForSemiring<SR>()};
 
+      Matrix<Polynomial<SR> > F_mat = Matrix<Polynomial<SR> >(F.size(),F);
+      SparseMatrix<Polynomial<SR> > J =
+        Polynomial<SR>::sparse_jacobian(F, poly_vars);
+      auto valuation_tmp = new SemiringMap<SR, VarPtr>();
       auto valuation = new std::unordered_map<VarPtr, SR>();
-      // insert null and one valuations into the map
-      // valuation->insert(valuation->begin(), std::pair<FreeSemiring,SR>(FreeSemiring::null(), SR::null()));
-      // valuation->insert(valuation->begin(), std::pair<FreeSemiring,SR>(FreeSemiring::one(), SR::one()));
-      for (auto v_it = valuation_tmp->begin(); v_it != valuation_tmp->end();
-           ++v_it) {
-        valuation->insert(valuation->begin(),
-                          std::pair<VarPtr, SR>(v_it->second, v_it->first));
+      std::vector<VarPtr> d;
+      if (star_mode_ == StarMode::kSolve) {
+        d = this->get_symbolic_vector(poly_vars.size(), "d");
+      }
+
+      /* Only the poly_vars (and the d) change between the steps, everything
+       * else in J_s depends just on the coefficients. */
+      std::vector<VarPtr> step_vars{poly_vars};
+      step_vars.insert(step_vars.end(), d.begin(), d.end());
+
+      /* J_s is the same in every step, so compile it just once (or take it
+       * from the cache, which also fills in the valuation). */
+      std::unique_ptr< StarCache<SR> > cache;
+      std::unique_ptr<FreeTape> J_s_compiled;
+      if (!star_cache_.empty() && star_mode_ != StarMode::kNumeric) {
+        cache.reset(new StarCache<SR>{star_cache_,
+                                      static_cast<std::size_t>(star_mode_),
+                                      J, step_vars});
+        J_s_compiled = cache->Load(valuation);
+      }
+      if (!J_s_compiled) {
+        Matrix<FreeSemiring> J_s{0, 0};
+        if (star_mode_ == StarMode::kFull) {
+          J_s = free_jacobian_star(J, valuation_tmp);
+        } else if (star_mode_ == StarMode::kSolve) {
+          std::vector<FreeSemiring> d_free(d.begin(), d.end());
+          J_s = Polynomial<SR>::make_free(J, valuation_tmp)
+                  .StarSolve(Matrix<FreeSemiring>{d.size(), std::move(d_free)},
+                             pool_);
+        }
+
+        // insert null and one valuations into the map
+        // valuation->insert(valuation->begin(), std::pair<FreeSemiring,SR>(FreeSemiring::null(), SR::null()));
+        // valuation->insert(valuation->begin(), std::pair<FreeSemiring,SR>(FreeSemiring::one(), SR::one()));
+        for (auto v_it = valuation_tmp->begin(); v_it != valuation_tmp->end();
+             ++v_it) {
+          valuation->insert(valuation->begin(),
+                            std::pair<VarPtr, SR>(v_it->second, v_it->first));
+        }
+
+        J_s_compiled.reset(new FreeTape{J_s});
+        if (cache && !cache->Store(*J_s_compiled, *valuation_tmp)) {
+          std::cerr << "Could not write " << cache->GetPath() << std::endl;
+        }
+      }
+
+      /* Everything that depends just on the coefficients is evaluated right
+       * away. */
+      FoldedTape<SR> J_s_tape{*J_s_compiled, step_vars, *valuation};
+
+      /* For StarMode::kNumeric the Jacobian is compiled just once and
+       * evaluated with the values of the poly_vars in every step. */
+      std::unique_ptr< PolynomialPlan<SR> > J_plan;
+      std::vector< std::pair<std::size_t, std::size_t> > J_positions;
+      if (star_mode_ == StarMode::kNumeric) {
+        std::vector< Polynomial<SR> > J_entries;
+        J.ForEachNonNull([&](std::size_t row, std::size_t column,
+                             const Polynomial<SR> &polynomial) {
+          J_positions.emplace_back(row, column);
+          J_entries.push_back(polynomial);
+        });
+        J_plan.reset(new PolynomialPlan<SR>{J_entries, poly_vars});
       }
 
+      /* See [Note: Freezing]. */
+      std::vector< std::vector<std::size_t> > dependents(poly_vars.size());
+      {
+        std::unordered_map<VarPtr, std::size_t> indices;
+        for (std::size_t i = 0; i < poly_vars.size(); ++i) {
+          indices.emplace(poly_vars[i], i);
+        }
+        for (std::size_t i = 0; i < F.size(); ++i) {
+          for (const auto &var : F[i].get_variables()) {
+            auto index_iter = indices.find(var);
+            if (index_iter != indices.end()) {
+              dependents[index_iter->second].push_back(i);
+            }
+          }
+        }
+      }
+      std::vector<std::uint8_t> frozen(poly_vars.size(), 0);
+
+      /* Computes the next iterand (according to star_mode_). */
+      auto next_step = [&](const Matrix<SR> &v, const Matrix<SR> &delta)
+          -> Matrix<SR> {
+        switch (star_mode_) {
+          case StarMode::kSolve:
+            return solve_step(poly_vars, d, J_s_tape, valuation, v, delta,
+                              frozen);
+          case StarMode::kNumeric:
+            return numeric_step(*J_plan, J_positions, v, delta, frozen);
+          default:
+            return step(poly_vars, J_s_tape, valuation, v, delta, frozen);
+        }
+      };
+
       // std::cout << "Jacobian (with vars): " << std::endl;
       // std::cout << J << std::endl;
 
-      Matrix<FreeSemiring> J_s = J_free.star();
-
       // define new symbolic vectors [u1,u2,...,un] TODO: this is ugly...
       std::vector<VarPtr> u = this->get_symbolic_vector(poly_vars.size(), "u");
       std::vector<VarPtr> u_upd =
@@ -305,26 +454,28 @@ class Newton {
       }
       Matrix<SR> delta_new = Polynomial<SR>::eval(F_mat, values);
 
-      Matrix<SR> v_upd = step(poly_vars, J_s, valuation, v, delta_new);
-
-      // FIXME: ugly since we do not have a simple standard Matrix-Constructor
-      // without any arguments
-      Matrix<Polynomial<SR> > delta = Matrix<Polynomial<SR> >(1,1);
-
-      if (!SR::is_idempotent)
-        delta = compute_symbolic_delta(u, u_upd, F, poly_vars);
+      Matrix<SR> v_upd = next_step(v, delta_new);
+      iterations_ = 1;
+
+      /* The delta is compiled once, in every step it is evaluated with the
+       * values of u followed by the ones of u_upd. */
+      std::unique_ptr< PolynomialPlan<SR> > delta;
+      if (!SR::is_idempotent) {
+        std::vector<VarPtr> delta_vars{u};
+        delta_vars.insert(delta_vars.end(), u_upd.begin(), u_upd.end());
+        delta.reset(new PolynomialPlan<SR>{
+            compute_symbolic_delta(u, u_upd, F, poly_vars).getElements(),
+            delta_vars});
+      }
 
       //start with i=1 as we have already done one iteration explicitly
-      for (int i=1; i<max_iter; ++i) {
+      //and stop early once all the variables are frozen
+      for (int i=1; i<max_iter && freeze(dependents, v, v_upd, &frozen); ++i) {
         if (!SR::is_idempotent) {
-          values.clear();
-          for (unsigned int i = 0; i<u.size(); i++) {
-            values.insert(values.begin(),
-                std::pair<VarPtr,SR>(u_upd.at(i), v_upd.getElements().at(i)));
-            values.insert(values.begin(),
-                std::pair<VarPtr,SR>(u.at(i), v.getElements().at(i)));
-          }
-          delta_new = Polynomial<SR>::eval(delta,values);
+          std::vector<SR> delta_values{v.getElements()};
+          delta_values.insert(delta_values.end(), v_upd.getElements().begin(),
+                              v_upd.getElements().end());
+          delta_new = delta->Eval(delta_values, &frozen);
         }
 
         if (SR::is_idempotent)
@@ -334,7 +485,15 @@ class Newton {
         else
           v = v + v_upd;
 
-        v_upd = step(poly_vars, J_s, valuation, v, delta_new);
+        v_upd = next_step(v, delta_new);
+        ++iterations_;
+
+        /* The frozen variables keep their values. */
+        for (std::size_t j = 0; j < frozen.size(); ++j) {
+          if (frozen[j]) {
+            v_upd.At(j, 0) = SR::is_idempotent ? v.At(j, 0) : SR::null();
+          }
+        }
       }
 
       if (SR::is_idempotent)
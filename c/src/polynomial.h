@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <initializer_list>
 #include <list>
 #include <map>
@@ -10,9 +11,11 @@
 #include <unordered_map>
 
 #include "free-semiring.h"
+#include "hash.h"
 #include "matrix.h"
 #include "monomial.h"
 #include "semiring.h"
+#include "sparse_matrix.h"
 #include "var.h"
 #include "var_degree_map.h"
 
@@ -167,7 +170,6 @@ class Polynomial : public Semiring< Polynomial<SR> > {
       for (const auto &lhs_monomial_coeff : monomials_) {
         for (const auto &rhs_monomial_coeff : rhs.monomials_) {
           auto tmp_monomial = lhs_monomial_coeff.first * rhs_monomial_coeff.first;
-          auto tmp_coeff = lhs_monomial_coeff.second * rhs_monomial_coeff.second;
 
           auto iter = tmp_monomials.find(tmp_monomial);
           if (iter == tmp_monomials.end()) {
@@ -175,10 +177,11 @@ class Polynomial : public Semiring< Polynomial<SR> > {
              * the monomial. */
             tmp_variables.Merge(tmp_monomial.variables_);
             InsertMonomial(tmp_monomials, std::move(tmp_monomial),
-                           std::move(tmp_coeff));
+                           lhs_monomial_coeff.second * rhs_monomial_coeff.second);
           } else {
             /* The monomial is already in the list, so add the coefficients. */
-            iter->second = tmp_coeff + iter->second;
+            AddMul(iter->second, lhs_monomial_coeff.second,
+                   rhs_monomial_coeff.second);
           }
         }
       }
@@ -255,6 +258,92 @@ class Polynomial : public Semiring< Polynomial<SR> > {
       return tmp_polynomial;
     }
 
+    /* Sums up the derivatives w.r.t. every multiset dx of vars with at least
+     * min_order elements, with vars substituted by values and multiplied by
+     * the corresponding deltas (one for every element of dx).  This is the
+     * same as summing up derivative(dx).subst(...) * deltas over all the
+     * possible dx, but instead of going through all of them (most of which
+     * give null) we go only through the parts of every monomial. */
+    Polynomial<SR> HigherOrderTerms(const std::vector<VarPtr> &vars,
+        const std::vector<VarPtr> &values, const std::vector<VarPtr> &deltas,
+        Degree min_order) const {
+      assert(vars.size() == values.size() && vars.size() == deltas.size());
+      std::unordered_map<VarPtr, std::size_t> indices;
+      for (std::size_t i = 0; i < vars.size(); ++i) {
+        indices.emplace(vars[i], i);
+      }
+
+      std::map<Monomial, SR> tmp_monomials;
+      /* The index (in vars) and the degree of the differentiated variables of
+       * the monomial and how many times we differentiate w.r.t. each. */
+      std::vector< std::pair<std::size_t, Degree> > index_degrees;
+      std::vector<Degree> orders;
+      for (const auto &monomial_coeff : monomials_) {
+        VarDegreeMap other_variables;
+        index_degrees.clear();
+        for (const auto &var_degree : monomial_coeff.first.variables_) {
+          auto index_iter = indices.find(var_degree.first);
+          if (index_iter == indices.end()) {
+            other_variables.Insert(var_degree.first, var_degree.second);
+          } else {
+            index_degrees.emplace_back(index_iter->second, var_degree.second);
+          }
+        }
+        /* Differentiate in the same order as derivative(dx) would. */
+        std::sort(index_degrees.begin(), index_degrees.end());
+
+        orders.assign(index_degrees.size(), 0);
+        Degree order = 0;
+        while (true) {
+          if (min_order <= order) {
+            SR tmp_coeff = monomial_coeff.second;
+            VarDegreeMap tmp_variables = other_variables;
+            for (std::size_t i = 0; i < orders.size(); ++i) {
+              auto index = index_degrees[i].first;
+              auto degree = index_degrees[i].second;
+              for (Degree j = 0; j < orders[i]; ++j, --degree) {
+                SR sum = SR::null();
+                for (Degree k = 0; k < degree; ++k) {
+                  sum += tmp_coeff;
+                }
+                tmp_coeff = std::move(sum);
+              }
+              if (degree != 0) {
+                tmp_variables.Insert(values[index], degree);
+              }
+              if (orders[i] != 0) {
+                tmp_variables.Insert(deltas[index], orders[i]);
+              }
+            }
+            Monomial tmp_monomial{std::move(tmp_variables)};
+            auto iter = tmp_monomials.find(tmp_monomial);
+            if (iter == tmp_monomials.end()) {
+              InsertMonomial(tmp_monomials, tmp_monomial, tmp_coeff);
+            } else {
+              iter->second += tmp_coeff;
+            }
+          }
+
+          /* Next orders (counting with digit i going up to its degree). */
+          std::size_t i = 0;
+          for (; i < orders.size(); ++i) {
+            if (orders[i] < index_degrees[i].second) {
+              ++orders[i];
+              ++order;
+              break;
+            }
+            order -= orders[i];
+            orders[i] = 0;
+          }
+          if (i == orders.size()) {
+            break;
+          }
+        }
+      }
+
+      return Polynomial<SR>{std::move(tmp_monomials)};
+    }
+
     static Matrix< Polynomial<SR> > jacobian(
         const std::vector< Polynomial<SR> > &polynomials,
         const std::vector<VarPtr> &variables) {
@@ -269,10 +358,52 @@ class Polynomial : public Semiring< Polynomial<SR> > {
                                       std::move(result_vector)};
     };
 
+    /* Same as jacobian, but the derivatives are computed only w.r.t. the
+     * variables that actually appear in each polynomial (all the others are
+     * null anyway). */
+    static SparseMatrix< Polynomial<SR> > sparse_jacobian(
+        const std::vector< Polynomial<SR> > &polynomials,
+        const std::vector<VarPtr> &variables) {
+      std::map<VarPtr, std::size_t> var_columns;
+      for (std::size_t i = 0; i < variables.size(); ++i) {
+        var_columns.insert(std::make_pair(variables[i], i));
+      }
+
+      std::vector<std::size_t> row_starts{0};
+      std::vector<std::size_t> column_indices;
+      std::vector< Polynomial<SR> > values;
+      std::vector< std::pair<std::size_t, VarPtr> > row;
+      for (const auto &polynomial : polynomials) {
+        row.clear();
+        for (const auto &var_degree : polynomial.variables_) {
+          auto iter = var_columns.find(var_degree.first);
+          if (iter != var_columns.end()) {
+            row.emplace_back(iter->second, var_degree.first);
+          }
+        }
+        std::sort(row.begin(), row.end(),
+            [](const std::pair<std::size_t, VarPtr> &lhs,
+               const std::pair<std::size_t, VarPtr> &rhs) {
+              return lhs.first < rhs.first;
+            });
+        for (const auto &column_var : row) {
+          column_indices.push_back(column_var.first);
+          values.emplace_back(polynomial.derivative(column_var.second));
+        }
+        row_starts.push_back(values.size());
+      }
+      return SparseMatrix< Polynomial<SR> >{polynomials.size(),
+                                            variables.size(),
+                                            std::move(row_starts),
+                                            std::move(column_indices),
+                                            std::move(values)};
+    }
+
     SR eval(const std::map<VarPtr, SR> &values) const {
       SR result = SR::null();
       for (const auto &monomial_coeff : monomials_) {
-        result += monomial_coeff.second * monomial_coeff.first.eval(values);
+        AddMul(result, monomial_coeff.second,
+               monomial_coeff.first.eval(values));
       }
       return result;
     }
@@ -324,51 +455,54 @@ class Polynomial : public Semiring< Polynomial<SR> > {
     }
 
     /* Convert this polynomial to an element of the free semiring.  Note that
-     * the provided valuation might be modified with new elements. */
-    FreeSemiring make_free(std::unordered_map<SR, VarPtr, SR> *valuation) const {
+     * the provided valuation might be modified with new elements: the i-th
+     * coefficient added to it becomes Var::getPooledVar(i), so converting many
+     * systems (each with its own valuation) reuses the same variables.  Hence
+     * the results for different valuations must not be mixed. */
+    FreeSemiring make_free(SemiringMap<SR, VarPtr> *valuation) const {
       assert(valuation);
 
       /* FIXME: Do we need that?  The above assertion should let us know...
       if (!valuation) {
-        valuation = new std::unordered_map<SR, VarPtr, SR>();
+        valuation = new SemiringMap<SR, VarPtr>();
       }
       */
 
-      auto result = FreeSemiring::null();
       // convert this polynomial by adding all converted monomials
+      std::vector<FreeSemiring> terms;
       for (const auto &monomial_coeff : monomials_) {
 
         if (monomial_coeff.second == SR::null()) {
-          result += FreeSemiring::null();
+          continue;
         } else if (monomial_coeff.second == SR::one()) {
-          result += FreeSemiring::one();
+          terms.push_back(FreeSemiring::one());
         } else {
           auto value_iter = valuation->find(monomial_coeff.second);
           if (value_iter == valuation->end()) {
-            /* Use a fresh constant - the constructor of Var::getVar() will take
-             * care of this. */
-            VarPtr tmp_var = Var::getVar();
-            FreeSemiring tmp_var_free{tmp_var};
+            VarPtr tmp_var = Var::getPooledVar(valuation->size());
             valuation->emplace(monomial_coeff.second, tmp_var);
-            result += tmp_var_free * monomial_coeff.first.make_free();
+            terms.push_back(FreeSemiring::ProductOf(
+                {FreeSemiring{tmp_var}, monomial_coeff.first.make_free()}));
           } else {
-            result += value_iter->second * monomial_coeff.first.make_free();
+            terms.push_back(FreeSemiring::ProductOf(
+                {FreeSemiring{value_iter->second},
+                 monomial_coeff.first.make_free()}));
           }
         }
       }
 
-      return result;
+      return FreeSemiring::SumOf(terms);
     }
 
     /* Same as make_free but for matrix form. */
     static Matrix<FreeSemiring> make_free(
         const Matrix< Polynomial<SR> > &poly_matrix,
-        std::unordered_map<SR, VarPtr, SR> *valuation) {
+        SemiringMap<SR, VarPtr> *valuation) {
 
       assert(valuation);
       // FIXME: Again, do we need that?
       // if (!valuation)
-      //   valuation = new std::unordered_map<SR, VarPtr, SR>();
+      //   valuation = new SemiringMap<SR, VarPtr>();
 
 
       const std::vector< Polynomial<SR> > &tmp_polynomials = poly_matrix.getElements();
@@ -380,6 +514,60 @@ class Polynomial : public Semiring< Polynomial<SR> > {
       return Matrix<FreeSemiring>{poly_matrix.getRows(), std::move(result)};
     }
 
+    /* Same as make_free but for sparse matrices (only the non-null entries are
+     * converted). */
+    static SparseMatrix<FreeSemiring> make_free(
+        const SparseMatrix< Polynomial<SR> > &poly_matrix,
+        SemiringMap<SR, VarPtr> *valuation) {
+      assert(valuation);
+      return poly_matrix.Map([valuation](const Polynomial<SR> &polynomial) {
+        return polynomial.make_free(valuation);
+      });
+    }
+
+    /* Calls f(coefficient, factors) for every monomial, the factors are its
+     * variables (each repeated as many times as its degree) in the order in
+     * which eval multiplies them. */
+    template <typename F>
+    void ForEachMonomial(F f) const {
+      std::vector<VarPtr> factors;
+      for (const auto &monomial_coeff : monomials_) {
+        factors.clear();
+        for (const auto &var_degree : monomial_coeff.first.variables_) {
+          factors.insert(factors.end(), var_degree.second, var_degree.first);
+        }
+        f(monomial_coeff.second, factors);
+      }
+    }
+
+    /* Combines the structure of the polynomial into seed: the monomials
+     * (with the variables identified by their positions, see
+     * Monomial::HashStructure) and for every coefficient only whether it's
+     * null, one or which of the other coefficients it is (that's all make_free
+     * depends on).  The coefficients that are not in indices yet are appended
+     * to coefficients. */
+    void HashStructure(std::size_t &seed,
+        const std::unordered_map<VarPtr, std::uint32_t> &positions,
+        std::vector<SR> &coefficients,
+        SemiringMap<SR, std::uint32_t> &indices) const {
+      for (const auto &monomial_coeff : monomials_) {
+        monomial_coeff.first.HashStructure(seed, positions);
+        if (monomial_coeff.second == SR::null()) {
+          HashCombine(seed, 0);
+        } else if (monomial_coeff.second == SR::one()) {
+          HashCombine(seed, 1);
+        } else {
+          auto index_iter = indices.find(monomial_coeff.second);
+          if (index_iter == indices.end()) {
+            index_iter = indices.emplace(monomial_coeff.second,
+                                         coefficients.size()).first;
+            coefficients.push_back(monomial_coeff.second);
+          }
+          HashCombine(seed, 2 + index_iter->second);
+        }
+      }
+    }
+
     Degree get_degree() {
       Degree degree = 0;
       for (auto &monomial_coeff : monomials_) {
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "matrix.h"
+#include "polynomial.h"
+#include "semiring.h"
+#include "var.h"
+
+/*
+ * PolynomialPlan
+ *
+ * A vector of polynomials compiled for evaluating them many times with
+ * different values of the same variables (e.g., the delta of Newton in every
+ * step).  The variables get fixed indices, so the values are just a vector,
+ * and every monomial becomes a product that is computed once and shared with
+ * all the other monomials (of any of the polynomials) that start with the same
+ * factors.  So an evaluation costs one multiplication for every distinct
+ * product and one AddMul for every term, without any lookups.
+ *
+ * The products multiply the factors in the same order as Polynomial::eval
+ * does, so the results are exactly the same.
+ */
+template <typename SR>
+class PolynomialPlan {
+  public:
+    PolynomialPlan(const std::vector< Polynomial<SR> > &polynomials,
+                   const std::vector<VarPtr> &vars)
+        : num_vars_(vars.size()) {
+      std::unordered_map<VarPtr, std::uint32_t> indices;
+      for (std::size_t i = 0; i < vars.size(); ++i) {
+        indices.emplace(vars[i], i);
+      }
+
+      /* Maps the product and the index of the variable it gets multiplied
+       * with to the resulting product. */
+      std::unordered_map<std::uint64_t, std::uint32_t> products;
+      starts_.push_back(0);
+      for (const auto &polynomial : polynomials) {
+        polynomial.ForEachMonomial([&](const SR &coefficient,
+                                       const std::vector<VarPtr> &factors) {
+          std::uint32_t product = 0;
+          for (const auto &var : factors) {
+            auto index_iter = indices.find(var);
+            /* All variables should be in vars. */
+            assert(index_iter != indices.end());
+            std::uint64_t key =
+              static_cast<std::uint64_t>(product) << 32 | index_iter->second;
+            auto key_product = products.emplace(key, steps_.size() + 1);
+            if (key_product.second) {
+              steps_.push_back(Step{product, index_iter->second});
+            }
+            product = key_product.first->second;
+          }
+          terms_.push_back(Term{coefficient, product});
+        });
+        starts_.push_back(terms_.size());
+      }
+    }
+
+    /* Evaluates the polynomials with values[i] for vars[i] (as given to the
+     * constructor).  Returns them as a column vector, the polynomials i with
+     * (*skip)[i] set are not evaluated and just null. */
+    Matrix<SR> Eval(const std::vector<SR> &values,
+                    const std::vector<std::uint8_t> *skip = nullptr) const {
+      assert(values.size() == num_vars_);
+      std::vector<SR> products;
+      products.reserve(steps_.size() + 1);
+      products.push_back(SR::one());
+      for (const auto &step : steps_) {
+        products.push_back(products[step.product] * values[step.var]);
+      }
+
+      std::vector<SR> result;
+      result.reserve(starts_.size() - 1);
+      for (std::size_t i = 0; i + 1 < starts_.size(); ++i) {
+        SR sum = SR::null();
+        if (skip && (*skip)[i]) {
+          result.push_back(std::move(sum));
+          continue;
+        }
+        for (auto t = starts_[i]; t < starts_[i + 1]; ++t) {
+          AddMul(sum, terms_[t].coefficient, products[terms_[t].product]);
+        }
+        result.push_back(std::move(sum));
+      }
+      return Matrix<SR>{result.size(), std::move(result)};
+    }
+
+    /* The number of distinct products (without the empty one). */
+    std::size_t GetNumProducts() const { return steps_.size(); }
+
+  private:
+    /* The product 0 is one and the product i + 1 is the product
+     * steps_[i].product multiplied by the variable steps_[i].var. */
+    struct Step {
+      std::uint32_t product;
+      std::uint32_t var;
+    };
+
+    struct Term {
+      SR coefficient;
+      std::uint32_t product;
+    };
+
+    std::vector<Step> steps_;
+
+    /* The terms of polynomial i are terms_[starts_[i]], ...,
+     * terms_[starts_[i + 1] - 1]. */
+    std::vector<Term> terms_;
+    std::vector<std::size_t> starts_;
+    std::size_t num_vars_;
+};
@@ -6,22 +6,21 @@ PrefixSemiring::PrefixSemiring()
 {
 	// empty prefix
 	this->val = {{}};
+	this->rehash();
 }
 
 PrefixSemiring::PrefixSemiring(const std::vector<VarPtr>& val)
 {
 	assert(val.size() <= max_length);
 	this->val = {val};
+	this->rehash();
 }
 
-PrefixSemiring::~PrefixSemiring()
-{
-}
-
-PrefixSemiring PrefixSemiring::operator+=(const PrefixSemiring& elem)
+PrefixSemiring& PrefixSemiring::operator+=(const PrefixSemiring& elem)
 {
 	// union of both operands
 	this->val.insert(elem.val.begin(), elem.val.end());
+	this->rehash();
 	return *this;
 }
 
@@ -33,17 +32,33 @@ std::vector<VarPtr> PrefixSemiring::concatenate(std::vector<VarPtr> l, std::vect
 	return ret;
 }
 
-PrefixSemiring PrefixSemiring::operator*=(const PrefixSemiring& elem)
+PrefixSemiring& PrefixSemiring::operator*=(const PrefixSemiring& elem)
 {
 	std::set<std::vector<VarPtr>> ret;
 	// element-wise concatenation
-	for(auto v : this->val)
-		for(auto u : elem.val)
+	for(auto &v : this->val)
+		for(auto &u : elem.val)
 			ret.insert(concatenate(v,u));
-	this->val = ret;
+	this->val = std::move(ret);
+	this->rehash();
 	return *this;
 }
 
+void PrefixSemiring::AddMul(PrefixSemiring& acc, const PrefixSemiring& lhs, const PrefixSemiring& rhs)
+{
+	// we would insert into the set we are iterating over
+	if(&acc == &lhs || &acc == &rhs)
+	{
+		acc += lhs * rhs;
+		return;
+	}
+	// insert the concatenations directly instead of creating the product
+	for(auto &v : lhs.val)
+		for(auto &u : rhs.val)
+			acc.val.insert(concatenate(v,u));
+	acc.rehash();
+}
+
 bool PrefixSemiring::operator==(const PrefixSemiring& elem) const
 {
 	for(auto v : this->val)
@@ -60,16 +75,16 @@ PrefixSemiring PrefixSemiring::star() const
 
 PrefixSemiring PrefixSemiring::null()
 {
-	if(!PrefixSemiring::elem_null)
-		PrefixSemiring::elem_null = std::shared_ptr<PrefixSemiring>(new PrefixSemiring());
-	return *PrefixSemiring::elem_null;
+	// a local static is initialized only once, even if several threads get
+	// here at the same time
+	static const PrefixSemiring elem_null{};
+	return elem_null;
 }
 
 PrefixSemiring PrefixSemiring::one()
 {
-	if(!PrefixSemiring::elem_one)
-		PrefixSemiring::elem_one = std::shared_ptr<PrefixSemiring>(new PrefixSemiring({Var::getVar("")}));
-	return *PrefixSemiring::elem_one;
+	static const PrefixSemiring elem_one({Var::getVar("")});
+	return elem_one;
 }
 
 std::string PrefixSemiring::string() const
@@ -88,8 +103,14 @@ std::string PrefixSemiring::string() const
 	return ss.str();
 }
 
+void PrefixSemiring::rehash()
+{
+	std::size_t h = 0;
+	for(auto &prefix : this->val)
+		HashCombine(h, prefix);
+	this->hash_ = h;
+}
+
 bool PrefixSemiring::is_idempotent = false;
 bool PrefixSemiring::is_commutative = false;
-std::shared_ptr<PrefixSemiring> PrefixSemiring::elem_null;
-std::shared_ptr<PrefixSemiring> PrefixSemiring::elem_one;
 unsigned int PrefixSemiring::max_length = 7;
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <set>
+#include "hash.h"
 #include "semiring.h"
 #include "var.h"
 
@@ -11,16 +12,21 @@ class PrefixSemiring : public Semiring<PrefixSemiring>
 {
 private:
 	std::set<std::vector<VarPtr>> val;
+	// the hash of val, computed by rehash() whenever val changes
+	std::size_t hash_;
+	void rehash();
 	static unsigned int max_length;
 	static std::vector<VarPtr> concatenate(std::vector<VarPtr> l, std::vector<VarPtr> r);
-	static std::shared_ptr<PrefixSemiring> elem_null;
-	static std::shared_ptr<PrefixSemiring> elem_one;
 public:
 	PrefixSemiring();
 	PrefixSemiring(const std::vector<VarPtr>& val);
-	virtual ~PrefixSemiring();
-	PrefixSemiring operator += (const PrefixSemiring& elem);
-	PrefixSemiring operator *= (const PrefixSemiring& elem);
+	PrefixSemiring(const PrefixSemiring& elem) = default;
+	PrefixSemiring(PrefixSemiring&& elem) = default;
+	PrefixSemiring& operator = (const PrefixSemiring& elem) = default;
+	PrefixSemiring& operator = (PrefixSemiring&& elem) = default;
+	PrefixSemiring& operator += (const PrefixSemiring& elem);
+	PrefixSemiring& operator *= (const PrefixSemiring& elem);
+	static void AddMul(PrefixSemiring& acc, const PrefixSemiring& lhs, const PrefixSemiring& rhs);
 	bool operator == (const PrefixSemiring& elem) const;
 	PrefixSemiring star () const;
 	static PrefixSemiring null();
@@ -28,6 +34,20 @@ public:
 	std::string string() const;
 	static bool is_idempotent;
 	static bool is_commutative;
+
+	friend struct std::hash<PrefixSemiring>;
 };
 
+namespace std {
+
+template <>
+struct hash<PrefixSemiring> {
+	std::size_t operator()(const PrefixSemiring& elem) const
+	{
+		return elem.hash_;
+	}
+};
+
+}
+
 #endif
@@ -13,6 +13,7 @@
 #include <lpsolve/lp_lib.h>
 #endif
 
+#include "hash.h"
 #include "semilinSetExp.h"
 
 // adding two Var-maps componentwise... could be put in a util-class ?
@@ -353,6 +354,7 @@ void SemilinSetExp::clean_slset() {
         ++m;
     }
   }
+  Rehash();
 }
 
 LinSet operator*(const LinSet &ls1, const LinSet &ls2) {
@@ -372,13 +374,16 @@ LinSet operator*(const LinSet &ls1, const LinSet &ls2) {
   return result;
 }
 
-SemilinSetExp::SemilinSetExp() : val() { }
+SemilinSetExp::SemilinSetExp() : val() {
+  Rehash();
+}
 
 SemilinSetExp::SemilinSetExp(VarPtr var) : val() {
   VecSparse offset = { std::make_pair(var, 1) };
   LinSet ls{};
   ls.first = offset;
   val.insert(std::move(ls));
+  Rehash();
 }
 
 SemilinSetExp::SemilinSetExp(VarPtr var, unsigned int cnt) : val() {
@@ -391,10 +396,12 @@ SemilinSetExp::SemilinSetExp(VarPtr var, unsigned int cnt) : val() {
   else {
     std::cerr << "[INFO] SL-set: tried to generate slset having a variable with count zero.. ignoring it." << std::endl;
   }
+  Rehash();
 }
 
 SemilinSetExp::SemilinSetExp(const std::set<LinSet> &v) {
   val = v;
+  Rehash();
 }
 
 SemilinSetExp::~SemilinSetExp() {
@@ -402,23 +409,19 @@ SemilinSetExp::~SemilinSetExp() {
 }
 
 SemilinSetExp SemilinSetExp::null() {
-  if(!SemilinSetExp::elem_null) {
-    SemilinSetExp::elem_null =
-      std::make_shared<SemilinSetExp>(std::set<LinSet>());
-  }
-  return *SemilinSetExp::elem_null;
+  /* A local static is initialized only once, even if several threads get here
+   * at the same time. */
+  static const SemilinSetExp elem_null{std::set<LinSet>()};
+  return elem_null;
 }
 
 SemilinSetExp SemilinSetExp::one() {
-  if (!SemilinSetExp::elem_one) {
-    std::set<LinSet> elone = { LinSet{} };
-    SemilinSetExp::elem_one = std::make_shared<SemilinSetExp>(elone);
-  }
-  return *SemilinSetExp::elem_one;
+  static const SemilinSetExp elem_one{std::set<LinSet>{ LinSet{} }};
+  return elem_one;
 }
 
 // TODO: check for obvious inclusions and remove them
-SemilinSetExp SemilinSetExp::operator+=(const SemilinSetExp &sl) {
+SemilinSetExp& SemilinSetExp::operator+=(const SemilinSetExp &sl) {
   std::set<LinSet> result;
   std::insert_iterator< std::set<LinSet> > it(result, result.begin());
   std::set_union(val.begin(), val.end(), sl.val.begin(), sl.val.end(), it);
@@ -430,7 +433,7 @@ SemilinSetExp SemilinSetExp::operator+=(const SemilinSetExp &sl) {
   return *this;
 }
 
-SemilinSetExp SemilinSetExp::operator*=(const SemilinSetExp &sl) {
+SemilinSetExp& SemilinSetExp::operator*=(const SemilinSetExp &sl) {
   std::set<LinSet> result;
   for(auto &lin_set_rhs : sl.val) {
     for(auto &lin_set_lhs : val) {
@@ -447,7 +450,7 @@ SemilinSetExp SemilinSetExp::operator*=(const SemilinSetExp &sl) {
 
 // TODO: semantic equivalence check or at least some more sophisticated check
 bool SemilinSetExp::operator == (const SemilinSetExp &sl) const {
-  return (val == sl.val);
+  return hash_ == sl.hash_ && val == sl.val;
 }
 
 std::set<LinSet> SemilinSetExp::star(const LinSet &ls) {
@@ -501,6 +504,31 @@ std::string SemilinSetExp::string() const {
   return ss.str();
 }
 
+namespace {
+
+void HashVecSparse(std::size_t &seed, const VecSparse &vec) {
+  for (const auto &var_count : vec) {
+    HashCombine(seed, var_count.first);
+    HashCombine(seed, var_count.second);
+  }
+}
+
+}  /* Anonymous namespace. */
+
+void SemilinSetExp::Rehash() {
+  hash_ = 0;
+  for (const auto &ls : val) {
+    HashVecSparse(hash_, ls.first);
+    for (const auto &generator : ls.second) {
+      HashVecSparse(hash_, generator);
+    }
+  }
+}
+
+std::size_t SemilinSetExp::Hash() const {
+  return hash_;
+}
+
 std::ostream& SemilinSetExp::operator<<(std::ostream &os) const {
   return os << string();
 }
@@ -508,5 +536,3 @@ std::ostream& SemilinSetExp::operator<<(std::ostream &os) const {
 
 const bool SemilinSetExp::is_idempotent = true;
 const bool SemilinSetExp::is_commutative = true;
-std::shared_ptr<SemilinSetExp> SemilinSetExp::elem_null;
-std::shared_ptr<SemilinSetExp> SemilinSetExp::elem_one;
@@ -53,10 +53,9 @@ typedef std::pair< VecSparse, std::set<VecSparse> > LinSet;
 class SemilinSetExp : public Semiring<SemilinSetExp> {
   private:
     std::set<LinSet> val;
-    /* null = {} (empty set) */
-    static std::shared_ptr<SemilinSetExp> elem_null;
-    /* one = (0, {(0,0,...0)}) */
-    static std::shared_ptr<SemilinSetExp> elem_one;
+    /* The hash of val, recomputed by Rehash() whenever val changes. */
+    std::size_t hash_;
+    void Rehash();
 
   public:
     SemilinSetExp();
@@ -64,18 +63,21 @@ class SemilinSetExp : public Semiring<SemilinSetExp> {
     SemilinSetExp(VarPtr v);
     SemilinSetExp(VarPtr var, unsigned int cnt);
 
-    virtual ~SemilinSetExp();
+    ~SemilinSetExp();
 
+    /* null = {} (empty set) */
     static SemilinSetExp null();
+    /* one = (0, {(0,0,...0)}) */
     static SemilinSetExp one();
     static std::set<LinSet> star(const LinSet &ls);
 
 
     SemilinSetExp star() const;
     std::string string() const;
+    std::size_t Hash() const;
 
-    SemilinSetExp operator += (const SemilinSetExp& sl);
-    SemilinSetExp operator *= (const SemilinSetExp& sl);
+    SemilinSetExp& operator += (const SemilinSetExp& sl);
+    SemilinSetExp& operator *= (const SemilinSetExp& sl);
 
     bool operator == (const SemilinSetExp& sl) const;
     std::ostream& operator<<(std::ostream& os) const;
@@ -86,6 +88,17 @@ class SemilinSetExp : public Semiring<SemilinSetExp> {
     static const bool is_commutative;
 };
 
+namespace std {
+
+template <>
+struct hash<SemilinSetExp> {
+  std::size_t operator()(const SemilinSetExp &slset) const {
+    return slset.Hash();
+  }
+};
+
+}  /* namespace std */
+
 
 
 
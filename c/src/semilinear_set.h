@@ -12,23 +12,31 @@ template <typename Simplifier1, typename Simplifier2, typename V>
 class SemilinearSet : public Semiring<
                                SemilinearSet<Simplifier1, Simplifier2, V> > {
   public:
-    SemilinearSet() = default;
+    SemilinearSet() { Rehash(); }
     SemilinearSet(std::initializer_list< LinearSet<Simplifier2, V> > list)
-        : set_(list) {}
+        : set_(list) {
+      Rehash();
+    }
     SemilinearSet(const SemilinearSet &slset) = default;
     SemilinearSet(SemilinearSet &&slset) = default;
 
-    SemilinearSet(const LinearSet<Simplifier2, V> &lset) : set_({lset}) {}
-    SemilinearSet(LinearSet<Simplifier2, V> &&lset) : set_({std::move(lset)}) {}
+    SemilinearSet(const LinearSet<Simplifier2, V> &lset) : set_({lset}) {
+      Rehash();
+    }
+    SemilinearSet(LinearSet<Simplifier2, V> &&lset) : set_({std::move(lset)}) {
+      Rehash();
+    }
 
     SemilinearSet(const V &v, Counter c)
-      : set_({ LinearSet<Simplifier2, V>{ SparseVec<V>{v, c} } }) {}
+        : set_({ LinearSet<Simplifier2, V>{ SparseVec<V>{v, c} } }) {
+      Rehash();
+    }
     SemilinearSet(const V &v) : SemilinearSet(v, 1) {}
 
     ~SemilinearSet() = default;
 
     bool operator==(const SemilinearSet &rhs) const {
-      return set_ == rhs.set_;
+      return hash_ == rhs.hash_ && set_ == rhs.set_;
     }
 
     static SemilinearSet null() {
@@ -49,6 +57,7 @@ class SemilinearSet : public Semiring<
                      std::inserter(result, result.begin()));
       set_ = std::move(result);
       // FIXME: run Simplifier1
+      Rehash();
       return *this;
     }
 
@@ -60,10 +69,26 @@ class SemilinearSet : public Semiring<
         }
       }
       set_ = std::move(result);
-
+      Rehash();
       return *this;
     }
 
+    /* acc += lhs * rhs, but inserting the products directly into acc. */
+    static void AddMul(SemilinearSet &acc, const SemilinearSet &lhs,
+                       const SemilinearSet &rhs) {
+      /* We would insert into the set that we're iterating over. */
+      if (&acc == &lhs || &acc == &rhs) {
+        acc += lhs * rhs;
+        return;
+      }
+      for(auto &lin_set_rhs : rhs.set_) {
+        for(auto &lin_set_lhs : lhs.set_) {
+          acc.set_.insert(lin_set_lhs + lin_set_rhs);
+        }
+      }
+      acc.Rehash();
+    }
+
     SemilinearSet star(const LinearSet<Simplifier2, V> &lset) const {
 
       /* If we do not have any generators, i.e.,
@@ -92,6 +117,7 @@ class SemilinearSet : public Semiring<
 
       /* Insert one.  We're inlining the definition for efficiency. */
       result.set_.insert(LinearSet<Simplifier2, V>{});
+      result.Rehash();
 
       return result;
     }
@@ -104,6 +130,10 @@ class SemilinearSet : public Semiring<
       return result;
     }
 
+    std::size_t Hash() const {
+      return hash_;
+    }
+
     std::string string() const {
       std::stringstream sout;
       sout << "{ " << std::endl;
@@ -118,9 +148,23 @@ class SemilinearSet : public Semiring<
     static const bool is_commutative = true;
 
   private:
-    SemilinearSet(std::set< LinearSet<Simplifier2, V> > &&s) : set_(s) {}
+    SemilinearSet(std::set< LinearSet<Simplifier2, V> > &&s) : set_(s) {
+      Rehash();
+    }
+
+    /* Recomputes hash_, has to be called whenever set_ changes. */
+    void Rehash() {
+      hash_ = 0;
+      for (const auto &ls : set_) {
+        HashCombine(hash_, ls);
+      }
+    }
 
     std::set< LinearSet<Simplifier2, V> > set_;
+    /* The hash of set_, so that hashing (e.g., in the Evaluator or a
+     * FoldedTape) and comparing different sets doesn't walk all the linear
+     * sets. */
+    std::size_t hash_;
     Simplifier1 simplifier_;
 
     template <typename S21, typename S22, typename S11, typename S12, typename VV>
@@ -139,6 +183,17 @@ SemilinearSet<S21, S22, V> ChangeSimplifiers(
   return SemilinearSet<S21, S22, V>{std::move(result_set)};
 }
 
+namespace std {
+
+template <typename S1, typename S2, typename V>
+struct hash< SemilinearSet<S1, S2, V> > {
+  std::size_t operator()(const SemilinearSet<S1, S2, V> &slset) const {
+    return slset.Hash();
+  }
+};
+
+}  /* namespace std */
+
 /* Compatibility with old implementation. */
 typedef SemilinearSet<DummySimplifier, NaiveSimplifier<VarPtr>, VarPtr> SemilinSetExp;
 // typedef SemilinearSet<DummySimplifier, DummySimplifier, VarPtr> SemilinSetExp;
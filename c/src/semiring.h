@@ -4,51 +4,155 @@
 #include <iosfwd>
 #include <string>
 #include <functional> // for std::hash
+#include <unordered_map>
+#include <utility>
 
 
+// Base class of all semirings (using CRTP, i.e., SR is the derived class).
+// There are no virtual functions, every semiring SR just has to provide
+//   SR star() const
+//   bool operator==(const SR&) const
+//   std::string string() const
+//   SR& operator+=(const SR&), SR& operator*=(const SR&)
+//   static SR null(), static SR one()
+// the flags is_idempotent and is_commutative, and a specialization of
+// std::hash<SR> (hashing the structure, not the string) or of SemiringHash and
+// SemiringEqual (see SemiringMap).  Everything is called statically, so simple
+// semirings (e.g., FloatSemiring) stay trivially copyable and do not carry a
+// vtable pointer around.
 template <typename SR>
 class Semiring {
 public:
-  virtual ~Semiring(){};
-
 	friend SR operator * (const SR& lhs, const SR& rhs)
 	{
 		SR result = lhs;
 		result *= rhs;
 		return result;
 	}
+	// if lhs is a temporary, we can reuse it for the result
+	friend SR operator * (SR&& lhs, const SR& rhs)
+	{
+		lhs *= rhs;
+		return std::move(lhs);
+	}
 	friend SR operator + (const SR& lhs, const SR& rhs)
 	{
 		SR result = lhs;
 		result += rhs;
 		return result;
 	}
-	virtual SR star () const = 0;
-	virtual bool operator ==(const SR& elem) const = 0;
+	friend SR operator + (SR&& lhs, const SR& rhs)
+	{
+		lhs += rhs;
+		return std::move(lhs);
+	}
 	static bool is_idempotent;
 	static bool is_commutative;
 	static SR null();
 	static SR one();
-	virtual std::string string() const = 0;
+};
+
+template <typename SR>
+SR& operator *= (SR& lhs, const SR& rhs);
+template <typename SR>
+SR& operator += (SR& lhs, const SR& rhs);
+
+namespace semiring_detail {
+
+// picked if SR has its own AddMul (the int parameter makes this the better match)
+template <typename SR>
+auto AddMul(SR& acc, const SR& lhs, const SR& rhs, int)
+	-> decltype(SR::AddMul(acc, lhs, rhs), void())
+{
+	SR::AddMul(acc, lhs, rhs);
+}
+
+template <typename SR>
+void AddMul(SR& acc, const SR& lhs, const SR& rhs, long)
+{
+	acc += lhs * rhs;
+}
+
+}
+
+// acc += lhs * rhs
+// This is the inner step of matrix products and polynomial evaluation.  By
+// default it just uses the operators, but a semiring can define a static
+// SR::AddMul(acc, lhs, rhs) that adds the product directly into acc (without
+// creating any temporaries).
+template <typename SR>
+inline void AddMul(SR& acc, const SR& lhs, const SR& rhs)
+{
+	semiring_detail::AddMul(acc, lhs, rhs, 0);
+}
 
-        // FIXME: This might be _really_ inefficient.  Maybe we should just
-        // require that the semirings provide the specialization for
-        // std::hash...?
-	size_t operator()(const SR& sr) const
+// The hash and equality of SR for the keys of a SemiringMap.  By default these
+// are std::hash<SR> and ==, but a semiring whose == is not an equivalence
+// (e.g., FloatSemiring, whose == allows for rounding errors) specializes them
+// to an exact comparison (and a hash that agrees with it).
+template <typename SR>
+struct SemiringHash
+{
+	std::size_t operator()(const SR& elem) const
+	{
+		return std::hash<SR>()(elem);
+	}
+};
+
+template <typename SR>
+struct SemiringEqual
+{
+	bool operator()(const SR& lhs, const SR& rhs) const
 	{
-		return std::hash<std::string>()(sr.string());
+		return lhs == rhs;
 	}
 };
 
+// An unordered_map with the elements of SR as keys (e.g., the coefficients in
+// Polynomial::make_free).
+template <typename SR, typename V>
+using SemiringMap = std::unordered_map<SR, V, SemiringHash<SR>, SemiringEqual<SR> >;
+
+// How close an update has to be to null for Newton to consider a variable
+// converged, relative to the value of the variable (see IsNegligible).
+struct Tolerance
+{
+	double absolute;
+	double relative;
+};
+
+namespace semiring_detail {
+
+// picked if SR has its own IsNegligible
+template <typename SR>
+auto IsNegligible(const SR& update, const SR& value, const Tolerance& tolerance, int)
+	-> decltype(SR::IsNegligible(update, value, tolerance))
+{
+	return SR::IsNegligible(update, value, tolerance);
+}
+
 template <typename SR>
-SR operator *= (SR& lhs, const SR& rhs);
+bool IsNegligible(const SR& update, const SR&, const Tolerance&, long)
+{
+	return update == SR::null();
+}
+
+}
+
+// Whether adding update to value can be ignored.  By default only null can, but
+// a semiring with a notion of distance can define a static
+// SR::IsNegligible(update, value, tolerance) that takes the tolerance into
+// account (e.g., FloatSemiring).
 template <typename SR>
-SR operator += (SR& lhs, const SR& rhs);
+inline bool IsNegligible(const SR& update, const SR& value, const Tolerance& tolerance)
+{
+	return semiring_detail::IsNegligible(update, value, tolerance, 0);
+}
 
 template <typename SR>
 std::ostream& operator<<(std::ostream& os, const Semiring<SR>& elem)
 {
-	return os << elem.string();
+	return os << static_cast<const SR&>(elem).string();
 }
 
 #endif
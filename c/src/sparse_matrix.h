@@ -0,0 +1,478 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "matrix.h"
+#include "thread_pool.h"
+
+/* Matrices with a smaller fraction of non-null entries are worth starring as a
+ * SparseMatrix, the denser (blocks of) ones are starred as a Matrix. */
+const double kSparseStarDensity = 0.1;
+
+/*
+ * SparseMatrix
+ *
+ * A matrix in the compressed sparse row (CSR) format: for every row we store
+ * only the columns and the values of its non-null entries, sorted by the
+ * column.  The entries of row r are at positions [row_starts_[r],
+ * row_starts_[r + 1]) of column_indices_ and values_.
+ *
+ * Addition, multiplication and star never touch the null entries, so their
+ * cost depends on the number of non-null entries and not on rows * columns.
+ * All the operations perform the semiring operations in the same order as the
+ * ones of Matrix (skipping only the ones involving null), so for example the
+ * star of a SparseMatrix<FreeSemiring> results in exactly the same Nodes as the
+ * star of the corresponding Matrix<FreeSemiring>.
+ */
+template <typename SR>
+class SparseMatrix {
+  public:
+    SparseMatrix(const SparseMatrix &m) = default;
+    SparseMatrix(SparseMatrix &&m) = default;
+
+    /* The null matrix. */
+    SparseMatrix(std::size_t r, std::size_t c)
+        : rows_(r), columns_(c), row_starts_(r + 1, 0) {}
+
+    SparseMatrix(std::size_t r, std::size_t c,
+                 std::vector<std::size_t> &&row_starts,
+                 std::vector<std::size_t> &&column_indices,
+                 std::vector<SR> &&values)
+        : rows_(r), columns_(c), row_starts_(std::move(row_starts)),
+          column_indices_(std::move(column_indices)),
+          values_(std::move(values)) {
+      assert(Sanity());
+    }
+
+    /* Keeps only the non-null entries of the given matrix. */
+    explicit SparseMatrix(const Matrix<SR> &matrix)
+        : rows_(matrix.getRows()), columns_(matrix.getColumns()) {
+      row_starts_.reserve(rows_ + 1);
+      row_starts_.push_back(0);
+      for (std::size_t r = 0; r < rows_; ++r) {
+        for (std::size_t c = 0; c < columns_; ++c) {
+          if (!(matrix.At(r, c) == SR::null())) {
+            column_indices_.push_back(c);
+            values_.push_back(matrix.At(r, c));
+          }
+        }
+        row_starts_.push_back(values_.size());
+      }
+      assert(Sanity());
+    }
+
+    SparseMatrix& operator=(const SparseMatrix &matrix) = default;
+    SparseMatrix& operator=(SparseMatrix &&matrix) = default;
+
+    Matrix<SR> ToDense() const {
+      Matrix<SR> result{rows_, columns_, SR::null()};
+      for (std::size_t r = 0; r < rows_; ++r) {
+        for (std::size_t i = row_starts_[r]; i < row_starts_[r + 1]; ++i) {
+          result.At(r, column_indices_[i]) = values_[i];
+        }
+      }
+      return result;
+    }
+
+    /* Applies f to every non-null entry.  The result has the same structure,
+     * even if f returns null for some of the entries. */
+    template <typename F>
+    SparseMatrix<typename std::result_of<F(const SR&)>::type> Map(F f) const {
+      typedef typename std::result_of<F(const SR&)>::type Result;
+      std::vector<Result> result_values;
+      result_values.reserve(values_.size());
+      for (const auto &value : values_) {
+        result_values.emplace_back(f(value));
+      }
+      std::vector<std::size_t> tmp_row_starts = row_starts_;
+      std::vector<std::size_t> tmp_column_indices = column_indices_;
+      return SparseMatrix<Result>{rows_, columns_, std::move(tmp_row_starts),
+                                  std::move(tmp_column_indices),
+                                  std::move(result_values)};
+    }
+
+    /* Calls f(row, column, value) for every non-null entry, row by row. */
+    template <typename F>
+    void ForEachNonNull(F f) const {
+      for (std::size_t r = 0; r < rows_; ++r) {
+        for (std::size_t i = row_starts_[r]; i < row_starts_[r + 1]; ++i) {
+          f(r, column_indices_[i], values_[i]);
+        }
+      }
+    }
+
+    SparseMatrix operator+(const SparseMatrix &rhs) const {
+      assert(rows_ == rhs.rows_ && columns_ == rhs.columns_);
+      SparseMatrix result{rows_, columns_};
+      result.row_starts_.clear();
+      result.row_starts_.push_back(0);
+      for (std::size_t r = 0; r < rows_; ++r) {
+        std::size_t i = row_starts_[r];
+        std::size_t j = rhs.row_starts_[r];
+        while (i < row_starts_[r + 1] || j < rhs.row_starts_[r + 1]) {
+          if (j == rhs.row_starts_[r + 1] ||
+              (i < row_starts_[r + 1] &&
+               column_indices_[i] < rhs.column_indices_[j])) {
+            result.column_indices_.push_back(column_indices_[i]);
+            result.values_.push_back(values_[i]);
+            ++i;
+          } else if (i == row_starts_[r + 1] ||
+                     rhs.column_indices_[j] < column_indices_[i]) {
+            result.column_indices_.push_back(rhs.column_indices_[j]);
+            result.values_.push_back(rhs.values_[j]);
+            ++j;
+          } else {
+            result.column_indices_.push_back(column_indices_[i]);
+            result.values_.push_back(values_[i] + rhs.values_[j]);
+            ++i;
+            ++j;
+          }
+        }
+        result.row_starts_.push_back(result.values_.size());
+      }
+      assert(result.Sanity());
+      return result;
+    }
+
+    /* Row-by-row (Gustavson's) multiplication.  For every row of the result we
+     * accumulate the products in a dense row, remembering which columns were
+     * touched. */
+    SparseMatrix operator*(const SparseMatrix &rhs) const {
+      assert(columns_ == rhs.rows_);
+      SparseMatrix result{rows_, rhs.columns_};
+      result.row_starts_.clear();
+      result.row_starts_.push_back(0);
+
+      std::vector<SR> accumulator(rhs.columns_, SR::null());
+      std::vector<bool> touched(rhs.columns_, false);
+      std::vector<std::size_t> touched_columns;
+
+      for (std::size_t r = 0; r < rows_; ++r) {
+        for (std::size_t i = row_starts_[r]; i < row_starts_[r + 1]; ++i) {
+          std::size_t k = column_indices_[i];
+          for (std::size_t j = rhs.row_starts_[k]; j < rhs.row_starts_[k + 1];
+               ++j) {
+            std::size_t c = rhs.column_indices_[j];
+            if (!touched[c]) {
+              touched[c] = true;
+              touched_columns.push_back(c);
+            }
+            AddMul(accumulator[c], values_[i], rhs.values_[j]);
+          }
+        }
+        std::sort(touched_columns.begin(), touched_columns.end());
+        for (auto c : touched_columns) {
+          result.column_indices_.push_back(c);
+          result.values_.push_back(std::move(accumulator[c]));
+          accumulator[c] = SR::null();
+          touched[c] = false;
+        }
+        touched_columns.clear();
+        result.row_starts_.push_back(result.values_.size());
+      }
+      assert(result.Sanity());
+      return result;
+    }
+
+    /* Multiplication with a dense matrix (e.g., a vector). */
+    Matrix<SR> operator*(const Matrix<SR> &rhs) const {
+      assert(columns_ == rhs.getRows());
+      Matrix<SR> result{rows_, rhs.getColumns(), SR::null()};
+      for (std::size_t r = 0; r < rows_; ++r) {
+        for (std::size_t c = 0; c < rhs.getColumns(); ++c) {
+          SR &elem = result.At(r, c);
+          for (std::size_t i = row_starts_[r]; i < row_starts_[r + 1]; ++i) {
+            AddMul(elem, values_[i], rhs.At(column_indices_[i], c));
+          }
+        }
+      }
+      return result;
+    }
+
+    bool operator==(const SparseMatrix &rhs) const {
+      return rows_ == rhs.rows_ && columns_ == rhs.columns_ &&
+             row_starts_ == rhs.row_starts_ &&
+             column_indices_ == rhs.column_indices_ &&
+             values_ == rhs.values_;
+    }
+
+    /* The same recursive block decomposition as Matrix::star, but on sparse
+     * blocks.  Blocks that are (almost) empty make all the products involving
+     * them (almost) free.  On the other hand, the star of a strongly connected
+     * block is dense, so the blocks with at least max_density * rows * columns
+     * non-null entries are handed over to Matrix::star.
+     *
+     * If a pool is given, the independent blocks are starred in parallel and
+     * so are the dense ones (with blocks of size at most serial_size computed
+     * serially, see Matrix::star). */
+    SparseMatrix star(double max_density = kSparseStarDensity,
+                      ThreadPool *pool = nullptr,
+                      std::size_t serial_size = 0) const {
+      assert(rows_ == columns_);
+      if (values_.size() >= max_density * rows_ * columns_) {
+        return SparseMatrix{pool ? ToDense().star(*pool, serial_size)
+                                 : ToDense().star()};
+      }
+      if (rows_ == 1) {
+        std::vector<std::size_t> tmp_row_starts = {0, 1};
+        std::vector<std::size_t> tmp_column_indices = {0};
+        std::vector<SR> tmp_values;
+        tmp_values.emplace_back(values_.empty() ? SR::null().star()
+                                                : values_[0].star());
+        return SparseMatrix{1, 1, std::move(tmp_row_starts),
+                            std::move(tmp_column_indices),
+                            std::move(tmp_values)};
+      }
+      // peel mode if n%2 != 0, split in middle otherwise
+      std::size_t split = rows_ % 2 == 0 ? rows_ / 2 : rows_ - 1;
+      std::size_t rest = rows_ - split;
+
+      SparseMatrix a_11 = Block(0, 0, split, split);
+      SparseMatrix a_12 = Block(0, split, split, rest);
+      SparseMatrix a_21 = Block(split, 0, rest, split);
+      SparseMatrix a_22 = Block(split, split, rest, rest);
+      auto star_of = [=](const SparseMatrix &block) {
+        return block.star(max_density, pool, serial_size);
+      };
+      /* The stars of the two diagonal blocks are independent. */
+      auto run_both = [&](const std::function<void()> &f,
+                          const std::function<void()> &g) {
+        if (pool && rows_ > serial_size) {
+          pool->Invoke(f, g);
+        } else {
+          f();
+          g();
+        }
+      };
+
+      SparseMatrix as_11{0, 0};
+      SparseMatrix as_22{0, 0};
+      run_both([&]() { as_11 = star_of(a_11); },
+               [&]() { as_22 = star_of(a_22); });
+      SparseMatrix A_11{0, 0};
+      SparseMatrix A_22{0, 0};
+      run_both([&]() { A_11 = star_of(a_11 + a_12 * as_22 * a_21); },
+               [&]() { A_22 = star_of(a_22 + a_21 * as_11 * a_12); });
+      SparseMatrix A_12 = as_11 * a_12 * A_22;
+      SparseMatrix A_21 = as_22 * a_21 * A_11;
+      return BlockMatrix(A_11, A_12, A_21, A_22);
+    }
+
+    /* The same Gaussian elimination as Matrix::StarSolve (skipping only the
+     * operations involving null entries of the matrix), but on sparse rows: in
+     * step k we only update the rows that have a non-null entry in column k
+     * and only with the non-null entries of row k, so the cost depends on the
+     * non-null entries (including the ones the elimination fills in) and not
+     * on rows * columns.  The rhs and the result are dense (e.g., a vector).
+     * If a pool is given, the rows updated in every step are updated in
+     * parallel. */
+    Matrix<SR> StarSolve(const Matrix<SR> &rhs,
+                         ThreadPool *pool = nullptr) const {
+      assert(rows_ == columns_ && rows_ == rhs.getRows());
+      /* The non-null entries of every row as (column, value), sorted by the
+       * column.  Once row k was the pivot, it keeps only the entries right of
+       * the diagonal (the rows below are updated only with those and they're
+       * all the backward substitution needs). */
+      typedef std::vector< std::pair<std::size_t, SR> > Row;
+      std::vector<Row> a(rows_);
+      for (std::size_t r = 0; r < rows_; ++r) {
+        a[r].reserve(row_starts_[r + 1] - row_starts_[r]);
+        for (std::size_t i = row_starts_[r]; i < row_starts_[r + 1]; ++i) {
+          a[r].emplace_back(column_indices_[i], values_[i]);
+        }
+      }
+      Matrix<SR> x = rhs;
+      const std::size_t x_columns = x.getColumns();
+      auto find = [](const Row &row, std::size_t column) {
+        return std::lower_bound(row.begin(), row.end(), column,
+            [](const std::pair<std::size_t, SR> &entry, std::size_t c) {
+              return entry.first < c;
+            });
+      };
+
+      std::vector<std::size_t> targets;
+      for (std::size_t k = 0; k < rows_; ++k) {
+        Row &pivot_row = a[k];
+        auto diagonal = find(pivot_row, k);
+        SR pivot_star = diagonal != pivot_row.end() && diagonal->first == k
+                          ? diagonal->second.star() : SR::null().star();
+        pivot_row.erase(pivot_row.begin(),
+                        diagonal != pivot_row.end() && diagonal->first == k
+                          ? diagonal + 1 : diagonal);
+        for (auto &entry : pivot_row) {
+          entry.second = pivot_star * entry.second;
+        }
+        for (std::size_t c = 0; c < x_columns; ++c) {
+          x.At(k, c) = pivot_star * x.At(k, c);
+        }
+
+        targets.clear();
+        for (std::size_t i = k + 1; i < rows_; ++i) {
+          auto entry = find(a[i], k);
+          if (entry != a[i].end() && entry->first == k) {
+            targets.push_back(i);
+          }
+        }
+        /* Replaces row i with a_ij + a_ik a_kj for j > k (merging the entries
+         * of both rows), different rows are independent. */
+        auto update = [&](std::size_t t) {
+          std::size_t i = targets[t];
+          Row &row = a[i];
+          auto entry = find(row, k);
+          const SR a_ik = entry->second;
+          Row updated;
+          updated.reserve(row.end() - entry - 1 + pivot_row.size());
+          auto left = entry + 1;
+          auto right = pivot_row.cbegin();
+          while (left != row.end() || right != pivot_row.cend()) {
+            if (right == pivot_row.cend() ||
+                (left != row.end() && left->first < right->first)) {
+              updated.push_back(std::move(*left));
+              ++left;
+            } else {
+              if (left == row.end() || right->first < left->first) {
+                updated.emplace_back(right->first, SR::null());
+              } else {
+                updated.push_back(std::move(*left));
+                ++left;
+              }
+              AddMul(updated.back().second, a_ik, right->second);
+              ++right;
+            }
+          }
+          row = std::move(updated);
+          for (std::size_t c = 0; c < x_columns; ++c) {
+            AddMul(x.At(i, c), a_ik, x.At(k, c));
+          }
+        };
+        if (pool && targets.size() > 1) {
+          pool->ParallelFor(0, targets.size(), update);
+        } else {
+          for (std::size_t t = 0; t < targets.size(); ++t) {
+            update(t);
+          }
+        }
+      }
+
+      for (std::size_t k = rows_; k-- > 0;) {
+        for (const auto &entry : a[k]) {
+          for (std::size_t c = 0; c < x_columns; ++c) {
+            AddMul(x.At(k, c), entry.second, x.At(entry.first, c));
+          }
+        }
+      }
+      return x;
+    }
+
+    std::size_t getRows() const {
+      return rows_;
+    }
+
+    std::size_t getColumns() const {
+      return columns_;
+    }
+
+    std::size_t GetNonNulls() const {
+      return values_.size();
+    }
+
+    std::string string() const {
+      return ToDense().string();
+    }
+
+  private:
+    std::size_t rows_;
+    std::size_t columns_;
+    std::vector<std::size_t> row_starts_;
+    std::vector<std::size_t> column_indices_;
+    std::vector<SR> values_;
+
+    template <typename T>
+    friend class SparseMatrix;
+
+    bool Sanity() const {
+      if (row_starts_.size() != rows_ + 1 || row_starts_[0] != 0 ||
+          row_starts_[rows_] != values_.size() ||
+          column_indices_.size() != values_.size()) {
+        return false;
+      }
+      for (std::size_t r = 0; r < rows_; ++r) {
+        for (std::size_t i = row_starts_[r]; i < row_starts_[r + 1]; ++i) {
+          if (column_indices_[i] >= columns_ ||
+              (i > row_starts_[r] &&
+               column_indices_[i - 1] >= column_indices_[i])) {
+            return false;
+          }
+        }
+      }
+      return true;
+    }
+
+    /* The block of size r x c starting at (row, column). */
+    SparseMatrix Block(std::size_t row, std::size_t column,
+                       std::size_t r, std::size_t c) const {
+      assert(row + r <= rows_ && column + c <= columns_);
+      SparseMatrix result{r, c};
+      result.row_starts_.clear();
+      result.row_starts_.push_back(0);
+      for (std::size_t i = row; i < row + r; ++i) {
+        auto begin = column_indices_.begin() + row_starts_[i];
+        auto end = column_indices_.begin() + row_starts_[i + 1];
+        auto iter = std::lower_bound(begin, end, column);
+        for (; iter != end && *iter < column + c; ++iter) {
+          result.column_indices_.push_back(*iter - column);
+          result.values_.push_back(values_[iter - column_indices_.begin()]);
+        }
+        result.row_starts_.push_back(result.values_.size());
+      }
+      return result;
+    }
+
+    static SparseMatrix BlockMatrix(const SparseMatrix &a_11,
+                                    const SparseMatrix &a_12,
+                                    const SparseMatrix &a_21,
+                                    const SparseMatrix &a_22) {
+      assert(a_11.rows_ == a_12.rows_ && a_21.rows_ == a_22.rows_);
+      assert(a_11.columns_ == a_21.columns_ && a_12.columns_ == a_22.columns_);
+      SparseMatrix result{a_11.rows_ + a_21.rows_,
+                          a_11.columns_ + a_12.columns_};
+      result.row_starts_.clear();
+      result.row_starts_.push_back(0);
+      result.column_indices_.reserve(a_11.GetNonNulls() + a_12.GetNonNulls() +
+                                     a_21.GetNonNulls() + a_22.GetNonNulls());
+      result.values_.reserve(result.column_indices_.capacity());
+      auto append_rows = [&result](const SparseMatrix &left,
+                                   const SparseMatrix &right) {
+        for (std::size_t r = 0; r < left.rows_; ++r) {
+          for (std::size_t i = left.row_starts_[r];
+               i < left.row_starts_[r + 1]; ++i) {
+            result.column_indices_.push_back(left.column_indices_[i]);
+            result.values_.push_back(left.values_[i]);
+          }
+          for (std::size_t i = right.row_starts_[r];
+               i < right.row_starts_[r + 1]; ++i) {
+            result.column_indices_.push_back(left.columns_ +
+                                             right.column_indices_[i]);
+            result.values_.push_back(right.values_[i]);
+          }
+          result.row_starts_.push_back(result.values_.size());
+        }
+      };
+      append_rows(a_11, a_12);
+      append_rows(a_21, a_22);
+      assert(result.Sanity());
+      return result;
+    }
+};
+
+template <typename SR>
+std::ostream& operator<<(std::ostream &os, const SparseMatrix<SR> &matrix) {
+  return os << matrix.string();
+}
@@ -5,6 +5,7 @@
 #include <cstdint>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -213,6 +214,7 @@ class VarVectorFactory {
 
     VarVectorPtr<V> NewVarVector(const VarVectorPtr<V> vector_ptr) {
       assert(vector_ptr);
+      std::lock_guard<std::mutex> lock{mutex_};
       auto iter_inserted =
         map_.emplace(KeyWrapper< VarVector<V> >{vector_ptr}, vector_ptr);
       /* Sanity check -- the actual vectors must be the same. */
@@ -222,6 +224,10 @@ class VarVectorFactory {
 
   private:
     std::unordered_map< KeyWrapper< VarVector<V> >, VarVectorPtr<V> > map_;
+
+    /* The vectors are created by all the threads of a ThreadPool that
+     * evaluates a tape (see FreeTape::Eval). */
+    std::mutex mutex_;
 };
 
 }  /* Anonymous namespace. */
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "free-tape.h"
+#include "hash.h"
+#include "polynomial.h"
+#include "sparse_matrix.h"
+#include "var.h"
+
+/*
+ * StarCache
+ *
+ * Keeps the compiled stars of the Jacobians (as FreeTapes) in a directory, so
+ * that the next run on a system with the same structure can skip the symbolic
+ * setup (converting the Jacobian to the free semiring and computing its star).
+ *
+ * The key is a hash of the structure of the Jacobian (see
+ * Polynomial::HashStructure), of the laws used to simplify the star (see
+ * RewriteRules) and of the variant (e.g., the StarMode).  Neither the names of
+ * the variables nor the coefficients are part of the key: the tape refers to
+ * the variables by their position in the given vector and to the coefficients
+ * by their position in the Jacobian, so on a hit they become the variables and
+ * get the values of the current system.  See also [Note: Tape files].
+ */
+template <typename SR>
+class StarCache {
+  public:
+    /* The variables are the ones the star depends on apart from the
+     * coefficients, i.e., the poly_vars (followed by the d for
+     * StarMode::kSolve). */
+    StarCache(const std::string &directory, std::size_t variant,
+              const SparseMatrix< Polynomial<SR> > &jacobian,
+              const std::vector<VarPtr> &variables)
+        : variables_(variables) {
+      std::unordered_map<VarPtr, std::uint32_t> positions;
+      for (std::size_t i = 0; i < variables_.size(); ++i) {
+        positions.emplace(variables_[i], i);
+      }
+      std::size_t seed = variant;
+      /* Copies, since binding the static members to a reference would need
+       * their definitions (not all semirings have them out of the class). */
+      bool idempotent = SR::is_idempotent;
+      bool commutative = SR::is_commutative;
+      HashCombine(seed, idempotent);
+      HashCombine(seed, commutative);
+      HashCombine(seed, jacobian.getRows());
+      HashCombine(seed, jacobian.getColumns());
+      HashCombine(seed, variables_.size());
+      jacobian.ForEachNonNull([&](std::size_t row, std::size_t column,
+                                  const Polynomial<SR> &polynomial) {
+        HashCombine(seed, row);
+        HashCombine(seed, column);
+        polynomial.HashStructure(seed, positions, coefficients_, indices_);
+      });
+      key_ = seed;
+
+      std::stringstream ss;
+      ss << directory << "/" << std::hex << std::setw(16) << std::setfill('0')
+         << key_ << ".tape";
+      path_ = ss.str();
+    }
+
+    /* Returns the cached tape (or nullptr if there is none) and adds the
+     * values of its coefficients to the valuation. */
+    std::unique_ptr<FreeTape> Load(
+        std::unordered_map<VarPtr, SR> *valuation) const {
+      /* The same variables as make_free would use for the coefficients. */
+      std::vector<VarPtr> vars;
+      for (std::size_t i = 0; i < coefficients_.size(); ++i) {
+        vars.push_back(Var::getPooledVar(i));
+      }
+      std::unique_ptr<FreeTape> tape =
+        FreeTape::Load(path_, key_, vars, variables_);
+      if (tape) {
+        for (std::size_t i = 0; i < vars.size(); ++i) {
+          valuation->insert(std::make_pair(vars[i], coefficients_[i]));
+        }
+      }
+      return tape;
+    }
+
+    /* Stores the tape, coefficients are the variables of the coefficients (as
+     * given to Polynomial::make_free).  Returns false if that failed. */
+    bool Store(const FreeTape &tape,
+               const SemiringMap<SR, VarPtr> &coefficients) const {
+      std::unordered_map<VarPtr, std::uint32_t> vars;
+      for (const auto &coefficient_var : coefficients) {
+        auto iter = indices_.find(coefficient_var.first);
+        if (iter != indices_.end()) {
+          vars.emplace(coefficient_var.second, iter->second);
+        }
+      }
+      return tape.Save(path_, key_, vars, variables_);
+    }
+
+    const std::string& GetPath() const { return path_; }
+
+  private:
+    std::string path_;
+    std::uint64_t key_;
+
+    /* The variables that the tape refers to by their position. */
+    std::vector<VarPtr> variables_;
+
+    /* The distinct coefficients of the Jacobian in the order of their first
+     * occurrence and their indices. */
+    std::vector<SR> coefficients_;
+    SemiringMap<SR, std::uint32_t> indices_;
+};
@@ -0,0 +1,137 @@
+#include <cassert>
+#include <iterator>
+
+#include "thread_pool.h"
+
+namespace {
+
+/* The pool that the current thread works for (if any) and its deque. */
+thread_local const ThreadPool *current_pool = nullptr;
+thread_local std::size_t current_index = 0;
+
+}  /* Anonymous namespace. */
+
+ThreadPool::ThreadPool(std::size_t threads)
+    : pending_(0), waiting_(0), stop_(false) {
+  assert(threads > 0);
+  for (std::size_t i = 0; i < threads; ++i) {
+    queues_.emplace_back(new Queue);
+  }
+  for (std::size_t i = 1; i < threads; ++i) {
+    workers_.emplace_back([this, i]() { WorkerLoop(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock{sleep_mutex_};
+    stop_ = true;
+  }
+  wake_up_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+std::size_t ThreadPool::CurrentQueue() const {
+  return current_pool == this ? current_index : 0;
+}
+
+void ThreadPool::Push(std::size_t index, Task *task) {
+  {
+    /* Count the task before anybody can see it, otherwise a worker could
+     * take it and decrement pending_ first (and wrap it around).  Taking the
+     * lock makes sure that a worker that has just checked that there is
+     * nothing to do, is already waiting when we notify it. */
+    std::lock_guard<std::mutex> lock{sleep_mutex_};
+    ++pending_;
+  }
+  {
+    std::lock_guard<std::mutex> lock{queues_[index]->mutex};
+    queues_[index]->tasks.push_back(task);
+  }
+  wake_up_.notify_one();
+}
+
+bool ThreadPool::Remove(std::size_t index, Task *task) {
+  Queue &own = *queues_[index];
+  std::lock_guard<std::mutex> lock{own.mutex};
+  /* We push and pop only at the back, so it's most likely still there. */
+  for (auto iter = own.tasks.rbegin(); iter != own.tasks.rend(); ++iter) {
+    if (*iter == task) {
+      own.tasks.erase(std::next(iter).base());
+      --pending_;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::Wait(std::size_t index, const Task &task) {
+  while (!task.done.load()) {
+    if (RunOne(index)) {
+      continue;
+    }
+    /* There is nothing to help with, so some other thread runs the task
+     * (possibly for a long time).  Sleep until it's done or there is new
+     * work.  Incrementing waiting_ before checking done makes sure that
+     * either we see the task done or RunOne sees us waiting. */
+    std::unique_lock<std::mutex> lock{sleep_mutex_};
+    ++waiting_;
+    wake_up_.wait(lock, [this, &task]() {
+      return task.done.load() || pending_ > 0;
+    });
+    --waiting_;
+  }
+}
+
+bool ThreadPool::RunOne(std::size_t index) {
+  Task *task = nullptr;
+  {
+    Queue &own = *queues_[index];
+    std::lock_guard<std::mutex> lock{own.mutex};
+    if (!own.tasks.empty()) {
+      task = own.tasks.back();
+      own.tasks.pop_back();
+    }
+  }
+  for (std::size_t i = 1; task == nullptr && i < queues_.size(); ++i) {
+    Queue &other = *queues_[(index + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock{other.mutex};
+    if (!other.tasks.empty()) {
+      task = other.tasks.front();
+      other.tasks.pop_front();
+    }
+  }
+  if (task == nullptr) {
+    return false;
+  }
+  --pending_;
+  try {
+    task->func();
+  } catch (...) {
+    task->exception = std::current_exception();
+  }
+  /* The owner may destroy the task as soon as it's done. */
+  task->done.store(true);
+  if (waiting_.load() > 0) {
+    std::lock_guard<std::mutex> lock{sleep_mutex_};
+    wake_up_.notify_all();
+  }
+  return true;
+}
+
+void ThreadPool::WorkerLoop(std::size_t index) {
+  current_pool = this;
+  current_index = index;
+  while (true) {
+    if (RunOne(index)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock{sleep_mutex_};
+    wake_up_.wait(lock, [this]() { return stop_ || pending_ > 0; });
+    if (stop_) {
+      return;
+    }
+  }
+}
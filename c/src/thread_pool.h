@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * ThreadPool
+ *
+ * A small work-stealing pool for fork-join parallelism.  Every worker has its
+ * own deque of tasks: it pushes and pops at the back of its own deque and, when
+ * that is empty, steals from the front of the deques of the other workers.
+ * Threads that are not workers of the pool (e.g., the main thread) share one
+ * additional deque.
+ *
+ * The only way to submit work is Invoke(f, g), which runs f and g (possibly) in
+ * parallel and returns once both are done (ParallelFor is built on top of
+ * it).  A thread waiting for its forked task does not block, but keeps
+ * executing other tasks, so it's fine to call Invoke recursively from within
+ * tasks (that's the whole point).  Once there is nothing left to help with, it
+ * sleeps until its task is done or new work arrives.
+ *
+ * If f or g throws, Invoke still waits until g is done (or takes it back if
+ * nobody has started it yet) and then rethrows the exception (the one of f if
+ * both throw).
+ *
+ * Note that the pool with n threads spawns only n - 1 workers, since the thread
+ * calling Invoke does its share of the work too.
+ */
+class ThreadPool {
+  public:
+    explicit ThreadPool(std::size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &pool) = delete;
+    ThreadPool& operator=(const ThreadPool &pool) = delete;
+
+    std::size_t GetThreads() const { return queues_.size(); }
+
+    template <typename F, typename G>
+    void Invoke(F &&f, G &&g) {
+      Task task{std::function<void()>{std::forward<G>(g)}};
+      std::size_t index = CurrentQueue();
+      Push(index, &task);
+      try {
+        f();
+      } catch (...) {
+        /* The task lives in our frame, so nobody must run it once we're
+         * gone. */
+        if (!Remove(index, &task)) {
+          Wait(index, task);
+        }
+        throw;
+      }
+      Wait(index, task);
+      if (task.exception) {
+        std::rethrow_exception(task.exception);
+      }
+    }
+
+    /* Runs f(i) for every i in [begin, end) by recursively splitting the
+     * range in halves with Invoke. */
+    template <typename F>
+    void ParallelFor(std::size_t begin, std::size_t end, const F &f) {
+      if (end - begin <= 1) {
+        if (begin < end) {
+          f(begin);
+        }
+        return;
+      }
+      std::size_t middle = begin + (end - begin) / 2;
+      Invoke([&]() { ParallelFor(begin, middle, f); },
+             [&]() { ParallelFor(middle, end, f); });
+    }
+
+  private:
+    struct Task {
+      Task(std::function<void()> &&f) : func(std::move(f)), done(false) {}
+      std::function<void()> func;
+      std::atomic<bool> done;
+      /* Set if func threw. */
+      std::exception_ptr exception;
+    };
+
+    struct Queue {
+      std::mutex mutex;
+      std::deque<Task*> tasks;
+    };
+
+    /* Index of the deque that belongs to the current thread. */
+    std::size_t CurrentQueue() const;
+
+    void Push(std::size_t index, Task *task);
+
+    /* Takes the task back from the given deque, returns false if somebody has
+     * already taken it. */
+    bool Remove(std::size_t index, Task *task);
+
+    /* Helps with other tasks (and sleeps if there are none) until the given
+     * task is done. */
+    void Wait(std::size_t index, const Task &task);
+
+    /* Pops a task from the given deque or steals one from some other deque and
+     * runs it.  Returns false if there was nothing to do. */
+    bool RunOne(std::size_t index);
+
+    void WorkerLoop(std::size_t index);
+
+    /* queues_[0] is shared by all the threads that are not workers. */
+    std::vector< std::unique_ptr<Queue> > queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_up_;
+    std::atomic<std::size_t> pending_;
+    /* The number of threads sleeping in Wait, only then does finishing a task
+     * have to notify wake_up_. */
+    std::atomic<std::size_t> waiting_;
+    bool stop_;
+};
@@ -1,20 +1,40 @@
+#include <atomic>
 #include <cassert>
+#include <mutex>
 #include "var.h"
 
+namespace {
+
+/* The table of all variables by their ids.  It grows by chunks that never
+ * move, so looking up a variable is safe while other variables are created.
+ * Variables are created (and Var::vars is used) only while holding
+ * vars_mutex, a new variable is published by storing the new num_vars with
+ * release semantics and lookup loads it with acquire semantics. */
+const std::uint32_t chunk_bits = 12;
+const std::uint32_t chunk_size = 1u << chunk_bits;
+const std::uint32_t max_chunks = 1u << 12;
+std::unique_ptr<Var> *chunks[max_chunks];
+std::atomic<std::uint32_t> num_vars(0);
+std::mutex vars_mutex;
+
+// the variables of Var::getPooledVar (guarded by vars_mutex)
+std::vector<VarPtr> pooled_vars;
+
+}
+
 Var::Var()
 {
-	this->id = max_id;
+	this->id = num_vars.load(std::memory_order_relaxed);
 	std::stringstream ss;
 	ss << "_"; // prefix for auto-generated variables
-	ss << max_id;
+	ss << this->id;
 	this->name = ss.str();
-	Var::max_id++;
 }
 
 Var::Var(std::string name)
 {
 	assert(name[0] != '_'); // name must not begin with underscore
-	this->id = max_id++;
+	this->id = num_vars.load(std::memory_order_relaxed);
 	this->name = name;
 }
 
@@ -23,26 +43,57 @@ std::string Var::getName()
 	return this->name;
 }
 
+// stores the var (with the next id) in the table, vars_mutex must be held
+VarPtr Var::add(Var* var)
+{
+	std::uint32_t id = num_vars.load(std::memory_order_relaxed);
+	assert(var->id == id);
+	std::uint32_t chunk = id >> chunk_bits;
+	assert(chunk < max_chunks); // too many variables
+	if(!chunks[chunk])
+		chunks[chunk] = new std::unique_ptr<Var>[chunk_size];
+	chunks[chunk][id & (chunk_size - 1)].reset(var);
+	// publishes the var (and its chunk) to lookup
+	num_vars.store(id + 1, std::memory_order_release);
+	Var::vars.insert(Var::vars.begin(), std::pair<std::string,VarPtr>(var->getName(), VarPtr(id)));
+	return VarPtr(id);
+}
+
+const Var* Var::lookup(std::uint32_t id)
+{
+	// synchronizes with add, so the var is visible even if its id was
+	// handed over without any synchronization
+	std::uint32_t size = num_vars.load(std::memory_order_acquire);
+	assert(id < size);
+	(void) size;
+	return chunks[id >> chunk_bits][id & (chunk_size - 1)].get();
+}
+
 // generates a new unnamed var
 VarPtr Var::getVar()
 {
-	VarPtr var(new Var());
-	Var::vars.insert(Var::vars.begin(), std::pair<std::string,VarPtr>(var->getName(), var));
-	return var;
+	std::lock_guard<std::mutex> lock(vars_mutex);
+	return add(new Var());
+}
+
+// creates the pooled vars up to index on first use
+VarPtr Var::getPooledVar(std::uint32_t index)
+{
+	std::lock_guard<std::mutex> lock(vars_mutex);
+	while(pooled_vars.size() <= index)
+		pooled_vars.push_back(add(new Var()));
+	return pooled_vars[index];
 }
 
 // returns a reference to 
 VarPtr Var::getVar(std::string name)
 {
+	std::lock_guard<std::mutex> lock(vars_mutex);
 	auto v_it = Var::vars.find(name);
 	if(v_it != Var::vars.end()) // var exists, return reference to it
 		return v_it->second;
 	else // create a new one
-	{
-		VarPtr var(new Var(name));
-		Var::vars.insert(Var::vars.begin(), std::pair<std::string,VarPtr>(name, var));
-		return var;
-	}
+		return add(new Var(name));
 }
 
 VarPtr Var::getVar(VarPtr var)
@@ -55,21 +106,6 @@ bool Var::operator<(const Var& rhs) const
 	return this->id < rhs.id;
 }
 
-bool operator==(const VarPtr& l, const VarPtr& r)
-{
-	return l->id == r->id;
-}
-
-bool operator!=(const VarPtr& l, const VarPtr& r)
-{
-	return l->id != r->id;
-}
-
-bool operator<(const VarPtr& l, const VarPtr& r)
-{
-	return l->id < r->id;
-}
-
 std::string Var::string() const
 {
 	//std::stringstream ss;
@@ -78,7 +114,6 @@ std::string Var::string() const
 	return this->name;
 }
 
-int Var::max_id = 0;
 std::map<std::string, VarPtr> Var::vars;
 
 std::ostream& operator<<(std::ostream& os, const VarPtr var)
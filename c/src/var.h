@@ -1,6 +1,8 @@
 #ifndef VAR_H
 #define VAR_H
 
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <map>
 #include <sstream>
@@ -9,29 +11,78 @@
 #include <memory>
 
 class Var;
-typedef std::shared_ptr<Var> VarPtr;
+
+/* A variable is referred to by its id, i.e., its index in the table of all
+ * variables (see Var::lookup).  So copying, comparing and hashing a VarId (in
+ * the keys of VarDegreeMap, Monomial, Polynomial, SparseVec or the valuations)
+ * are just operations on an integer, and the ids are dense, so they can index
+ * a plain vector.  The Var itself is only needed for its name. */
+class VarId
+{
+public:
+	VarId() : id(invalid) {}
+	explicit VarId(std::uint32_t id) : id(id) {}
+
+	std::uint32_t getId() const { return id; }
+	const Var* get() const;
+	const Var* operator->() const { return get(); }
+	const Var& operator*() const { return *get(); }
+	explicit operator bool() const { return id != invalid; }
+
+	bool operator==(const VarId& rhs) const { return id == rhs.id; }
+	bool operator!=(const VarId& rhs) const { return id != rhs.id; }
+	bool operator<(const VarId& rhs) const { return id < rhs.id; }
+	bool operator>(const VarId& rhs) const { return id > rhs.id; }
+	bool operator<=(const VarId& rhs) const { return id <= rhs.id; }
+	bool operator>=(const VarId& rhs) const { return id >= rhs.id; }
+
+private:
+	static const std::uint32_t invalid = UINT32_MAX;
+	std::uint32_t id;
+};
+
+/* The name from when variables were shared_ptrs, kept for the API. */
+typedef VarId VarPtr;
+
+namespace std {
+template <>
+struct hash<VarId>
+{
+	std::size_t operator()(const VarId& var) const
+	{
+		return std::hash<std::uint32_t>()(var.getId());
+	}
+};
+}
 
 class Var
 {
 private:
-	int id;
+	std::uint32_t id;
 	std::string name;
-	static int max_id;
-	static std::map<std::string, VarPtr> vars; // name → Var*
+	static std::map<std::string, VarPtr> vars; // name → VarId
 	Var();
 	Var(std::string name);
 	std::string getName();
+	static VarPtr add(Var* var);
 public:
 	static VarPtr getVar();
 	static VarPtr getVar(std::string name);
+	// the index-th variable of a pool of generated variables that are reused
+	// (e.g., for the coefficients in Polynomial::make_free), so that doing the
+	// same thing repeatedly doesn't create more and more variables
+	static VarPtr getPooledVar(std::uint32_t index);
 	static VarPtr getVar(VarPtr var);
+	static const Var* lookup(std::uint32_t id);
 	bool operator<(const Var& rhs) const;
-	friend bool operator==(const VarPtr& l, const VarPtr& r);
-	friend bool operator!=(const VarPtr& l, const VarPtr& r);
-	friend bool operator<(const VarPtr& l, const VarPtr& r);
 	std::string string() const;
 };
 
+inline const Var* VarId::get() const
+{
+	return Var::lookup(id);
+}
+
 struct VarPtrSort
 {
 	bool operator()(const VarPtr& lhs, const VarPtr& rhs) const
@@ -36,6 +36,22 @@ void CommutativeRExpTest::testTerms()
 	CPPUNIT_ASSERT( ((a*b + a*c) + (a * (c+b)) ) == ( (a*b + a*c) +  (a * (b+c))) );
 }
 
+void CommutativeRExpTest::testHash()
+{
+	CommutativeRExp a = *this->a;
+	CommutativeRExp b = *this->b;
+	CommutativeRExp c = *this->c;
+	std::hash<CommutativeRExp> h;
+
+	// equal terms have to have the same hash
+	CPPUNIT_ASSERT( h((a*b + c) + (c + b*a)) == h(a*b + c) );
+	CPPUNIT_ASSERT( h((c + b*a) * (a*b + c)) == h((a*b+c)*(a*b+c)) );
+	CPPUNIT_ASSERT( h(a.star()) == h(a.star().star()) );
+
+	// and a prefix of a sum is not equal to the sum
+	CPPUNIT_ASSERT( !((a + b) == (a + b + c)) );
+}
+
 void CommutativeRExpTest::testAddition()
 {
 	// a + 0 = a
@@ -45,6 +61,21 @@ void CommutativeRExpTest::testAddition()
 
 	// associative (a + b) + c == a + (b + c)
 	CPPUNIT_ASSERT( ((*a) + (*b)) + (*c) == (*a) + ((*b) + (*c)) );
+
+	// a longer sum is bigger, whatever its elements are (so < is a strict
+	// weak ordering and the sets don't depend on the order of insertion)
+	CPPUNIT_ASSERT( (*b) + (*c) < (*a) + (*b) + (*c) );
+	CPPUNIT_ASSERT( !((*a) + (*b) + (*c) < (*b) + (*c)) );
+
+	// AddMul adds into the sum in place, but must not change its copies
+	CommutativeRExp sum = (*a) + (*b);
+	CommutativeRExp copy = sum;
+	CommutativeRExp::AddMul(sum, *b, *c);
+	CPPUNIT_ASSERT( sum == (*a) + (*b) + (*b) * (*c) );
+	CPPUNIT_ASSERT( std::hash<CommutativeRExp>()(sum) == std::hash<CommutativeRExp>()((*a) + (*b) + (*b) * (*c)) );
+	CPPUNIT_ASSERT( copy == (*a) + (*b) );
+	CommutativeRExp::AddMul(sum, *a, CommutativeRExp::one());
+	CPPUNIT_ASSERT( sum == (*a) + (*b) + (*b) * (*c) );
 }
 
 void CommutativeRExpTest::testMultiplication()
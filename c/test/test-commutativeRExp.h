@@ -11,6 +11,7 @@ class CommutativeRExpTest : public CppUnit::TestFixture
 	CPPUNIT_TEST(testMultiplication);
 	CPPUNIT_TEST(testStar);
 	CPPUNIT_TEST(testTerms);
+	CPPUNIT_TEST(testHash);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -22,6 +23,7 @@ protected:
 	void testMultiplication();
 	void testStar();
 	void testTerms();
+	void testHash();
 
 private:
 	CommutativeRExp *a, *b, *c;
@@ -1,3 +1,4 @@
+#include <cmath>
 #include "test-float-semiring.h"
 
 CPPUNIT_TEST_SUITE_REGISTRATION(FloatSemiringTest);
@@ -33,3 +34,96 @@ void FloatSemiringTest::testStar()
 	CPPUNIT_ASSERT( (*null).star() == *one );
 	CPPUNIT_ASSERT( FloatSemiring(0.5).star() == FloatSemiring(2.0) );
 }
+
+void FloatSemiringTest::testMatrixMultiplication()
+{
+	// large enough to use both the vectorized and the remaining columns
+	const std::size_t rows = 19, inner = 11, columns = 13;
+	std::vector<FloatSemiring> lhs_elems, rhs_elems;
+	for(std::size_t i = 0; i < rows * inner; ++i)
+		lhs_elems.push_back(FloatSemiring(0.1 * (i % 7)));
+	for(std::size_t i = 0; i < inner * columns; ++i)
+		rhs_elems.push_back(FloatSemiring(0.3 * (i % 5)));
+	Matrix<FloatSemiring> lhs{rows, lhs_elems};
+	Matrix<FloatSemiring> rhs{inner, rhs_elems};
+
+	Matrix<FloatSemiring> product = lhs * rhs;
+	CPPUNIT_ASSERT( product.getRows() == rows && product.getColumns() == columns );
+	for(std::size_t r = 0; r < rows; ++r)
+	{
+		for(std::size_t c = 0; c < columns; ++c)
+		{
+			float expected = 0;
+			for(std::size_t i = 0; i < inner; ++i)
+				expected += lhs.At(r, i).getValue() * rhs.At(i, c).getValue();
+			// the kernels have to round exactly like the element-wise version
+			CPPUNIT_ASSERT( product.At(r, c).getValue() == expected );
+		}
+	}
+}
+
+void FloatSemiringTest::testMatrixStar()
+{
+	const std::size_t size = 10;
+	std::vector<FloatSemiring> elems;
+	for(std::size_t i = 0; i < size * size; ++i)
+		elems.push_back(FloatSemiring(0.01 * (i % 3)));
+	Matrix<FloatSemiring> matrix{size, elems};
+
+	Matrix<FloatSemiring> fw_star = matrix.star2();
+	Matrix<FloatSemiring> rec_star = matrix.star();
+	for(std::size_t r = 0; r < size; ++r)
+	{
+		for(std::size_t c = 0; c < size; ++c)
+		{
+			float fw = fw_star.At(r, c).getValue();
+			float rec = rec_star.At(r, c).getValue();
+			CPPUNIT_ASSERT( std::fabs(fw - rec) <= 1e-5 * rec );
+		}
+	}
+	// A* * b via the linear solve
+	std::vector<FloatSemiring> rhs_elems;
+	for(std::size_t i = 0; i < 2 * size; ++i)
+		rhs_elems.push_back(FloatSemiring(0.5 * (i % 4)));
+	Matrix<FloatSemiring> rhs{size, rhs_elems};
+	Matrix<FloatSemiring> solved = matrix.StarSolve(rhs);
+	Matrix<FloatSemiring> multiplied = rec_star * rhs;
+	for(std::size_t r = 0; r < size; ++r)
+		for(std::size_t c = 0; c < 2; ++c)
+			CPPUNIT_ASSERT( std::fabs(solved.At(r, c).getValue() - multiplied.At(r, c).getValue()) <= 1e-5 * multiplied.At(r, c).getValue() );
+
+	// A* = 1 + A A*
+	Matrix<FloatSemiring> unfolded = Matrix<FloatSemiring>::one(size) + matrix * fw_star;
+	for(std::size_t r = 0; r < size; ++r)
+		for(std::size_t c = 0; c < size; ++c)
+			CPPUNIT_ASSERT( std::fabs(unfolded.At(r, c).getValue() - fw_star.At(r, c).getValue()) <= 1e-5 * fw_star.At(r, c).getValue() );
+}
+
+void FloatSemiringTest::testIsNegligible()
+{
+	// without any tolerance only null is negligible
+	Tolerance exact{0, 0};
+	CPPUNIT_ASSERT( IsNegligible(*null, *second, exact) );
+	CPPUNIT_ASSERT( !IsNegligible(FloatSemiring(1e-30), *second, exact) );
+
+	// absolute, relative and both
+	CPPUNIT_ASSERT( IsNegligible(FloatSemiring(0.001), *one, Tolerance{0.01, 0}) );
+	CPPUNIT_ASSERT( !IsNegligible(FloatSemiring(0.1), *one, Tolerance{0.01, 0}) );
+	CPPUNIT_ASSERT( IsNegligible(FloatSemiring(0.1), FloatSemiring(100), Tolerance{0, 0.01}) );
+	CPPUNIT_ASSERT( !IsNegligible(FloatSemiring(0.1), *one, Tolerance{0, 0.01}) );
+	CPPUNIT_ASSERT( IsNegligible(FloatSemiring(0.015), *one, Tolerance{0.01, 0.01}) );
+}
+
+void FloatSemiringTest::testKeys()
+{
+	// == allows for rounding errors, but as keys only the same floats are equal
+	FloatSemiring rounded(std::nextafter(1.2f, 2.0f));
+	CPPUNIT_ASSERT( rounded == (*first) );
+	SemiringMap<FloatSemiring, int> keys;
+	keys.emplace(*first, 1);
+	keys.emplace(rounded, 2);
+	keys.emplace(FloatSemiring(1.2), 3);
+	CPPUNIT_ASSERT( keys.size() == 2 );
+	CPPUNIT_ASSERT( keys.at(FloatSemiring(1.2)) == 1 );
+	CPPUNIT_ASSERT( keys.at(rounded) == 2 );
+}
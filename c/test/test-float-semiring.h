@@ -10,6 +10,10 @@ class FloatSemiringTest : public CppUnit::TestFixture
 	CPPUNIT_TEST(testAddition);
 	CPPUNIT_TEST(testMultiplication);
 	CPPUNIT_TEST(testStar);
+	CPPUNIT_TEST(testMatrixMultiplication);
+	CPPUNIT_TEST(testMatrixStar);
+	CPPUNIT_TEST(testIsNegligible);
+	CPPUNIT_TEST(testKeys);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -20,6 +24,10 @@ protected:
 	void testAddition();
 	void testMultiplication();
 	void testStar();
+	void testMatrixMultiplication();
+	void testMatrixStar();
+	void testIsNegligible();
+	void testKeys();
 
 private:
 	FloatSemiring *null, *one, *first, *second;
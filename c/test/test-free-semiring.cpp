@@ -1,4 +1,15 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+
+#include <unistd.h>
+
 #include "test-free-semiring.h"
+#include "float-semiring.h"
+#include "float_batch_tape.h"
+#include "free-tape.h"
 
 CPPUNIT_TEST_SUITE_REGISTRATION(FreeSemiringTest);
 
@@ -7,6 +18,7 @@ void FreeSemiringTest::setUp()
 	a = new FreeSemiring(Var::getVar("a"));
 	b = new FreeSemiring(Var::getVar("b"));
 	c = new FreeSemiring(Var::getVar("c"));
+	tape_path.clear();
 }
 
 void FreeSemiringTest::tearDown()
@@ -14,6 +26,9 @@ void FreeSemiringTest::tearDown()
 	delete a;
 	delete b;
 	delete c;
+	// also if an assertion failed in between
+	if (!tape_path.empty())
+		std::remove(tape_path.c_str());
 }
 
 void FreeSemiringTest::testAddition()
@@ -51,3 +66,410 @@ void FreeSemiringTest::testStar()
         // corresponding constructor...
 	// CPPUNIT_ASSERT( a->star() == FreeSemiring(FreeSemiring::Star, *a));
 }
+
+void FreeSemiringTest::testTape()
+{
+	// shared subexpressions, the star of a matrix shares even more
+	FreeSemiring ab = (*a) * (*b);
+	Matrix<FreeSemiring> matrix{2, {ab + (*c), ab.star(), FreeSemiring::null(), (*c) * ab}};
+	Matrix<FreeSemiring> star = matrix.star();
+
+	std::unordered_map<VarPtr, FreeSemiring> valuation;
+	valuation.insert(std::make_pair(Var::getVar("a"), *b));
+	valuation.insert(std::make_pair(Var::getVar("b"), (*c) + FreeSemiring::one()));
+	valuation.insert(std::make_pair(Var::getVar("c"), a->star()));
+
+	FreeTape tape{star};
+	CPPUNIT_ASSERT( tape.GetVars().size() == 3 );
+
+	Matrix<FreeSemiring> expected = FreeSemiring_eval<FreeSemiring>(star, &valuation);
+	CPPUNIT_ASSERT( tape.Eval(valuation) == expected );
+
+	// evaluating again with the same storage gives the same result
+	std::vector<FreeSemiring> values;
+	CPPUNIT_ASSERT( tape.Eval(valuation, values) == expected );
+	CPPUNIT_ASSERT( tape.Eval(valuation, values) == expected );
+	CPPUNIT_ASSERT( values.size() == tape.GetSize() );
+}
+
+void FreeSemiringTest::testFoldedTape()
+{
+	// a and b are constants, only c changes
+	FreeSemiring ab = ((*a) + (*b)).star() * (*b);
+	Matrix<FreeSemiring> matrix{2, {ab, ab * (*c), (*c) + FreeSemiring::one(), (*a) * (*c)}};
+	Matrix<FreeSemiring> star = matrix.star();
+	FreeTape tape{star};
+
+	std::unordered_map<VarPtr, FreeSemiring> valuation;
+	valuation.insert(std::make_pair(Var::getVar("a"), *b));
+	valuation.insert(std::make_pair(Var::getVar("b"), b->star()));
+	valuation.insert(std::make_pair(Var::getVar("c"), *a));
+
+	FoldedTape<FreeSemiring> folded{tape, {Var::getVar("c")}, valuation};
+	CPPUNIT_ASSERT( folded.GetNumConstants() > 0 );
+	CPPUNIT_ASSERT( folded.GetSize() < tape.GetSize() );
+	CPPUNIT_ASSERT( folded.Eval(valuation) == tape.Eval(valuation) );
+
+	// changing the value of c (but not of the constants)
+	valuation[Var::getVar("c")] = (*a) + (*c);
+	CPPUNIT_ASSERT( folded.Eval(valuation) == tape.Eval(valuation) );
+	valuation[Var::getVar("c")] = FreeSemiring::null();
+	CPPUNIT_ASSERT( folded.Eval(valuation) == tape.Eval(valuation) );
+}
+
+void FreeSemiringTest::testUpdateTape()
+{
+	FreeSemiring ab = (*a) * (*b);
+	Matrix<FreeSemiring> matrix{2, {ab + (*c), (*a).star(), (*b) * (*c), (*c) + FreeSemiring::one()}};
+	FreeTape tape{matrix.star()};
+
+	std::unordered_map<VarPtr, FreeSemiring> valuation;
+	valuation.insert(std::make_pair(Var::getVar("a"), *b));
+	valuation.insert(std::make_pair(Var::getVar("b"), *c));
+	valuation.insert(std::make_pair(Var::getVar("c"), *a));
+
+	FoldedTape<FreeSemiring> folded{tape, {Var::getVar("a"), Var::getVar("b")}, valuation};
+	// the first update evaluates everything
+	CPPUNIT_ASSERT( folded.Update(valuation) == tape.Eval(valuation) );
+	// nothing changed
+	CPPUNIT_ASSERT( folded.Update(valuation) == tape.Eval(valuation) );
+	// only one of the variables changes
+	valuation[Var::getVar("a")] = (*a) + (*b);
+	CPPUNIT_ASSERT( folded.Update(valuation) == tape.Eval(valuation) );
+	valuation[Var::getVar("b")] = FreeSemiring::null();
+	CPPUNIT_ASSERT( folded.Update(valuation) == tape.Eval(valuation) );
+	// and back
+	valuation[Var::getVar("a")] = *b;
+	valuation[Var::getVar("b")] = *c;
+	CPPUNIT_ASSERT( folded.Update(valuation) == tape.Eval(valuation) );
+
+	// skipping the first row leaves it null and computes just the second one
+	// (also after it changed), making it live again has to recompute it
+	ThreadPool pool(2);
+	for (ThreadPool *eval_pool : {static_cast<ThreadPool*>(nullptr), &pool}) {
+		FoldedTape<FreeSemiring> skipping{tape, {Var::getVar("a"), Var::getVar("b")}, valuation};
+		Matrix<FreeSemiring> expected = tape.Eval(valuation);
+		skipping.SkipRows({1, 0});
+		Matrix<FreeSemiring> result = skipping.Update(valuation, eval_pool);
+		CPPUNIT_ASSERT( result.At(0, 0) == FreeSemiring::null() && result.At(0, 1) == FreeSemiring::null() );
+		CPPUNIT_ASSERT( result.At(1, 0) == expected.At(1, 0) && result.At(1, 1) == expected.At(1, 1) );
+		valuation[Var::getVar("a")] = (*a) + (*b);
+		expected = tape.Eval(valuation);
+		result = skipping.Update(valuation, eval_pool);
+		CPPUNIT_ASSERT( result.At(1, 0) == expected.At(1, 0) && result.At(1, 1) == expected.At(1, 1) );
+		skipping.SkipRows({0, 0});
+		CPPUNIT_ASSERT( skipping.Update(valuation, eval_pool) == expected );
+		valuation[Var::getVar("a")] = *b;
+	}
+}
+
+void FreeSemiringTest::testParallelTape()
+{
+	FreeSemiring one = FreeSemiring::one();
+	std::vector<FreeSemiring> elements;
+	for (int i = 0; i < 16; ++i) {
+		elements.push_back(i % 3 == 0 ? (*a) * (*b) : (i % 3 == 1 ? (*c) + one : (*b).star()));
+	}
+	Matrix<FreeSemiring> star = Matrix<FreeSemiring>{4, elements}.star();
+	FreeTape tape{star};
+
+	std::unordered_map<VarPtr, FreeSemiring> valuation;
+	valuation.insert(std::make_pair(Var::getVar("a"), *b));
+	valuation.insert(std::make_pair(Var::getVar("b"), (*c) + one));
+	valuation.insert(std::make_pair(Var::getVar("c"), *a));
+
+	ThreadPool pool(4);
+	Matrix<FreeSemiring> expected = FreeSemiring_eval<FreeSemiring>(star, &valuation);
+	CPPUNIT_ASSERT( tape.Eval(valuation, pool) == expected );
+	CPPUNIT_ASSERT( FreeSemiringMatrixEval(star, valuation, pool) == expected );
+
+	FoldedTape<FreeSemiring> folded{tape, {Var::getVar("a")}, valuation};
+	CPPUNIT_ASSERT( folded.Eval(valuation, &pool) == expected );
+	CPPUNIT_ASSERT( folded.Update(valuation, &pool) == expected );
+	valuation[Var::getVar("a")] = (*a) + (*c);
+	CPPUNIT_ASSERT( folded.Update(valuation, &pool) == tape.Eval(valuation) );
+	CPPUNIT_ASSERT( folded.Eval(valuation, &pool) == tape.Eval(valuation) );
+}
+
+void FreeSemiringTest::testTapeFile()
+{
+	// a is a coefficient (stored by its index), b and c by their positions
+	FreeSemiring ab = (*a) * (*b);
+	Matrix<FreeSemiring> star = Matrix<FreeSemiring>{2, {ab + (*c), ab.star(), FreeSemiring::null(), (*c) * (*a)}}.star();
+	FreeTape tape{star};
+	// a fresh file for every run, removed in tearDown
+	char name[] = "/tmp/test-free-semiring.XXXXXX";
+	int fd = mkstemp(name);
+	CPPUNIT_ASSERT( fd != -1 );
+	close(fd);
+	tape_path = name;
+	const std::string path = tape_path;
+	const std::vector<VarPtr> variables{Var::getVar("b"), Var::getVar("c")};
+	CPPUNIT_ASSERT( tape.Save(path, 42, {{Var::getVar("a"), 0}}, variables) );
+
+	// the coefficient gets a new variable
+	VarPtr coefficient = Var::getVar("tape_file_a");
+	std::unique_ptr<FreeTape> loaded = FreeTape::Load(path, 42, {coefficient}, variables);
+	CPPUNIT_ASSERT( loaded );
+	CPPUNIT_ASSERT( loaded->GetSize() == tape.GetSize() );
+
+	std::unordered_map<VarPtr, FreeSemiring> valuation;
+	valuation.insert(std::make_pair(Var::getVar("a"), *b));
+	valuation.insert(std::make_pair(Var::getVar("b"), (*c) + FreeSemiring::one()));
+	valuation.insert(std::make_pair(Var::getVar("c"), a->star()));
+	std::unordered_map<VarPtr, FreeSemiring> loaded_valuation{valuation};
+	loaded_valuation.insert(std::make_pair(coefficient, *b));
+	loaded_valuation.erase(Var::getVar("a"));
+	CPPUNIT_ASSERT( loaded->Eval(loaded_valuation) == tape.Eval(valuation) );
+
+	// wrong key, missing coefficient, missing variable and missing file
+	CPPUNIT_ASSERT( !FreeTape::Load(path, 43, {coefficient}, variables) );
+	CPPUNIT_ASSERT( !FreeTape::Load(path, 42, {}, variables) );
+	CPPUNIT_ASSERT( !FreeTape::Load(path, 42, {coefficient}, {Var::getVar("b")}) );
+	CPPUNIT_ASSERT( !FreeTape::Load(path + ".missing", 42, {coefficient}, variables) );
+
+	// a truncated file is rejected
+	std::string contents;
+	{
+		std::ifstream in{path, std::ifstream::binary};
+		contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+	{
+		std::ofstream out{path, std::ofstream::binary};
+		out.write(contents.data(), contents.size() - 1);
+	}
+	CPPUNIT_ASSERT( !FreeTape::Load(path, 42, {coefficient}, variables) );
+
+	// generated variables (e.g., for EBNF) are stored by their positions, so
+	// they can be loaded as other generated variables
+	const std::vector<VarPtr> generated_vars{Var::getVar(), Var::getVar()};
+	FreeSemiring x{generated_vars[0]};
+	FreeSemiring y{generated_vars[1]};
+	FreeTape generated{Matrix<FreeSemiring>{2, {x * y, x.star(), y + (*a), y * x}}.star()};
+	CPPUNIT_ASSERT( generated.Save(path, 42, {{Var::getVar("a"), 0}}, generated_vars) );
+	const std::vector<VarPtr> loaded_vars{Var::getVar(), Var::getVar()};
+	std::unique_ptr<FreeTape> loaded_generated = FreeTape::Load(path, 42, {coefficient}, loaded_vars);
+	CPPUNIT_ASSERT( loaded_generated );
+	std::unordered_map<VarPtr, FreeSemiring> generated_valuation;
+	generated_valuation.insert(std::make_pair(generated_vars[0], *b));
+	generated_valuation.insert(std::make_pair(generated_vars[1], (*c) + FreeSemiring::one()));
+	generated_valuation.insert(std::make_pair(Var::getVar("a"), c->star()));
+	std::unordered_map<VarPtr, FreeSemiring> loaded_generated_valuation;
+	loaded_generated_valuation.insert(std::make_pair(loaded_vars[0], *b));
+	loaded_generated_valuation.insert(std::make_pair(loaded_vars[1], (*c) + FreeSemiring::one()));
+	loaded_generated_valuation.insert(std::make_pair(coefficient, c->star()));
+	CPPUNIT_ASSERT( loaded_generated->Eval(loaded_generated_valuation) == generated.Eval(generated_valuation) );
+
+	// a variable that is neither a coefficient nor in the variables can't be stored
+	CPPUNIT_ASSERT( !generated.Save(path, 42, {}, generated_vars) );
+}
+
+void FreeSemiringTest::testBatchTape()
+{
+	std::vector<FreeSemiring> elements;
+	for (int i = 0; i < 9; ++i) {
+		elements.push_back(i % 3 == 0 ? (*a) * (*b) : (i % 3 == 1 ? (*c) + (*a) : (*b).star() * (*c)));
+	}
+	Matrix<FreeSemiring> star = Matrix<FreeSemiring>{2, {elements[0] + elements[1], elements[2],
+		elements[3] * elements[4], elements[5] + elements[6] * elements[7]}}.star();
+	FreeTape tape{star};
+	FloatBatchTape batch{tape};
+	CPPUNIT_ASSERT( batch.GetNumRegisters() < tape.GetSize() );
+
+	// enough lanes to have a tail after the vectorized part
+	const std::size_t lanes = 19;
+	std::unordered_map<VarPtr, std::vector<float> > valuations;
+	for (std::size_t lane = 0; lane < lanes; ++lane) {
+		valuations[Var::getVar("a")].push_back(0.01f * lane);
+		valuations[Var::getVar("b")].push_back(0.3f - 0.01f * lane);
+		valuations[Var::getVar("c")].push_back(0.05f + 0.002f * lane);
+	}
+	std::vector< Matrix<FloatSemiring> > results = batch.Eval(valuations);
+	CPPUNIT_ASSERT( results.size() == lanes );
+
+	for (std::size_t lane = 0; lane < lanes; ++lane) {
+		std::unordered_map<VarPtr, FloatSemiring> valuation;
+		for (const auto &var_values : valuations) {
+			valuation.insert(std::make_pair(var_values.first, FloatSemiring{var_values.second[lane]}));
+		}
+		Matrix<FloatSemiring> expected = tape.Eval(valuation);
+		CPPUNIT_ASSERT( results[lane].getRows() == 2 && results[lane].getColumns() == 2 );
+		for (std::size_t r = 0; r < 2; ++r) {
+			for (std::size_t c = 0; c < 2; ++c) {
+				CPPUNIT_ASSERT( results[lane].At(r, c).getValue() == expected.At(r, c).getValue() );
+			}
+		}
+	}
+}
+
+void FreeSemiringTest::testGC()
+{
+	FreeSemiring::GC();
+	std::size_t count = FreeSemiring::GetNodeCount();
+
+	FreeSemiring kept = (*a) * (*c) * (*a);
+	{
+		FreeSemiring x{Var::getVar("gc_x")};
+		FreeSemiring garbage = ((*a) * x + (*b)).star() * kept;
+		Matrix<FreeSemiring> matrix{2, {x, garbage, *a, *b}};
+		matrix = matrix.star();
+		CPPUNIT_ASSERT( FreeSemiring::GetNodeCount() > count + 2 );
+	}
+
+	// only the two multiplications of kept survive
+	CPPUNIT_ASSERT( FreeSemiring::GC() > 0 );
+	CPPUNIT_ASSERT( FreeSemiring::GetNodeCount() == count + 2 );
+
+	// and we still get the same nodes for them
+	CPPUNIT_ASSERT( kept == (*a) * (*c) * (*a) );
+	CPPUNIT_ASSERT( FreeSemiring::GetNodeCount() == count + 2 );
+
+	// moved-from handles don't keep anything alive
+	FreeSemiring moved = std::move(kept);
+	kept = FreeSemiring::one();
+	moved = FreeSemiring::null();
+	FreeSemiring::GC();
+	CPPUNIT_ASSERT( FreeSemiring::GetNodeCount() == count );
+}
+
+void FreeSemiringTest::testConcurrentFactory()
+{
+	std::vector<FreeSemiring> vars;
+	for (int i = 0; i < 64; ++i) {
+		vars.emplace_back(Var::getVar("concurrent_" + std::to_string(i)));
+	}
+
+	// every thread builds the same elements, but in a different order of the
+	// operands, which must still give exactly the same nodes
+	const int threads = 4;
+	std::vector< std::vector<FreeSemiring> > results(threads);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; ++t) {
+		workers.emplace_back([&vars, &results, t]() {
+			for (std::size_t i = 0; i + 2 < vars.size(); ++i) {
+				const FreeSemiring &x = vars[i];
+				const FreeSemiring &y = vars[i + 1];
+				const FreeSemiring &z = vars[i + 2];
+				FreeSemiring sum = t % 2 == 0 ? x + y : y + x;
+				results[t].push_back((sum * z).star() + FreeSemiring::SumOf({x, y, z}));
+			}
+		});
+	}
+	for (auto &worker : workers) {
+		worker.join();
+	}
+
+	for (int t = 1; t < threads; ++t) {
+		CPPUNIT_ASSERT( results[t] == results[0] );
+	}
+	CPPUNIT_ASSERT( results[0][0] == ((vars[1] + vars[0]) * vars[2]).star() + FreeSemiring::SumOf({vars[2], vars[0], vars[1]}) );
+}
+
+void FreeSemiringTest::testRewriteRules()
+{
+	FreeSemiring one = FreeSemiring::one();
+
+	// without any rules only the laws of all semirings are used
+	{
+		ScopedRewriteRules rules{RewriteRules{false, false}};
+		CPPUNIT_ASSERT( one + (*a) * a->star() == a->star() );
+		CPPUNIT_ASSERT( a->star() * (*a) + one == a->star() );
+		CPPUNIT_ASSERT( !((*a) + (*a) == (*a)) );
+		CPPUNIT_ASSERT( !(a->star().star() == a->star()) );
+		CPPUNIT_ASSERT( !((*a) * (*b) == (*b) * (*a)) );
+	}
+
+	{
+		ScopedRewriteRules rules{RewriteRules{true, true}};
+		CPPUNIT_ASSERT( (*a) + (*a) == (*a) );
+		CPPUNIT_ASSERT( a->star().star() == a->star() );
+		CPPUNIT_ASSERT( one.star() == one );
+		CPPUNIT_ASSERT( one + a->star() == a->star() );
+		CPPUNIT_ASSERT( a->star() + (*a) == a->star() );
+		CPPUNIT_ASSERT( (*a) * (*b) == (*b) * (*a) );
+		CPPUNIT_ASSERT( ((*a) * (*b) + (*c)) * (*c) == (*c) * ((*c) + (*b) * (*a)) );
+	}
+
+	// the rules are restored when the guard goes away
+	CPPUNIT_ASSERT( !((*a) * (*b) == (*b) * (*a)) );
+}
+
+void FreeSemiringTest::testNaryNodes()
+{
+	FreeSemiring one = FreeSemiring::one();
+	FreeSemiring zero = FreeSemiring::null();
+
+	// the nested sums and products are flattened, 0 and 1 are dropped
+	FreeSemiring sum = FreeSemiring::SumOf({*a, zero, FreeSemiring::SumOf({*b, *c, a->star()})});
+	CPPUNIT_ASSERT( sum == FreeSemiring::SumOf({a->star(), *c, *b, *a}) );
+	CPPUNIT_ASSERT( FreeSemiring::SumOf({zero, *a}) == (*a) );
+	CPPUNIT_ASSERT( FreeSemiring::SumOf({}) == zero );
+	FreeSemiring product = FreeSemiring::ProductOf({*a, one, FreeSemiring::ProductOf({*b, *b, *b})});
+	CPPUNIT_ASSERT( product == FreeSemiring::ProductOf({*a, *b, *b, *b}) );
+	CPPUNIT_ASSERT( !(product == FreeSemiring::ProductOf({*b, *b, *b, *a})) );
+	CPPUNIT_ASSERT( FreeSemiring::ProductOf({*a, zero, *b}) == zero );
+	CPPUNIT_ASSERT( FreeSemiring::ProductOf({}) == one );
+
+	// the balanced evaluation gives the same as folding from left to right
+	std::vector<FreeSemiring> factors{*a, *b, *b, *b, *b, *b, *c, *c, *a};
+	FreeSemiring folded = one;
+	for (const auto &factor : factors) {
+		folded *= factor;
+	}
+	FreeSemiring poly = FreeSemiring::SumOf({FreeSemiring::ProductOf(factors), product, *c, one});
+	FreeSemiring folded_poly = (((folded + product) + (*c)) + one);
+
+	std::unordered_map<VarPtr, FloatSemiring> valuation;
+	valuation.insert(std::make_pair(Var::getVar("a"), FloatSemiring{2}));
+	valuation.insert(std::make_pair(Var::getVar("b"), FloatSemiring{3}));
+	valuation.insert(std::make_pair(Var::getVar("c"), FloatSemiring{0.5}));
+	FloatSemiring expected{2 * 243 * 0.25 * 2 + 2 * 27 + 0.5 + 1};
+	CPPUNIT_ASSERT( poly.Eval(valuation) == expected );
+	CPPUNIT_ASSERT( folded_poly.Eval(valuation) == expected );
+
+	Matrix<FreeSemiring> matrix{1, {poly}};
+	FreeTape tape{matrix};
+	CPPUNIT_ASSERT( tape.Eval(valuation) == Matrix<FloatSemiring>(1, {expected}) );
+}
+
+void FreeSemiringTest::testOperandOrder()
+{
+	// two factories that create the same elements in the opposite order (so
+	// with the opposite ids) still have to order the operands the same
+	VarPtr p = Var::getVar("order_p");
+	VarPtr q = Var::getVar("order_q");
+	VarPtr r = Var::getVar("order_r");
+	NodeFactory forward;
+	NodeFactory backward;
+	forward.SetRewriteRules(RewriteRules{false, true});
+	backward.SetRewriteRules(RewriteRules{false, true});
+	std::vector<NodePtr> forward_elements{forward.NewElement(p), forward.NewElement(q), forward.NewElement(r)};
+	std::vector<NodePtr> backward_elements{backward.NewElement(r), backward.NewElement(q), backward.NewElement(p)};
+	std::reverse(backward_elements.begin(), backward_elements.end());
+	CPPUNIT_ASSERT( forward_elements[0]->GetId() < forward_elements[2]->GetId() );
+	CPPUNIT_ASSERT( backward_elements[0]->GetId() > backward_elements[2]->GetId() );
+
+	auto var_of = [](NodePtr node) {
+		return static_cast<const Element*>(node)->GetVar();
+	};
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			if (i == j) {
+				continue;
+			}
+			auto forward_addition = static_cast<const Addition*>(forward.NewAddition(forward_elements[i], forward_elements[j]));
+			auto backward_addition = static_cast<const Addition*>(backward.NewAddition(backward_elements[j], backward_elements[i]));
+			CPPUNIT_ASSERT( var_of(forward_addition->GetLhs()) == var_of(backward_addition->GetLhs()) );
+			auto forward_multiplication = static_cast<const Multiplication*>(forward.NewMultiplication(forward_elements[i], forward_elements[j]));
+			auto backward_multiplication = static_cast<const Multiplication*>(backward.NewMultiplication(backward_elements[j], backward_elements[i]));
+			CPPUNIT_ASSERT( var_of(forward_multiplication->GetLhs()) == var_of(backward_multiplication->GetLhs()) );
+			CPPUNIT_ASSERT( forward_multiplication->GetStructure() == backward_multiplication->GetStructure() );
+		}
+	}
+
+	auto forward_sum = static_cast<const Sum*>(forward.NewSum(forward_elements));
+	auto backward_sum = static_cast<const Sum*>(backward.NewSum(backward_elements));
+	for (std::size_t i = 0; i < 3; ++i) {
+		CPPUNIT_ASSERT( var_of(forward_sum->GetChildren()[i]) == var_of(backward_sum->GetChildren()[i]) );
+	}
+}
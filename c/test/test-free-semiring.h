@@ -11,6 +11,17 @@ class FreeSemiringTest : public CppUnit::TestFixture
 	CPPUNIT_TEST(testAddition);
 	CPPUNIT_TEST(testMultiplication);
 	CPPUNIT_TEST(testStar);
+	CPPUNIT_TEST(testTape);
+	CPPUNIT_TEST(testFoldedTape);
+	CPPUNIT_TEST(testUpdateTape);
+	CPPUNIT_TEST(testParallelTape);
+	CPPUNIT_TEST(testTapeFile);
+	CPPUNIT_TEST(testBatchTape);
+	CPPUNIT_TEST(testGC);
+	CPPUNIT_TEST(testConcurrentFactory);
+	CPPUNIT_TEST(testRewriteRules);
+	CPPUNIT_TEST(testNaryNodes);
+	CPPUNIT_TEST(testOperandOrder);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -21,9 +32,22 @@ protected:
 	void testAddition();
 	void testMultiplication();
 	void testStar();
+	void testTape();
+	void testFoldedTape();
+	void testUpdateTape();
+	void testParallelTape();
+	void testTapeFile();
+	void testBatchTape();
+	void testGC();
+	void testConcurrentFactory();
+	void testRewriteRules();
+	void testNaryNodes();
+	void testOperandOrder();
 
 private:
 	FreeSemiring *a, *b, *c;
+	// the file written by testTapeFile
+	std::string tape_path;
 };
 
 #endif
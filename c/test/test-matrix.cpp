@@ -1,3 +1,5 @@
+#include <cmath>
+
 #include "test-matrix.h"
 
 CPPUNIT_TEST_SUITE_REGISTRATION(MatrixTest);
@@ -95,3 +97,86 @@ void MatrixTest::testStar()
 			(((((*d * *n) + (*e * *p)) + (*f * *r)) + (((((*d * *m) + (*e * *o)) + (*f * *q)) * ((((*a * *m) + (*b * *o)) + (*c * *q)).star())) * (((*a * *n) + (*b * *p)) + (*c * *r)))).star())});
 	CPPUNIT_ASSERT( star == result );
 }
+
+void MatrixTest::testParallelStar()
+{
+	// the parallel star has to compute exactly the same as the serial one
+	std::vector<FreeSemiring> elements;
+	for(int idx = 0; idx < 7 * 7; ++idx)
+	{
+		std::stringstream ss;
+		ss << "v" << idx;
+		elements.push_back(FreeSemiring(Var::getVar(ss.str())));
+	}
+	Matrix<FreeSemiring> matrix(7, elements);
+
+	ThreadPool pool(4);
+	CPPUNIT_ASSERT( matrix.star(pool, 1) == matrix.star() );
+	CPPUNIT_ASSERT( matrix.star(pool, 3) == matrix.star() );
+	CPPUNIT_ASSERT( (*fourth).star(pool, 1) == (*fourth).star() );
+}
+
+void MatrixTest::testStarSolve()
+{
+	// upper triangular: x_1 = c* e, x_0 = a* d + a* b x_1
+	Matrix<FreeSemiring> upper(2,{
+			*a, *b,
+			FreeSemiring::null(), *c});
+	Matrix<FreeSemiring> rhs(2,{*d, *e});
+	Matrix<FreeSemiring> result(2,{
+			(a->star() * *d) + ((a->star() * *b) * (c->star() * *e)),
+			c->star() * *e});
+	CPPUNIT_ASSERT( upper.StarSolve(rhs) == result );
+
+	// in general the terms differ from star() * rhs, but they have the same value
+	Matrix<FreeSemiring> rhs2(3,{
+			*c, *d,
+			*e, *f,
+			*g, *h});
+	std::unordered_map<VarPtr, FloatSemiring> valuation;
+	valuation[Var::getVar("a")] = FloatSemiring(0.1);
+	valuation[Var::getVar("b")] = FloatSemiring(0.2);
+	valuation[Var::getVar("c")] = FloatSemiring(1);
+	valuation[Var::getVar("d")] = FloatSemiring(2);
+	valuation[Var::getVar("e")] = FloatSemiring(3);
+	valuation[Var::getVar("f")] = FloatSemiring(4);
+	valuation[Var::getVar("g")] = FloatSemiring(5);
+	valuation[Var::getVar("h")] = FloatSemiring(6);
+	Matrix<FloatSemiring> solved = FreeSemiring_eval<FloatSemiring>((*fourth).StarSolve(rhs2), &valuation);
+	Matrix<FloatSemiring> multiplied = FreeSemiring_eval<FloatSemiring>((*fourth).star() * rhs2, &valuation);
+	for(std::size_t r = 0; r < 3; ++r)
+		for(std::size_t c = 0; c < 2; ++c)
+			CPPUNIT_ASSERT( std::fabs(solved.At(r, c).getValue() - multiplied.At(r, c).getValue()) <= 1e-5 * multiplied.At(r, c).getValue() );
+}
+
+void MatrixTest::testFloydWarshall()
+{
+	std::vector<FreeSemiring> elements;
+	std::unordered_map<VarPtr, FloatSemiring> valuation;
+	for(int idx = 0; idx < 7 * 7; ++idx)
+	{
+		std::stringstream ss;
+		ss << "w" << idx;
+		elements.push_back(FreeSemiring(Var::getVar(ss.str())));
+		valuation[Var::getVar(ss.str())] = FloatSemiring(0.01 * (idx % 5));
+	}
+	Matrix<FreeSemiring> matrix(7, elements);
+
+	// the parallel version has to compute exactly the same terms as the serial
+	// one with the same tiles (with tiles of 2 and 3 every phase has several)
+	ThreadPool pool(4);
+	CPPUNIT_ASSERT( matrix.star2(pool, 64) == matrix.star2() );
+	for(std::size_t tile_size : {2, 3})
+		CPPUNIT_ASSERT( matrix.star2(pool, tile_size) == matrix.star2(tile_size) );
+
+	// with different tile sizes the terms differ, but the values are the same
+	Matrix<FloatSemiring> expected = FreeSemiring_eval<FloatSemiring>(matrix.star(), &valuation);
+	std::vector<Matrix<FreeSemiring>> stars = {matrix.star2(), matrix.star2(pool, 1), matrix.star2(pool, 3)};
+	for(auto &star : stars)
+	{
+		Matrix<FloatSemiring> value = FreeSemiring_eval<FloatSemiring>(star, &valuation);
+		for(std::size_t r = 0; r < 7; ++r)
+			for(std::size_t c = 0; c < 7; ++c)
+				CPPUNIT_ASSERT( std::fabs(value.At(r, c).getValue() - expected.At(r, c).getValue()) <= 1e-5 * expected.At(r, c).getValue() );
+	}
+}
@@ -3,6 +3,7 @@
 
 #include <cppunit/extensions/HelperMacros.h>
 
+#include "float-semiring.h"
 #include "free-semiring.h"
 #include "matrix.h"
 
@@ -13,6 +14,9 @@ class MatrixTest : public CppUnit::TestFixture
 	CPPUNIT_TEST(testAddition);
 	CPPUNIT_TEST(testMultiplication);
 	CPPUNIT_TEST(testStar);
+	CPPUNIT_TEST(testParallelStar);
+	CPPUNIT_TEST(testStarSolve);
+	CPPUNIT_TEST(testFloydWarshall);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -23,6 +27,9 @@ protected:
 	void testAddition();
 	void testMultiplication();
 	void testStar();
+	void testParallelStar();
+	void testStarSolve();
+	void testFloydWarshall();
 
 private:
 	FreeSemiring *a, *b, *c, *d, *e, *f, *g, *h, *i, *j, *k, *l, *m, *n, *o, *p, *q, *r;
@@ -0,0 +1,153 @@
+#include <cmath>
+#include "test-newton.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(NewtonTest);
+
+typedef std::vector< std::pair< VarPtr, Polynomial<FloatSemiring> > > FloatEquations;
+
+void NewtonTest::setUp()
+{
+	x = Var::getVar("newton_x");
+	y = Var::getVar("newton_y");
+	z = Var::getVar("newton_z");
+}
+
+void NewtonTest::tearDown()
+{
+}
+
+void NewtonTest::testFreezing()
+{
+	// x = a, y = b y + x is linear, so Newton has the fixpoint after the first
+	// step, the second one doesn't change anything and freezes everything
+	CommutativeRExp a{Var::getVar("a")};
+	CommutativeRExp b{Var::getVar("b")};
+	std::vector< std::pair< VarPtr, Polynomial<CommutativeRExp> > > equations{
+		{x, Polynomial<CommutativeRExp>{{a, {}}}},
+		{y, Polynomial<CommutativeRExp>{{b, {y}}, {CommutativeRExp::one(), {x}}}}};
+
+	Newton<CommutativeRExp> newton;
+	std::map<VarPtr, CommutativeRExp> result = newton.solve_fixpoint(equations, 10);
+	CPPUNIT_ASSERT( newton.GetIterations() < 10 );
+
+	// with a single iteration there is nothing to freeze
+	Newton<CommutativeRExp> single;
+	CPPUNIT_ASSERT( result == single.solve_fixpoint(equations, 1) );
+	CPPUNIT_ASSERT( single.GetIterations() == 1 );
+}
+
+void NewtonTest::testPartialFreezing()
+{
+	// x = a freezes after the second step, while z = c z^2 + x keeps changing
+	// (its regular expression only grows), so x must keep its value and z must
+	// be the same as in z = c z^2 + a (where there is nothing else to freeze)
+	CommutativeRExp a{Var::getVar("a")};
+	CommutativeRExp c{Var::getVar("c")};
+	std::vector< std::pair< VarPtr, Polynomial<CommutativeRExp> > > rexp_with_x{
+		{x, Polynomial<CommutativeRExp>{{a, {}}}},
+		{z, Polynomial<CommutativeRExp>{{c, {z, z}}, {CommutativeRExp::one(), {x}}}}};
+	std::vector< std::pair< VarPtr, Polynomial<CommutativeRExp> > > rexp_without_x{
+		{z, Polynomial<CommutativeRExp>{{c, {z, z}}, {a, {}}}}};
+
+	// (the frozen rows are skipped in every StarMode)
+	for (StarMode mode : {StarMode::kFull, StarMode::kSolve}) {
+		for (int max_iter = 1; max_iter <= 5; ++max_iter) {
+			Newton<CommutativeRExp> newton_with_x{nullptr, 0, mode};
+			Newton<CommutativeRExp> newton_without_x{nullptr, 0, mode};
+			std::map<VarPtr, CommutativeRExp> result = newton_with_x.solve_fixpoint(rexp_with_x, max_iter);
+			CPPUNIT_ASSERT( result[x] == a );
+			CPPUNIT_ASSERT( result[z] == newton_without_x.solve_fixpoint(rexp_without_x, max_iter)[z] );
+		}
+	}
+
+	// the same for x = 1/2 and z = 1/4 z^2 + x, where z converges after a few
+	// steps and then we stop
+	FloatEquations float_with_x{
+		{x, Polynomial<FloatSemiring>{{FloatSemiring{0.5}, {}}}},
+		{z, Polynomial<FloatSemiring>{{FloatSemiring{0.25}, {z, z}}, {FloatSemiring::one(), {x}}}}};
+	FloatEquations float_without_x{
+		{z, Polynomial<FloatSemiring>{{FloatSemiring{0.25}, {z, z}}, {FloatSemiring{0.5}, {}}}}};
+
+	for (StarMode mode : {StarMode::kFull, StarMode::kSolve, StarMode::kNumeric}) {
+		for (int max_iter = 1; max_iter <= 6; ++max_iter) {
+			Newton<FloatSemiring> newton_with_x{nullptr, 0, mode};
+			Newton<FloatSemiring> newton_without_x{nullptr, 0, mode};
+			std::map<VarPtr, FloatSemiring> result = newton_with_x.solve_fixpoint(float_with_x, max_iter);
+			CPPUNIT_ASSERT( result[x] == FloatSemiring{0.5} );
+			CPPUNIT_ASSERT( result[z] == newton_without_x.solve_fixpoint(float_without_x, max_iter)[z] );
+			CPPUNIT_ASSERT( newton_with_x.GetIterations() == newton_without_x.GetIterations() );
+		}
+	}
+}
+
+void NewtonTest::testTolerance()
+{
+	FloatEquations equations{
+		{z, Polynomial<FloatSemiring>{{FloatSemiring{0.25}, {z, z}}, {FloatSemiring{0.5}, {}}}}};
+
+	// with the default tolerance we stop only once the updates are 0
+	Newton<FloatSemiring> exact;
+	float expected = exact.solve_fixpoint(equations, 100)[z].getValue();
+	CPPUNIT_ASSERT( exact.GetIterations() < 100 );
+
+	Tolerance tolerance{1e-3, 1e-3};
+	Newton<FloatSemiring> newton{nullptr, 0, StarMode::kFull, "", tolerance};
+	float value = newton.solve_fixpoint(equations, 100)[z].getValue();
+	CPPUNIT_ASSERT( newton.GetIterations() < exact.GetIterations() );
+	CPPUNIT_ASSERT( std::fabs(value - expected) <= tolerance.absolute + tolerance.relative * expected );
+}
+
+void NewtonTest::testStarSolve()
+{
+	// a chain x_i = 1/4 x_i x_{i+1} + 1/2 has a sparse Jacobian, x = 1/4 y^2 +
+	// 1/4, y = 1/4 x y + 1/4 x + 1/2 a dense one, for both solving (with and
+	// without a pool) has to give the same as the whole star
+	FloatEquations sparse;
+	const int size = 30;
+	std::vector<VarPtr> chain;
+	for (int i = 0; i < size; ++i) {
+		chain.push_back(Var::getVar("newton_chain_" + std::to_string(i)));
+	}
+	for (int i = 0; i < size; ++i) {
+		Polynomial<FloatSemiring> polynomial{{FloatSemiring{0.5}, {}}};
+		if (i + 1 < size) {
+			polynomial = Polynomial<FloatSemiring>{{FloatSemiring{0.25}, {chain[i], chain[i + 1]}}, {FloatSemiring{0.5}, {}}};
+		}
+		sparse.push_back({chain[i], polynomial});
+	}
+	FloatEquations dense{
+		{x, Polynomial<FloatSemiring>{{FloatSemiring{0.25}, {y, y}}, {FloatSemiring{0.25}, {}}}},
+		{y, Polynomial<FloatSemiring>{{FloatSemiring{0.25}, {x, y}}, {FloatSemiring{0.25}, {x}}, {FloatSemiring{0.5}, {}}}}};
+
+	ThreadPool pool(4);
+	for (const FloatEquations &equations : {sparse, dense}) {
+		Newton<FloatSemiring> full;
+		std::map<VarPtr, FloatSemiring> expected = full.solve_fixpoint(equations, 8);
+		for (ThreadPool *solve_pool : {static_cast<ThreadPool*>(nullptr), &pool}) {
+			Newton<FloatSemiring> solve{solve_pool, 1, StarMode::kSolve};
+			std::map<VarPtr, FloatSemiring> result = solve.solve_fixpoint(equations, 8);
+			for (const auto &equation : equations) {
+				CPPUNIT_ASSERT( std::fabs(result[equation.first].getValue() - expected[equation.first].getValue()) <= 1e-5f * expected[equation.first].getValue() );
+			}
+		}
+	}
+}
+
+void NewtonTest::testNumeric()
+{
+	// x = 1/4 y^2 + 1/4, y = 1/4 x y + 1/4 x + 1/2, z = 1/2 z x + 1/4 (z does
+	// not occur in the others, so some entries of the Jacobian are null), the
+	// numeric steps have to give the same as the whole star
+	FloatEquations equations{
+		{x, Polynomial<FloatSemiring>{{FloatSemiring{0.25}, {y, y}}, {FloatSemiring{0.25}, {}}}},
+		{y, Polynomial<FloatSemiring>{{FloatSemiring{0.25}, {x, y}}, {FloatSemiring{0.25}, {x}}, {FloatSemiring{0.5}, {}}}},
+		{z, Polynomial<FloatSemiring>{{FloatSemiring{0.5}, {z, x}}, {FloatSemiring{0.25}, {}}}}};
+
+	Newton<FloatSemiring> full;
+	std::map<VarPtr, FloatSemiring> expected = full.solve_fixpoint(equations, 8);
+	Newton<FloatSemiring> numeric{nullptr, 1, StarMode::kNumeric};
+	std::map<VarPtr, FloatSemiring> result = numeric.solve_fixpoint(equations, 8);
+	for (const auto &equation : equations) {
+		CPPUNIT_ASSERT( std::fabs(result[equation.first].getValue() - expected[equation.first].getValue()) <= 1e-5f * expected[equation.first].getValue() );
+	}
+}
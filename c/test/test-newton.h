@@ -0,0 +1,35 @@
+#ifndef TEST_NEWTON_H
+#define TEST_NEWTON_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "../src/commutativeRExp.h"
+#include "../src/float-semiring.h"
+#include "../src/newton.h"
+
+class NewtonTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(NewtonTest);
+	CPPUNIT_TEST(testFreezing);
+	CPPUNIT_TEST(testPartialFreezing);
+	CPPUNIT_TEST(testTolerance);
+	CPPUNIT_TEST(testStarSolve);
+	CPPUNIT_TEST(testNumeric);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+protected:
+	void testFreezing();
+	void testPartialFreezing();
+	void testTolerance();
+	void testStarSolve();
+	void testNumeric();
+
+private:
+	VarPtr x, y, z;
+};
+
+#endif
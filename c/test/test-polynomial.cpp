@@ -3,6 +3,7 @@
 #include <map>
 
 #include "../src/matrix.h"
+#include "../src/polynomial_plan.h"
 #include "test-polynomial.h"
 
 CPPUNIT_TEST_SUITE_REGISTRATION(PolynomialTest);
@@ -96,15 +97,49 @@ void PolynomialTest::testJacobian() {
   Matrix<Polynomial<FreeSemiring> > result = Matrix<Polynomial<FreeSemiring> >(2,polys2);
 
   CPPUNIT_ASSERT( Polynomial<FreeSemiring>::jacobian(polys, vars) == result );
+  CPPUNIT_ASSERT( Polynomial<FreeSemiring>::sparse_jacobian(polys, vars).ToDense() == result );
 
   polys = {*p1};
   vars = {Var::getVar("x")};
   polys2 = { Polynomial<FreeSemiring>({ {*a+*b, {}} }) };
   result = Matrix<Polynomial<FreeSemiring> >(1,polys2);
   CPPUNIT_ASSERT( Polynomial<FreeSemiring>::jacobian(polys, vars) == result );
+  CPPUNIT_ASSERT( Polynomial<FreeSemiring>::sparse_jacobian(polys, vars).ToDense() == result );
 
 }
 
+void PolynomialTest::testHigherOrderTerms() {
+  // (c*xx+d*xy+e*yy) * (a*xx+b*z), z is not differentiated
+  Polynomial<FreeSemiring> poly = (*second) * (*first);
+  std::vector<VarPtr> vars = {Var::getVar("x"), Var::getVar("y")};
+  std::vector<VarPtr> values = {Var::getVar("v_x"), Var::getVar("v_y")};
+  std::vector<VarPtr> deltas = {Var::getVar("d_x"), Var::getVar("d_y")};
+  std::map<VarPtr, VarPtr> mapping = {{vars[0], values[0]}, {vars[1], values[1]}};
+
+  // go through all the derivatives up to the degree
+  Polynomial<FreeSemiring> expected = Polynomial<FreeSemiring>::null();
+  for (int x = 0; x <= 4; ++x) {
+    for (int y = 0; y <= 4 - x; ++y) {
+      if (x + y < 2) {
+        continue;
+      }
+      std::vector<VarPtr> dx;
+      Polynomial<FreeSemiring> prod = Polynomial<FreeSemiring>::one();
+      for (int i = 0; i < x; ++i) {
+        dx.push_back(vars[0]);
+        prod *= deltas[0];
+      }
+      for (int i = 0; i < y; ++i) {
+        dx.push_back(vars[1]);
+        prod *= deltas[1];
+      }
+      expected = expected + poly.derivative(dx).subst(mapping) * prod;
+    }
+  }
+  CPPUNIT_ASSERT( poly.HigherOrderTerms(vars, values, deltas, 2) == expected );
+  CPPUNIT_ASSERT( first->HigherOrderTerms({Var::getVar("z")}, {values[0]}, {deltas[0]}, 2) == *null );
+}
+
 void PolynomialTest::testEvaluation() {
   std::map<VarPtr,FreeSemiring> values = {
     { Var::getVar("x"), FreeSemiring(Var::getVar("a")) },
@@ -129,9 +164,24 @@ void PolynomialTest::testEvaluation() {
 
 void PolynomialTest::testMatrixEvaluation() { }
 
+void PolynomialTest::testPlan() {
+  std::vector<VarPtr> vars = {Var::getVar("x"), Var::getVar("y"), Var::getVar("z")};
+  PolynomialPlan<FreeSemiring> plan{{*first, *second, *null, *one}, vars};
+  // x, xx, xy, y, yy and z (in some order), the products are shared
+  CPPUNIT_ASSERT( plan.GetNumProducts() == 6 );
+
+  std::map<VarPtr, FreeSemiring> values = {
+    { vars[0], *a + *b },
+    { vars[1], c->star() },
+    { vars[2], *d }
+  };
+  Matrix<Polynomial<FreeSemiring> > polys{4, {*first, *second, *null, *one}};
+  CPPUNIT_ASSERT( plan.Eval({*a + *b, c->star(), *d}) == Polynomial<FreeSemiring>::eval(polys, values) );
+}
+
 void PolynomialTest::testPolynomialToFreeSemiring() {
   // auto valuation = new std::unordered_map<FreeSemiring, FreeSemiring, FreeSemiring>();
-  std::unordered_map<FreeSemiring, VarPtr, FreeSemiring> valuation;
+  SemiringMap<FreeSemiring, VarPtr> valuation;
   FreeSemiring elem = second->make_free(&valuation);
   //std::cout << "poly2free: " << std::endl << (*second) << " → " << elem << std::endl;
   std::unordered_map<VarPtr, FreeSemiring> r_valuation;
@@ -156,4 +206,10 @@ void PolynomialTest::testPolynomialToFreeSemiring() {
   //std::cout << "evaluated: " << eval_elem << " vs. " << eval_elem2 << std::endl;
 
   CPPUNIT_ASSERT( eval_elem == eval_elem2 );
+
+  // converting again (with a new valuation) reuses the same variables for the
+  // coefficients
+  SemiringMap<FreeSemiring, VarPtr> new_valuation;
+  CPPUNIT_ASSERT( second->make_free(&new_valuation) == elem );
+  CPPUNIT_ASSERT( new_valuation == valuation );
 }
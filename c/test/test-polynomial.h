@@ -12,8 +12,10 @@ class PolynomialTest : public CppUnit::TestFixture
 	CPPUNIT_TEST(testAddition);
 	CPPUNIT_TEST(testMultiplication);
 	CPPUNIT_TEST(testJacobian);
+	CPPUNIT_TEST(testHigherOrderTerms);
 	CPPUNIT_TEST(testEvaluation);
 	CPPUNIT_TEST(testMatrixEvaluation);
+	CPPUNIT_TEST(testPlan);
 //	CPPUNIT_TEST(testPolynomialToFreeSemiring);
 	CPPUNIT_TEST_SUITE_END();
 
@@ -25,8 +27,10 @@ protected:
 	void testAddition();
 	void testMultiplication();
 	void testJacobian();
+	void testHigherOrderTerms();
 	void testEvaluation();
 	void testMatrixEvaluation();
+	void testPlan();
 	void testPolynomialToFreeSemiring();
 
 private:
@@ -6,6 +6,8 @@
  */
 
 #include "test-semilinSetExp.h"
+#include "free-tape.h"
+#include "thread_pool.h"
 
 CPPUNIT_TEST_SUITE_REGISTRATION(SemilinSetExpTest);
 
@@ -24,6 +26,23 @@ void SemilinSetExpTest::tearDown()
 	delete c;
 }
 
+void SemilinSetExpTest::testHash()
+{
+	SemilinSetExp a = *this->a;
+	SemilinSetExp b = *this->b;
+	SemilinSetExp c = *this->c;
+	std::hash<SemilinSetExp> h;
+
+	// the stored hash has to follow every way of building a set
+	CPPUNIT_ASSERT( h((a*b + c) + (c + b*a)) == h(a*b + c) );
+	CPPUNIT_ASSERT( h((a*b).star()) == h((b*a).star()) );
+	SemilinSetExp acc = c;
+	AddMul(acc, a, b);
+	CPPUNIT_ASSERT( acc == a*b + c );
+	CPPUNIT_ASSERT( h(acc) == h(a*b + c) );
+	CPPUNIT_ASSERT( !(acc == c) );
+}
+
 void SemilinSetExpTest::testTerms()
 {
 /*	(a+(b.c+c.b).(a.b + c + b.a)*) = a + (b.c).(ab + c)*
@@ -82,3 +101,33 @@ void SemilinSetExpTest::testStar()
 
 
 }
+
+void SemilinSetExpTest::testParallelTape()
+{
+	// the workers create new linear sets (and vectors) at the same time
+	std::vector<VarPtr> vars;
+	std::vector<FreeSemiring> elements;
+	for (int i = 0; i < 9; ++i) {
+		std::stringstream name;
+		name << "sl_tape_" << i % 3;
+		vars.push_back(Var::getVar(name.str()));
+		FreeSemiring var{vars.back()};
+		elements.push_back(i % 3 == 0 ? FreeSemiring::null() : (i % 3 == 1 ? var : var * var + FreeSemiring::one()));
+	}
+	FreeTape tape{Matrix<FreeSemiring>{3, elements}.star()};
+
+	ThreadPool pool(4);
+	for (int round = 0; round < 3; ++round) {
+		// new values in every round, so there is always something to create
+		std::unordered_map<VarPtr, SemilinSetExp> valuation;
+		for (int i = 0; i < 3; ++i) {
+			SemilinSetExp value = *a;
+			for (int j = 0; j < round + i; ++j) {
+				value *= (j % 2 == 0) ? *b : *c;
+			}
+			valuation[vars[i]] = value + *c;
+		}
+		Matrix<SemilinSetExp> parallel = tape.Eval(valuation, pool);
+		CPPUNIT_ASSERT( parallel == tape.Eval(valuation) );
+	}
+}
@@ -24,6 +24,8 @@ class SemilinSetExpTest : public CppUnit::TestFixture
 	CPPUNIT_TEST(testMultiplication);
 	CPPUNIT_TEST(testStar);
 	CPPUNIT_TEST(testTerms);
+	CPPUNIT_TEST(testHash);
+	CPPUNIT_TEST(testParallelTape);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -35,6 +37,8 @@ protected:
 	void testMultiplication();
 	void testStar();
 	void testTerms();
+	void testHash();
+	void testParallelTape();
 
 private:
 	SemilinSetExp *a, *b, *c;
@@ -0,0 +1,99 @@
+#include "test-sparse-matrix.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SparseMatrixTest);
+
+void SparseMatrixTest::setUp()
+{
+	a = new FreeSemiring(Var::getVar("a"));b = new FreeSemiring(Var::getVar("b"));
+	c = new FreeSemiring(Var::getVar("c"));d = new FreeSemiring(Var::getVar("d"));
+	e = new FreeSemiring(Var::getVar("e"));f = new FreeSemiring(Var::getVar("f"));
+	FreeSemiring z = FreeSemiring::null();
+	first = new Matrix<FreeSemiring>(4,{
+			 z, *a,  z,  z,
+			 z,  z, *b,  z,
+			*c,  z,  z, *d,
+			 z,  z,  z,  z});
+	second = new Matrix<FreeSemiring>(4,{
+			*e,  z,  z,  z,
+			 z,  z,  z, *f,
+			 z, *a,  z,  z,
+			 z,  z, *b,  z});
+	third = new Matrix<FreeSemiring>(5,{
+			 z, *a,  z,  z,  z,
+			 z,  z, *b,  z,  z,
+			 z,  z,  z, *c,  z,
+			 z,  z,  z,  z, *d,
+			*e,  z,  z,  z, *f});
+}
+
+void SparseMatrixTest::tearDown()
+{
+	delete first;
+	delete second;
+	delete third;
+	delete a;delete b;delete c;delete d;delete e;delete f;
+}
+
+void SparseMatrixTest::testConversion()
+{
+	SparseMatrix<FreeSemiring> sparse(*first);
+	CPPUNIT_ASSERT( sparse.GetNonNulls() == 4 );
+	CPPUNIT_ASSERT( sparse.ToDense() == *first );
+	CPPUNIT_ASSERT( SparseMatrix<FreeSemiring>(4, 4).ToDense() == Matrix<FreeSemiring>::null(4) );
+}
+
+void SparseMatrixTest::testAddition()
+{
+	SparseMatrix<FreeSemiring> sum = SparseMatrix<FreeSemiring>(*first) + SparseMatrix<FreeSemiring>(*second);
+	CPPUNIT_ASSERT( sum.ToDense() == *first + *second );
+}
+
+void SparseMatrixTest::testMultiplication()
+{
+	SparseMatrix<FreeSemiring> product = SparseMatrix<FreeSemiring>(*first) * SparseMatrix<FreeSemiring>(*second);
+	CPPUNIT_ASSERT( product.ToDense() == *first * *second );
+	CPPUNIT_ASSERT( SparseMatrix<FreeSemiring>(*first) * *second == *first * *second );
+}
+
+void SparseMatrixTest::testStar()
+{
+	// skipping the null entries must not change the result
+	CPPUNIT_ASSERT( SparseMatrix<FreeSemiring>(*first).star().ToDense() == first->star() );
+	CPPUNIT_ASSERT( SparseMatrix<FreeSemiring>(*second).star().ToDense() == second->star() );
+	CPPUNIT_ASSERT( SparseMatrix<FreeSemiring>(*third).star().ToDense() == third->star() );
+
+	// and neither must computing the blocks (sparse and dense) in parallel
+	ThreadPool pool(4);
+	CPPUNIT_ASSERT( SparseMatrix<FreeSemiring>(*first).star(0.5, &pool, 1).ToDense() == first->star() );
+	CPPUNIT_ASSERT( SparseMatrix<FreeSemiring>(*third).star(0.5, &pool, 1).ToDense() == third->star() );
+}
+
+void SparseMatrixTest::testStarSolve()
+{
+	// skipping the null entries must not change the result of the elimination
+	ThreadPool pool(4);
+	Matrix<FreeSemiring> rhs4(4, {*a, *b, *c, *d, *e, *f, *a, FreeSemiring::null()});
+	Matrix<FreeSemiring> rhs5(5, {*a, *b, *c, *d, *e});
+	CPPUNIT_ASSERT( SparseMatrix<FreeSemiring>(*first).StarSolve(rhs4) == first->StarSolve(rhs4) );
+	CPPUNIT_ASSERT( SparseMatrix<FreeSemiring>(*second).StarSolve(rhs4) == second->StarSolve(rhs4) );
+	CPPUNIT_ASSERT( SparseMatrix<FreeSemiring>(*third).StarSolve(rhs5) == third->StarSolve(rhs5) );
+	CPPUNIT_ASSERT( SparseMatrix<FreeSemiring>(*third).StarSolve(rhs5, &pool) == third->StarSolve(rhs5) );
+
+	// a larger one, where the elimination fills in many entries and updates
+	// many rows in every step
+	const std::size_t size = 16;
+	FreeSemiring vars[] = {*a, *b, *c, *d, *e, *f};
+	std::vector<FreeSemiring> elements;
+	std::vector<FreeSemiring> rhs_elements;
+	for (std::size_t r = 0; r < size; ++r) {
+		for (std::size_t c = 0; c < size; ++c) {
+			bool non_null = (r * 7 + c * 3) % 5 == 0 || c == (r + 1) % size;
+			elements.push_back(non_null ? vars[(r + c) % 6] : FreeSemiring::null());
+		}
+		rhs_elements.push_back(vars[r % 6]);
+	}
+	Matrix<FreeSemiring> matrix(size, elements);
+	Matrix<FreeSemiring> rhs(size, rhs_elements);
+	CPPUNIT_ASSERT( SparseMatrix<FreeSemiring>(matrix).StarSolve(rhs) == matrix.StarSolve(rhs) );
+	CPPUNIT_ASSERT( SparseMatrix<FreeSemiring>(matrix).StarSolve(rhs, &pool) == matrix.StarSolve(rhs) );
+}
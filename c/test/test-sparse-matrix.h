@@ -0,0 +1,37 @@
+#ifndef TEST_SPARSE_MATRIX_H
+#define TEST_SPARSE_MATRIX_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "free-semiring.h"
+#include "matrix.h"
+#include "sparse_matrix.h"
+
+
+class SparseMatrixTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(SparseMatrixTest);
+	CPPUNIT_TEST(testConversion);
+	CPPUNIT_TEST(testAddition);
+	CPPUNIT_TEST(testMultiplication);
+	CPPUNIT_TEST(testStar);
+	CPPUNIT_TEST(testStarSolve);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+protected:
+	void testConversion();
+	void testAddition();
+	void testMultiplication();
+	void testStar();
+	void testStarSolve();
+
+private:
+	FreeSemiring *a, *b, *c, *d, *e, *f;
+	Matrix<FreeSemiring> *first, *second, *third;
+};
+
+#endif
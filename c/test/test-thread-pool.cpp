@@ -0,0 +1,77 @@
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "test-thread-pool.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ThreadPoolTest);
+
+void ThreadPoolTest::setUp()
+{
+}
+
+void ThreadPoolTest::tearDown()
+{
+}
+
+void ThreadPoolTest::testParallelFor()
+{
+	ThreadPool pool(4);
+	std::vector<int> values(1000, 0);
+	pool.ParallelFor(0, values.size(), [&values](std::size_t i) { values[i] = i; });
+	for (std::size_t i = 0; i < values.size(); ++i) {
+		CPPUNIT_ASSERT( values[i] == static_cast<int>(i) );
+	}
+
+	// the waiting thread sleeps while another one runs a long task
+	std::atomic<int> done{0};
+	pool.Invoke([&done]() { ++done; },
+	            [&done]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		++done;
+	});
+	CPPUNIT_ASSERT( done == 2 );
+}
+
+void ThreadPoolTest::testExceptions()
+{
+	ThreadPool pool(4);
+
+	// an exception of g is rethrown by Invoke
+	bool f_done = false;
+	bool caught = false;
+	try {
+		pool.Invoke([&f_done]() { f_done = true; },
+		            []() { throw std::runtime_error("g"); });
+	} catch (const std::runtime_error &e) {
+		caught = std::string(e.what()) == "g";
+	}
+	CPPUNIT_ASSERT( f_done && caught );
+
+	// if f throws, g is either taken back or done before Invoke rethrows
+	for (int i = 0; i < 20; ++i) {
+		std::atomic<int> g_state{0};
+		caught = false;
+		try {
+			pool.Invoke([]() {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				throw std::runtime_error("f");
+			}, [&g_state]() {
+				g_state = 1;
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+				g_state = 2;
+			});
+		} catch (const std::runtime_error &e) {
+			caught = std::string(e.what()) == "f";
+		}
+		CPPUNIT_ASSERT( caught );
+		CPPUNIT_ASSERT( g_state != 1 );
+	}
+
+	// and the pool still works
+	std::atomic<int> sum{0};
+	pool.ParallelFor(0, 100, [&sum](std::size_t i) { sum += i; });
+	CPPUNIT_ASSERT( sum == 4950 );
+}
@@ -0,0 +1,24 @@
+#ifndef TEST_THREAD_POOL_H
+#define TEST_THREAD_POOL_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "../src/thread_pool.h"
+
+class ThreadPoolTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(ThreadPoolTest);
+	CPPUNIT_TEST(testParallelFor);
+	CPPUNIT_TEST(testExceptions);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+protected:
+	void testParallelFor();
+	void testExceptions();
+};
+
+#endif
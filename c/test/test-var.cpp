@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <thread>
+#include <vector>
+
 #include "test-var.h"
 
 CPPUNIT_TEST_SUITE_REGISTRATION(VarTest);
@@ -19,3 +23,55 @@ void VarTest::testIdentity()
 	CPPUNIT_ASSERT( a == newA );
 	CPPUNIT_ASSERT( a != b );
 }
+
+void VarTest::testIds()
+{
+	VarPtr a = Var::getVar("a");
+	VarPtr fresh = Var::getVar();
+
+	// the ids are dense and a new variable gets the next one
+	CPPUNIT_ASSERT( a < fresh );
+	CPPUNIT_ASSERT( Var::getVar()->string() == "_" + std::to_string(fresh.getId() + 1) );
+	CPPUNIT_ASSERT( VarPtr(a.getId()) == a );
+	CPPUNIT_ASSERT( a->string() == "a" );
+	CPPUNIT_ASSERT( std::hash<VarPtr>()(a) == std::hash<VarPtr>()(Var::getVar("a")) );
+
+	// the default one is not a variable
+	CPPUNIT_ASSERT( !VarPtr() );
+	CPPUNIT_ASSERT( a );
+}
+
+void VarTest::testConcurrentVars()
+{
+	// every thread creates the same named and some fresh variables
+	const int threads = 4;
+	const int count = 1000;
+	std::vector< std::vector<VarPtr> > named(threads), fresh(threads);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; ++t) {
+		workers.emplace_back([&named, &fresh, t, count]() {
+			for (int i = 0; i < count; ++i) {
+				named[t].push_back(Var::getVar("concurrent_var_" + std::to_string(i)));
+				fresh[t].push_back(Var::getVar());
+			}
+		});
+	}
+	for (auto &worker : workers) {
+		worker.join();
+	}
+
+	std::vector<VarPtr> all_fresh;
+	for (int t = 0; t < threads; ++t) {
+		CPPUNIT_ASSERT( named[t] == named[0] );
+		all_fresh.insert(all_fresh.end(), fresh[t].begin(), fresh[t].end());
+	}
+	for (int i = 0; i < count; ++i) {
+		CPPUNIT_ASSERT( named[0][i]->string() == "concurrent_var_" + std::to_string(i) );
+	}
+	// the fresh variables all got their own ids
+	std::sort(all_fresh.begin(), all_fresh.end());
+	CPPUNIT_ASSERT( std::unique(all_fresh.begin(), all_fresh.end()) == all_fresh.end() );
+	for (const auto &var : all_fresh) {
+		CPPUNIT_ASSERT( var->string() == "_" + std::to_string(var.getId()) );
+	}
+}
@@ -8,6 +8,8 @@ class VarTest : public CppUnit::TestFixture
 {
 	CPPUNIT_TEST_SUITE(VarTest);
 	CPPUNIT_TEST(testIdentity);
+	CPPUNIT_TEST(testIds);
+	CPPUNIT_TEST(testConcurrentVars);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -16,6 +18,8 @@ public:
 
 protected:
 	void testIdentity();
+	void testIds();
+	void testConcurrentVars();
 };
 
 #endif